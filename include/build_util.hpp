@@ -1,157 +1,189 @@
 #pragma once
 
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#include "include/task_scheduler.hpp"
 #include "external/sketch/include/sketch/hll.h"
 #include "external/kmeans/include/kmeans.hpp"
 
 namespace fulgor {
 
-void build_reference_sketches(hfur_index_t const& index,
-                              uint64_t p,                  // use 2^p bytes per HLL sketch
-                              uint64_t num_threads,        // num. threads for construction
-                              std::string output_filename  // where the sketches will be serialized
-) {
-    assert(num_threads > 0);
-
-    const uint64_t num_colors = index.num_colors();
-    typename sketch::hll_t::HashType hasher;
-    auto const& u2c = index.get_u2c();
-    auto const& u2c_rank1_index = index.get_u2c_rank1_index();
-    auto const& ccs = index.get_color_sets();
-    const uint64_t num_color_sets = ccs.num_color_sets();
-    const uint64_t num_ones = u2c_rank1_index.num_ones();
-    assert(u2c.num_bits() > 0);
-    const uint64_t last_pos = u2c.num_bits() - 1;
-    assert(num_color_sets == num_ones);
-
-    if (num_ones < num_threads) {
-        throw std::runtime_error("there are only " + std::to_string(num_color_sets) +
-                                 ": reduce the number of threads.");
-    }
+/* x = max(x, val), atomically: concurrent updates of the same x never lose the largest */
+template <typename T>
+void atomic_update_max(T& x, const T val) {
+    T curr = __atomic_load_n(&x, __ATOMIC_RELAXED);
+    while (val > curr and
+           !__atomic_compare_exchange_n(&x, &curr, val, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
 
-    std::vector<std::vector<sketch::hll_t>> thread_sketches(
-        num_threads, std::vector<sketch::hll_t>(num_colors, sketch::hll_t(p)));
+/* x = min(x, val), atomically */
+template <typename T>
+void atomic_update_min(T& x, const T val) {
+    T curr = __atomic_load_n(&x, __ATOMIC_RELAXED);
+    while (val < curr and
+           !__atomic_compare_exchange_n(&x, &curr, val, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
 
-    struct slice {
-        uint64_t begin;                         // start position in u2c
-        uint64_t color_id_begin, color_id_end;  // [..)
-    };
-    std::vector<slice> thread_slices;
+/*
+    Parallel visit of the runs of unitigs of an index (see index::u2c), in chunks of about the
+    same load: the load of a run is the size of its color set times its number of unitigs.
+*/
+template <typename Index>
+struct unitig_runs_scheduler {
+    unitig_runs_scheduler(Index const& index, const uint64_t num_threads)
+        : m_index(index), m_scheduler(num_threads) {
+        auto const& u2c = index.get_u2c();
+        m_num_runs = index.get_u2c_rank1_index().num_ones();
+        assert(u2c.num_bits() > 0);
 
-    /* compute load */
-    uint64_t load = 0;
-    {
-        uint64_t pop_count = 0;
-        uint64_t prev_pos = 0;
-        auto unary_it = u2c.begin();
-        for (uint64_t color_id = 0; color_id != num_color_sets; ++color_id) {
-            uint64_t curr_pos = pop_count != num_ones ? unary_it.next() : last_pos;
-            uint64_t num_unitigs = curr_pos - prev_pos + 1;
-            auto it = ccs.color_set(color_id);
-            uint64_t size = it.size();
-            load += size * num_unitigs;
-            pop_count += 1;
-            prev_pos = curr_pos + 1;
+        std::vector<uint64_t> run_load(m_num_runs);
+        uint64_t load = 0;
+        {
+            uint64_t prev_pos = 0;
+            auto unary_it = u2c.begin();
+            for (uint64_t run_id = 0; run_id != m_num_runs; ++run_id) {
+                uint64_t curr_pos = end_of_run(unary_it, run_id);
+                run_load[run_id] = color_set(run_id).size() * (curr_pos - prev_pos + 1);
+                load += run_load[run_id];
+                prev_pos = curr_pos + 1;
+            }
         }
-    }
+        m_scheduler.add(
+            0, m_num_runs, m_scheduler.chunk_weight(load),
+            [&](uint64_t run_id) { return run_load[run_id]; }, [](uint64_t) { return true; });
 
-    const uint64_t load_per_thread = load / num_threads;
-    if (load_per_thread == 0) {
-        throw std::runtime_error("load is too small: reduce the number of threads");
-    }
-
-    {
+        /* position in u2c of the first unitig of every chunk */
+        m_chunk_begin.resize(m_scheduler.num_chunks());
         uint64_t prev_pos = 0;
+        uint64_t chunk_id = 0;
         auto unary_it = u2c.begin();
-        slice s;
-        s.begin = 0;
-        s.color_id_begin = 0;
-        uint64_t cur_load = 0;
-
-        for (uint64_t color_id = 0; color_id != num_color_sets; ++color_id) {
-            uint64_t curr_pos = color_id != num_color_sets - 1 ? unary_it.next() : last_pos;
-
-            uint64_t num_unitigs = curr_pos - prev_pos + 1;
-            auto it = ccs.color_set(color_id);
-            uint64_t size = it.size();
-            cur_load += size * num_unitigs;
-            prev_pos = curr_pos + 1;
-
-            if (cur_load >= load_per_thread or color_id == num_color_sets - 1) {
-                s.color_id_end = color_id + 1;
-                thread_slices.push_back(s);
-                s.begin = prev_pos;
-                s.color_id_begin = color_id + 1;
-                cur_load = 0;
+        for (uint64_t run_id = 0; run_id != m_num_runs; ++run_id) {
+            if (chunk_id != m_scheduler.num_chunks() and
+                m_scheduler.chunks()[chunk_id].begin == run_id) {
+                m_chunk_begin[chunk_id++] = prev_pos;
             }
+            prev_pos = end_of_run(unary_it, run_id) + 1;
         }
-
-        num_threads = thread_slices.size();
     }
 
-    auto exe = [&](uint64_t thread_id) {
-        assert(thread_id < thread_slices.size());
-        auto& sketches = thread_sketches[thread_id];
-        auto s = thread_slices[thread_id];
-        uint64_t prev_pos = s.begin;
-        std::vector<uint64_t> hashes;
-        auto unary_it = u2c.get_iterator_at(s.begin);
-        for (uint64_t color_id = s.color_id_begin; color_id != s.color_id_end; ++color_id) {
-            uint64_t curr_pos = color_id != num_color_sets - 1 ? unary_it.next() : last_pos;
-            auto it = ccs.color_set(color_id);
-            const uint64_t size = it.size();
-            hashes.reserve(curr_pos - prev_pos + 1);
-            for (uint64_t unitig_id = prev_pos; unitig_id <= curr_pos; ++unitig_id) {
-                assert(unitig_id < u2c.num_bits());
-                assert(index.u2c(unitig_id) == color_id);
-                hashes.push_back(hasher.hash(unitig_id));
+    /*
+        Call visit(thread_id, color_set_iterator, first_unitig_id, last_unitig_id)
+        for every run of unitigs.
+    */
+    template <typename Visitor>
+    void run(Visitor const& visit) const {
+        m_scheduler.run([&](uint64_t thread_id, uint64_t chunk_id) {
+            auto const& chunk = m_scheduler.chunks()[chunk_id];
+            uint64_t prev_pos = m_chunk_begin[chunk_id];
+            auto unary_it = m_index.get_u2c().get_iterator_at(prev_pos);
+            for (uint64_t run_id = chunk.begin; run_id != chunk.end; ++run_id) {
+                uint64_t curr_pos = end_of_run(unary_it, run_id);
+                visit(thread_id, color_set(run_id), prev_pos, curr_pos);
+                prev_pos = curr_pos + 1;
             }
-            for (uint64_t i = 0; i != size; ++i, ++it) {
-                uint32_t ref_id = *it;
-                assert(ref_id < num_colors);
-                for (auto hash : hashes) sketches[ref_id].add(hash);
-            }
-            prev_pos = curr_pos + 1;
-            hashes.clear();
-        }
-    };
+        });
+    }
+
+private:
+    Index const& m_index;
+    task_scheduler m_scheduler;
+    uint64_t m_num_runs;
+    std::vector<uint64_t> m_chunk_begin;
 
-    std::vector<std::thread> threads(num_threads);
-    for (uint64_t thread_id = 0; thread_id != num_threads; ++thread_id) {
-        threads[thread_id] = std::thread(exe, thread_id);
+    auto color_set(const uint64_t run_id) const {
+        auto const& u2c_map = m_index.get_u2c_map();
+        return m_index.get_color_sets().color_set(u2c_map.size() == 0 ? run_id
+                                                                      : u2c_map[run_id]);
     }
-    for (auto& t : threads) {
-        if (t.joinable()) t.join();
+
+    template <typename UnaryIterator>
+    uint64_t end_of_run(UnaryIterator& unary_it, const uint64_t run_id) const {
+        return run_id != m_num_runs - 1 ? unary_it.next() : m_index.get_u2c().num_bits() - 1;
     }
+};
 
-    /* merge sketches into thread_sketches[0] */
-    for (uint64_t i = 0; i != num_colors; ++i) {
-        auto& sketch = thread_sketches[0][i];
-        for (uint64_t thread_id = 1; thread_id != num_threads; ++thread_id) {
-            sketch += thread_sketches[thread_id][i];
-        }
+/*
+    All threads update the same sketches, taking the maximum of the registers atomically, so
+    that the sketches take O(num_colors) memory regardless of the number of threads.
+    If the sketches of all references do not fit in ram_limit_in_bytes, the references are
+    sketched in ranges, one pass per range.
+*/
+void build_reference_sketches(hfur_index_t const& index,
+                              uint64_t p,                   // use 2^p bytes per HLL sketch
+                              uint64_t num_threads,         // num. threads for construction
+                              std::string output_filename,  // where the sketches will be serialized
+                              uint64_t ram_limit_in_bytes   // memory for the sketches
+) {
+    assert(num_threads > 0);
+    assert(p > 0 and p < 64);
+
+    const uint64_t num_colors = index.num_colors();
+    typename sketch::hll_t::HashType hasher;
+    unitig_runs_scheduler<hfur_index_t> scheduler(index, num_threads);
+
+    const uint64_t num_bytes = 1ULL << p;
+    const uint64_t num_colors_per_pass = std::min<uint64_t>(
+        std::max<uint64_t>(ram_limit_in_bytes / num_bytes, 1), num_colors);
+    if (num_colors_per_pass != num_colors) {
+        std::cout << "sketching " << num_colors_per_pass
+                  << " references per pass to fit the RAM limit" << std::endl;
     }
 
     std::ofstream out(output_filename, std::ios::binary);
     if (!out.is_open()) throw std::runtime_error("cannot open file");
-    const uint64_t num_bytes = 1ULL << p;
     out.write(reinterpret_cast<char const*>(&num_bytes), 8);
     out.write(reinterpret_cast<char const*>(&num_colors), 8);
-    for (auto const& x : thread_sketches[0]) {
-        assert(x.m() == num_bytes);
-        assert(x.m() == x.core().size());
-        uint8_t const* data = x.data();
-        out.write(reinterpret_cast<char const*>(data), num_bytes);
+
+    /* the HLL registers, as sketch::hll_t computes them */
+    std::vector<uint8_t> registers;
+    for (uint64_t ref_begin = 0; ref_begin < num_colors; ref_begin += num_colors_per_pass) {
+        const uint64_t ref_end = std::min(ref_begin + num_colors_per_pass, num_colors);
+        registers.assign((ref_end - ref_begin) * num_bytes, 0);
+
+        scheduler.run([&](uint64_t /* thread_id */, auto it, uint64_t first_unitig_id,
+                          uint64_t last_unitig_id) {
+            const uint64_t size = it.size();
+            std::vector<uint64_t> hashes;
+            hashes.reserve(last_unitig_id - first_unitig_id + 1);
+            for (uint64_t unitig_id = first_unitig_id; unitig_id <= last_unitig_id; ++unitig_id) {
+                hashes.push_back(hasher.hash(unitig_id));
+            }
+            for (uint64_t i = 0; i != size; ++i, ++it) {
+                uint32_t ref_id = *it;
+                assert(ref_id < num_colors);
+                if (ref_id < ref_begin) continue;
+                if (ref_id >= ref_end) break;  // color sets are sorted
+                uint8_t* sketch = registers.data() + (ref_id - ref_begin) * num_bytes;
+                for (auto hash : hashes) {
+                    const uint64_t register_id = hash >> (64 - p);
+                    const uint8_t rank = __builtin_clzll(((hash << 1) | 1) << (p - 1)) + 1;
+                    atomic_update_max(sketch[register_id], rank);
+                }
+            }
+        });
+
+        out.write(reinterpret_cast<char const*>(registers.data()), registers.size());
     }
     out.close();
 }
 
+/*
+    Sketch the color sets whose size is in (left * num_colors, right * num_colors].
+    The sketches are computed and written in windows of as many as fit in ram_limit_in_bytes.
+*/
 template <typename Index>
 void build_colors_sketches_sliced(
     Index const& index,
     uint64_t p,                   // use 2^p bytes per HLL sketch
     uint64_t num_threads,         // num. threads for construction
     std::string output_filename,  // where the sketches will be serialized
-    double left, double right)    //
+    double left, double right,    //
+    uint64_t ram_limit_in_bytes)  // memory for the sketches
 {
     assert(num_threads > 0);
 
@@ -165,73 +197,15 @@ void build_colors_sketches_sliced(
 
     if (num_color_sets < num_threads) { num_threads = num_color_sets; }
 
-    uint64_t load = 0;
     std::vector<uint64_t> filtered_colors_ids;
     filtered_colors_ids.reserve(num_color_sets);
     for (uint64_t color_id = 0; color_id != num_color_sets; ++color_id) {
         auto it = index.color_set(color_id);
         uint64_t size = it.size();
-        if (size > min_size && size <= max_size) {
-            load += size;
-            filtered_colors_ids.push_back(color_id);
-        }
+        if (size > min_size && size <= max_size) filtered_colors_ids.push_back(color_id);
     }
     const uint64_t partition_size = filtered_colors_ids.size();
 
-    struct slice {
-        uint64_t begin, end;  // [..)
-    };
-    std::vector<slice> thread_slices;
-
-    uint64_t load_per_thread = load / num_threads;
-    {
-        slice s;
-        s.begin = 0;
-        uint64_t curr_load = 0;
-
-        for (uint64_t i = 0; i != partition_size; ++i) {
-            auto color_id = filtered_colors_ids[i];
-            auto it = index.color_set(color_id);
-            curr_load += it.size();
-            if (curr_load >= load_per_thread || i == partition_size - 1) {
-                s.end = i + 1;
-                thread_slices.push_back(s);
-                s.begin = i + 1;
-                curr_load = 0;
-            }
-        }
-        assert(thread_slices.size() <= num_threads);
-    }
-    num_threads = thread_slices.size();
-    std::vector<std::vector<sketch::hll_t>> thread_sketches(num_threads);
-
-    auto exe = [&](uint64_t thread_id) {
-        assert(thread_id < thread_slices.size());
-        auto& sketches = thread_sketches[thread_id];
-        auto s = thread_slices[thread_id];
-        sketches = std::vector<sketch::hll_t>(s.end - s.begin, sketch::hll_t(p));
-
-        for (uint64_t i = s.begin; i != s.end; ++i) {
-            auto color_id = filtered_colors_ids[i];
-            auto it = index.color_set(color_id);
-            const uint64_t size = it.size();
-            assert(size > 0);
-            for (uint64_t j = 0; j < size; ++j, ++it) {
-                uint64_t ref_id = *it;
-                assert(ref_id < num_colors);
-                sketches[i - s.begin].addh(ref_id);
-            }
-        }
-    };
-
-    std::vector<std::thread> threads(num_threads);
-    for (uint64_t thread_id = 0; thread_id != num_threads; ++thread_id) {
-        threads[thread_id] = std::thread(exe, thread_id);
-    }
-    for (auto& t : threads) {
-        if (t.joinable()) t.join();
-    }
-
     std::ofstream out(output_filename, std::ios::binary);
     if (!out.is_open()) throw std::runtime_error("cannot open file");
     const uint64_t num_bytes = 1ULL << p;
@@ -241,12 +215,78 @@ void build_colors_sketches_sliced(
     for (auto const color_id : filtered_colors_ids) {
         out.write(reinterpret_cast<char const*>(&color_id), 8);
     }
-    for (auto const& sketch : thread_sketches) {
-        for (auto const& x : sketch) {
-            assert(x.m() == num_bytes);
-            assert(x.m() == x.core().size());
-            uint8_t const* data = x.data();
-            out.write(reinterpret_cast<char const*>(data), num_bytes);
+
+    struct slice {
+        uint64_t begin, end;  // [..)
+    };
+
+    const uint64_t window_size =
+        std::max<uint64_t>(ram_limit_in_bytes / num_bytes, std::max<uint64_t>(num_threads, 1));
+    for (uint64_t window_begin = 0; window_begin < partition_size; window_begin += window_size) {
+        const uint64_t window_end = std::min(window_begin + window_size, partition_size);
+
+        uint64_t load = 0;
+        for (uint64_t i = window_begin; i != window_end; ++i) {
+            load += index.color_set(filtered_colors_ids[i]).size();
+        }
+
+        std::vector<slice> thread_slices;
+        uint64_t load_per_thread = load / num_threads;
+        {
+            slice s;
+            s.begin = window_begin;
+            uint64_t curr_load = 0;
+
+            for (uint64_t i = window_begin; i != window_end; ++i) {
+                auto color_id = filtered_colors_ids[i];
+                auto it = index.color_set(color_id);
+                curr_load += it.size();
+                if (curr_load >= load_per_thread || i == window_end - 1) {
+                    s.end = i + 1;
+                    thread_slices.push_back(s);
+                    s.begin = i + 1;
+                    curr_load = 0;
+                }
+            }
+            assert(thread_slices.size() <= num_threads);
+        }
+        const uint64_t num_slices = thread_slices.size();
+        std::vector<std::vector<sketch::hll_t>> thread_sketches(num_slices);
+
+        auto exe = [&](uint64_t thread_id) {
+            assert(thread_id < thread_slices.size());
+            auto& sketches = thread_sketches[thread_id];
+            auto s = thread_slices[thread_id];
+            sketches = std::vector<sketch::hll_t>(s.end - s.begin, sketch::hll_t(p));
+
+            for (uint64_t i = s.begin; i != s.end; ++i) {
+                auto color_id = filtered_colors_ids[i];
+                auto it = index.color_set(color_id);
+                const uint64_t size = it.size();
+                assert(size > 0);
+                for (uint64_t j = 0; j < size; ++j, ++it) {
+                    uint64_t ref_id = *it;
+                    assert(ref_id < num_colors);
+                    sketches[i - s.begin].addh(ref_id);
+                }
+            }
+        };
+
+        std::vector<std::thread> threads(num_slices);
+        for (uint64_t thread_id = 0; thread_id != num_slices; ++thread_id) {
+            threads[thread_id] = std::thread(exe, thread_id);
+        }
+        for (auto& t : threads) {
+            if (t.joinable()) t.join();
+        }
+
+        for (auto const& sketch : thread_sketches) {
+            for (auto const& x : sketch) {
+                assert(x.m() == num_bytes);
+                assert(x.m() == x.core().size());
+                uint8_t const* data = x.data();
+                out.write(reinterpret_cast<char const*>(data), num_bytes);
+            }
         }
     }
     out.close();
@@ -1,7 +1,19 @@
 #pragma once
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <exception>
+#include <memory>
+#include <functional>
+#include <random>
+
 #include "include/index.hpp"
 #include "include/GGCAT.hpp"
+#include "include/checkpoint.hpp"
+#include "include/builders/concurrent_sshash_builder.hpp"
 
 namespace fulgor {
 
@@ -35,6 +47,186 @@ private:
     std::vector<uint32_t> m_buffer;
 };
 
+/*
+    Encodes color sets in parallel and appends the encodings to a single builder,
+    in the same order in which the color sets were inserted.
+
+    Color sets are collected into buffers: a full buffer gets a sequence number and is
+    encoded by a persistent pool of num_threads workers. Encoded buffers are appended
+    in sequence order by a single appender thread, that then hands the buffer back
+    for reuse. At most num_threads buffers exist at any time: insert() blocks (without
+    spinning) when all of them are being encoded or waiting to be appended.
+*/
+template <typename ColorSetsBuilder>
+struct ordered_color_sets_encoder {
+    ordered_color_sets_encoder(ColorSetsBuilder& main_builder, const uint64_t num_colors,
+                               const uint64_t num_threads, const uint64_t buffer_size)
+        : m_main_builder(main_builder)
+        , m_curr(nullptr)
+        , m_next_seq(0)
+        , m_next_seq_to_append(0)
+        , m_no_more_tasks(false)
+        , m_finished(false) {
+        assert(num_threads > 0);
+        assert(buffer_size > num_colors);
+        m_slots.reserve(num_threads);
+        for (uint64_t i = 0; i != num_threads; ++i) {
+            m_slots.push_back(std::make_unique<slot>(num_colors, buffer_size));
+            /* reserve for each build as much space as for the uncompressed buffers */
+            m_slots.back()->builder.reserve_num_bits(buffer_size * 32 / 8);
+            m_free.push_back(m_slots.back().get());
+        }
+        m_workers.reserve(num_threads);
+        for (uint64_t i = 0; i != num_threads; ++i) {
+            m_workers.emplace_back([this]() { encode(); });
+        }
+        m_appender = std::thread([this]() { append(); });
+        m_curr = acquire();
+    }
+
+    ~ordered_color_sets_encoder() {
+        if (!m_finished) stop();
+    }
+
+    void insert(uint32_t const* data, const uint32_t size) {
+        if (m_curr->buf.insert(data, size)) return;
+        submit();
+        m_curr = acquire();
+        m_curr->buf.insert(data, size);
+    }
+
+    /*
+        Call f(b, builders) before the first buffer b is encoded, with all the builders
+        (the main one first), e.g. to set their parameters.
+    */
+    void on_first_buffer(
+        std::function<void(buffer const&, std::vector<ColorSetsBuilder*> const&)> f) {
+        m_on_first_buffer = std::move(f);
+    }
+
+    /* encode the color sets still buffered and wait until all are appended */
+    void finish() {
+        if (m_curr->buf.num_sets() != 0) submit();
+        stop();
+        if (m_exception) std::rethrow_exception(m_exception);
+    }
+
+private:
+    struct slot {
+        slot(const uint64_t num_colors, const uint64_t buffer_size)
+            : builder(num_colors), buf(buffer_size), seq(0) {}
+        ColorSetsBuilder builder;
+        buffer buf;
+        uint64_t seq;
+    };
+
+    ColorSetsBuilder& m_main_builder;
+    std::vector<std::unique_ptr<slot>> m_slots;
+    slot* m_curr;  // the buffer being filled
+    uint64_t m_next_seq, m_next_seq_to_append;
+
+    std::mutex m_mut;
+    std::condition_variable m_free_cv, m_tasks_cv, m_encoded_cv;
+    std::vector<slot*> m_free;
+    std::deque<slot*> m_tasks;
+    std::map<uint64_t, slot*> m_encoded;  // by sequence number
+    bool m_no_more_tasks, m_finished;
+    std::exception_ptr m_exception;
+    std::function<void(buffer const&, std::vector<ColorSetsBuilder*> const&)> m_on_first_buffer;
+
+    std::vector<std::thread> m_workers;
+    std::thread m_appender;
+
+    slot* acquire() {
+        std::unique_lock lock(m_mut);
+        m_free_cv.wait(lock, [&]() { return !m_free.empty(); });
+        slot* s = m_free.back();
+        m_free.pop_back();
+        return s;
+    }
+
+    void submit() {
+        if (m_next_seq == 0 and m_on_first_buffer) {
+            /* no buffer is being encoded yet */
+            std::vector<ColorSetsBuilder*> builders = {&m_main_builder};
+            for (auto& s : m_slots) builders.push_back(&s->builder);
+            m_on_first_buffer(m_curr->buf, builders);
+        }
+        m_curr->seq = m_next_seq++;
+        std::lock_guard lock(m_mut);
+        m_tasks.push_back(m_curr);
+        m_tasks_cv.notify_one();
+    }
+
+    void stop() {
+        {
+            std::lock_guard lock(m_mut);
+            m_no_more_tasks = true;
+        }
+        m_tasks_cv.notify_all();
+        m_encoded_cv.notify_all();
+        for (auto& t : m_workers) t.join();
+        m_appender.join();
+        m_finished = true;
+    }
+
+    void encode() {
+        while (true) {
+            slot* s = nullptr;
+            {
+                std::unique_lock lock(m_mut);
+                m_tasks_cv.wait(lock, [&]() { return !m_tasks.empty() or m_no_more_tasks; });
+                if (m_tasks.empty()) break;
+                s = m_tasks.front();
+                m_tasks.pop_front();
+            }
+            try {
+                buffer const& b = s->buf;
+                s->builder.clear();
+                for (uint32_t i = 0, pos = 0; i < b.num_sets(); i++) {
+                    uint32_t size = b[pos++];
+                    s->builder.encode_color_set(b.data() + pos, size);
+                    pos += size;
+                }
+            } catch (...) {
+                std::lock_guard lock(m_mut);
+                if (!m_exception) m_exception = std::current_exception();
+            }
+            std::lock_guard lock(m_mut);
+            m_encoded.emplace(s->seq, s);
+            m_encoded_cv.notify_one();
+        }
+    }
+
+    void append() {
+        while (true) {
+            slot* s = nullptr;
+            {
+                std::unique_lock lock(m_mut);
+                m_encoded_cv.wait(lock, [&]() {
+                    return m_encoded.count(m_next_seq_to_append) != 0 or
+                           (m_no_more_tasks and m_next_seq_to_append == m_next_seq);
+                });
+                auto it = m_encoded.find(m_next_seq_to_append);
+                if (it == m_encoded.end()) break;  // all appended
+                s = it->second;
+                m_encoded.erase(it);
+            }
+            try {
+                if (!m_exception) m_main_builder.append(s->builder);
+            } catch (...) {
+                std::lock_guard lock(m_mut);
+                if (!m_exception) m_exception = std::current_exception();
+            }
+            s->buf.clear();
+            std::lock_guard lock(m_mut);
+            ++m_next_seq_to_append;
+            m_free.push_back(s);
+            m_free_cv.notify_one();
+        }
+    }
+};
+
 template <typename ColorSets>
 struct index<ColorSets>::builder {
     builder() {}
@@ -61,7 +253,48 @@ struct index<ColorSets>::builder {
                                                 util::filename(m_build_config.file_base_name) +
                                                 ".sshash.fa";
 
-        {
+        sshash::build_configuration sshash_config;
+        sshash_config.k = m_build_config.k;
+        sshash_config.m = m_build_config.m;
+        sshash_config.canonical = true;
+        sshash_config.verbose = m_build_config.verbose;
+        sshash_config.tmp_dirname = m_build_config.tmp_dirname;
+        sshash_config.num_threads = util::largest_power_of_2(m_build_config.num_threads);
+        sshash_config.print();
+
+        checkpoint cp(m_build_config, ColorSets::type);
+        const bool color_sets_done = cp.completed("fur.color_sets");
+        const bool k2u_done = color_sets_done and cp.completed("fur.k2u");
+
+        /* SSHash is built from the unitigs while they are written in step 2 */
+        std::unique_ptr<concurrent_sshash_builder> k2u_builder;
+        if (k2u_done) {
+            cp.load("fur.k2u", idx.m_k2u);
+        } else {
+            k2u_builder = std::make_unique<concurrent_sshash_builder>(
+                idx.m_k2u, input_filename_for_sshash, sshash_config);
+            if (k2u_builder->streaming()) {
+                std::cout << "SSHash is built concurrently with step 2" << std::endl;
+            }
+        }
+
+        if (color_sets_done) {
+            essentials::logger("step 2. loading unitig-to-color map and color sets...");
+            cp.load("fur.color_sets", idx.m_color_sets, idx.m_u2c);
+            idx.m_u2c_rank1_index.build(idx.m_u2c);
+            if (k2u_builder) {
+                m_ccdbg.loop_through_unitigs([&](ggcat::Slice<char> const unitig,
+                                                 ggcat::Slice<uint32_t> const /* color_set */,
+                                                 bool /* same_color_set */) {
+                    try {
+                        k2u_builder->append(unitig.data, unitig.size);
+                    } catch (std::exception const& e) {
+                        std::cerr << e.what() << std::endl;
+                        exit(1);
+                    }
+                });
+            }
+        } else {
             essentials::logger("step 2. building unitig-to-color map and encoding color sets...");
             timer.start();
 
@@ -70,63 +303,74 @@ struct index<ColorSets>::builder {
 
             typename ColorSets::builder main_builder(m_build_config.num_colors);
 
-            const uint64_t num_threads = m_build_config.num_threads;
-            std::vector<typename ColorSets::builder> thread_builders(num_threads,
-                                                                     m_build_config.num_colors);
-
+            /*
+                Every thread has a buffer and the space to encode it: give them at most
+                half of the RAM limit (4 bytes per buffered integer and as many for encoding),
+                but always enough to buffer the largest color set.
+            */
             constexpr uint64_t MAX_BUFFER_SIZE = 1 << 28;
+            const uint64_t ram_buffer_size =
+                m_build_config.ram_limit_in_bytes(2 * m_build_config.num_threads) / 8;
             uint64_t buffer_size = std::min(m_build_config.num_colors * 10000, MAX_BUFFER_SIZE);
-            std::vector<std::thread> threads(num_threads);
-            std::vector<buffer> thread_buffers(num_threads, buffer_size);
-
-            /* reserve for each build as much space as for the uncompressed buffers */
-            for (auto& b : thread_builders) b.reserve_num_bits(buffer_size * 32 / 8);
-
-            assert(thread_buffers[0].capacity() > m_build_config.num_colors);
-            uint32_t curr_thread = 0;
-            std::atomic<uint32_t> appending_thread = 0;
-
-            auto encode_color_sets_and_append = [&](uint64_t thread_id) {
-                buffer const& b = thread_buffers[thread_id];
-                thread_builders[thread_id].clear();
-                for (uint32_t i = 0, pos = 0; i < b.num_sets(); i++) {
-                    uint32_t size = b[pos++];
-                    thread_builders[thread_id].encode_color_set(b.data() + pos, size);
-                    pos += size;
-                }
-                while (appending_thread != thread_id) {}
-                main_builder.append(thread_builders[thread_id]);
-                appending_thread = (appending_thread + 1) % num_threads;
-            };
+            buffer_size = std::max(std::min(buffer_size, ram_buffer_size),
+                                   2 * (m_build_config.num_colors + 1));
+            ordered_color_sets_encoder encoder(main_builder, m_build_config.num_colors,
+                                               m_build_config.num_threads, buffer_size);
+            if (m_build_config.tune_for != tuning_t::NO_TUNING) {
+                /*
+                    Tune the thresholds of the encoding on a uniform sample of the distinct
+                    color sets, drawn with reservoir sampling in a first pass over the unitigs:
+                    the color sets come in GGCAT order, so a prefix would not represent them.
+                */
+                essentials::logger("sampling color sets to tune the thresholds...");
+                typename ColorSets::thresholds_tuner tuner(m_build_config.num_colors);
+                std::vector<std::vector<uint32_t>> sample;
+                std::mt19937_64 rng(0);
+                uint64_t num_color_sets = 0;
+                m_ccdbg.loop_through_unitigs([&](ggcat::Slice<char> const /* unitig */,
+                                                 ggcat::Slice<uint32_t> const color_set,
+                                                 bool same_color_set) {
+                    if (same_color_set or color_set.size == 0) return;
+                    num_color_sets += 1;
+                    if (sample.size() < tuner.max_num_sets()) {
+                        sample.emplace_back(color_set.data, color_set.data + color_set.size);
+                        return;
+                    }
+                    const uint64_t i = rng() % num_color_sets;
+                    if (i < sample.size()) {
+                        sample[i].assign(color_set.data, color_set.data + color_set.size);
+                    }
+                });
+                for (auto const& color_set : sample) tuner.add(color_set.data(), color_set.size());
+                std::vector<std::vector<uint32_t>>().swap(sample);
+
+                auto t = tuner.tune(m_build_config.tune_for);
+                encoder.on_first_buffer([t](buffer const& /* b */, auto const& builders) {
+                    for (auto builder : builders) {
+                        builder->set_thresholds(t.sparse_set_threshold_size,
+                                                t.very_dense_set_threshold_size);
+                    }
+                });
+                std::cout << "tuned the thresholds on " << tuner.num_sets() << " of the "
+                          << num_color_sets << " color sets: sparse below "
+                          << t.sparse_set_threshold_size << " colors, very dense from "
+                          << t.very_dense_set_threshold_size << " colors (sample: " << t.num_bits
+                          << " bits, decoded in " << t.nanosec / 1000
+                          << " us; with the default thresholds: " << t.default_num_bits
+                          << " bits, " << t.default_nanosec / 1000 << " us)" << std::endl;
+            }
 
             bits::bit_vector::builder u2c_builder;
 
-            /* write unitigs to fasta file for SSHash */
-            std::ofstream out(input_filename_for_sshash.c_str());
-            if (!out.is_open()) throw std::runtime_error("cannot open output file");
-
             m_ccdbg.loop_through_unitigs([&](ggcat::Slice<char> const unitig,
                                              ggcat::Slice<uint32_t> const color_set,
                                              bool same_color_set) {
-                assert(curr_thread >= 0);
-                assert(curr_thread < num_threads);
                 try {
                     if (!same_color_set) {
                         num_distinct_color_sets += 1;
                         if (num_unitigs > 0) u2c_builder.set(num_unitigs - 1, 1);
 
-                        /* fill buffers */
-                        if (!thread_buffers[curr_thread].insert(color_set.data, color_set.size)) {
-                            threads[curr_thread] =
-                                std::thread(encode_color_sets_and_append, curr_thread);
-                            const uint32_t next_thread = (curr_thread + 1) % num_threads;
-                            if (threads[next_thread].joinable()) threads[next_thread].join();
-
-                            curr_thread = next_thread;
-
-                            thread_buffers[curr_thread].clear();
-                            thread_buffers[curr_thread].insert(color_set.data, color_set.size);
-                        }
+                        encoder.insert(color_set.data, color_set.size);
                     }
                     u2c_builder.push_back(0);
 
@@ -135,9 +379,7 @@ struct index<ColorSets>::builder {
                         This is *not* the same order in which
                         unitigs are written in the ggcat.fa file.
                     */
-                    out << ">\n";
-                    out.write(unitig.data, unitig.size);
-                    out << '\n';
+                    k2u_builder->append(unitig.data, unitig.size);
 
                     num_unitigs += 1;
 
@@ -147,12 +389,7 @@ struct index<ColorSets>::builder {
                 }
             });
 
-            threads[curr_thread] = std::thread(encode_color_sets_and_append, curr_thread);
-            for (auto& t : threads) {
-                if (t.joinable()) t.join();
-            }
-
-            out.close();
+            encoder.finish();
 
             assert(num_unitigs > 0);
             assert(num_unitigs < (uint64_t(1) << 32));
@@ -182,29 +419,20 @@ struct index<ColorSets>::builder {
             std::cout << "** building unitig-to-color map took " << timer.elapsed() << " seconds / "
                       << timer.elapsed() / 60 << " minutes" << std::endl;
             timer.reset();
+
+            cp.save("fur.color_sets", idx.m_color_sets, idx.m_u2c);
         }
 
-        {
+        if (k2u_builder) {
             essentials::logger("step 3. building SSHash...");
             timer.start();
-
-            sshash::build_configuration sshash_config;
-            sshash_config.k = m_build_config.k;
-            sshash_config.m = m_build_config.m;
-            sshash_config.canonical = true;
-            sshash_config.verbose = m_build_config.verbose;
-            sshash_config.tmp_dirname = m_build_config.tmp_dirname;
-            sshash_config.num_threads = util::largest_power_of_2(m_build_config.num_threads);
-            sshash_config.print();
-            idx.m_k2u.build(input_filename_for_sshash, sshash_config);
-            try {  // remove unitig file
-                std::remove(input_filename_for_sshash.c_str());
-            } catch (std::exception const& e) { std::cerr << e.what() << std::endl; }
-
+            k2u_builder->wait();
             timer.stop();
-            std::cout << "** building SSHash took " << timer.elapsed() << " seconds / "
+            std::cout << "** building SSHash took " << timer.elapsed() << " more seconds / "
                       << timer.elapsed() / 60 << " minutes" << std::endl;
             timer.reset();
+
+            cp.save("fur.k2u", idx.m_k2u);
         }
 
         {
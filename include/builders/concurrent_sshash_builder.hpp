@@ -0,0 +1,123 @@
+#pragma once
+
+#include <string>
+#include <thread>
+#include <fstream>
+#include <exception>
+#include <stdexcept>
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "include/index.hpp"
+
+namespace fulgor {
+
+/*
+    Builds an sshash::dictionary in a background thread while the unitigs are still
+    being produced: the unitig file is a named pipe (FIFO), that SSHash parses as
+    it is filled by append(). If a FIFO cannot be created (e.g., the file system does
+    not support them), the unitigs are written to a regular file and the dictionary
+    is built by wait(), i.e., after all unitigs have been appended.
+*/
+struct concurrent_sshash_builder {
+    concurrent_sshash_builder(sshash_type& dict, std::string const& filename,
+                              sshash::build_configuration const& config)
+        : m_dict(dict)
+        , m_filename(filename)
+        , m_config(config)
+        , m_guard_fd(-1)
+        , m_streaming(false)
+        , m_waited(false) {
+        std::remove(m_filename.c_str());
+        if (mkfifo(m_filename.c_str(), 0600) == 0) {
+            /*
+                Keep the FIFO open for reading on our side too: the writer never blocks
+                on open() and never gets SIGPIPE, even if SSHash fails before (or while)
+                reading; in that case, the rest of the stream is drained and discarded.
+            */
+            m_guard_fd = ::open(m_filename.c_str(), O_RDONLY | O_NONBLOCK);
+            if (m_guard_fd < 0) std::remove(m_filename.c_str());
+        }
+        m_out.open(m_filename.c_str(), std::ios::out | std::ios::binary);
+        if (!m_out.is_open()) throw std::runtime_error("cannot open output file");
+        m_streaming = m_guard_fd >= 0;
+        if (!m_streaming) return;
+#ifdef F_SETPIPE_SZ
+        ::fcntl(m_guard_fd, F_SETPIPE_SZ, 1 << 20);  // fewer context switches (Linux only)
+#endif
+        m_thread = std::thread([this]() {
+            try {
+                m_dict.build(m_filename, m_config);
+            } catch (...) { m_exception = std::current_exception(); }
+            ::fcntl(m_guard_fd, F_SETFL, ::fcntl(m_guard_fd, F_GETFL) & ~O_NONBLOCK);
+            char buf[1 << 16];
+            while (::read(m_guard_fd, buf, sizeof(buf)) > 0) {}
+        });
+    }
+
+    ~concurrent_sshash_builder() {
+        if (m_waited) return;
+        m_out.close();
+        if (m_thread.joinable()) m_thread.join();
+        cleanup();
+    }
+
+    /* true if the dictionary is being built while the unitigs are appended */
+    bool streaming() const { return m_streaming; }
+
+    void append(char const* unitig, const uint64_t size) {
+        m_out << ">\n";
+        m_out.write(unitig, size);
+        m_out << '\n';
+    }
+
+    /* append the unitig with the given id in another dictionary */
+    void append(sshash_type const& dict, const uint64_t contig_id) {
+        auto it = dict.at_contig_id(contig_id);
+        auto [_, kmer] = it.next();
+        m_unitig.assign(kmer);
+        while (it.has_next()) {
+            auto [_, kmer] = it.next();
+            m_unitig.push_back(kmer[dict.k() - 1]);  // overlaps!
+        }
+        append(m_unitig.data(), m_unitig.size());
+    }
+
+    /* no more unitigs: wait until the dictionary is built */
+    void wait() {
+        m_out.close();
+        if (streaming()) {
+            m_thread.join();
+        } else {
+            try {
+                m_dict.build(m_filename, m_config);
+            } catch (...) { m_exception = std::current_exception(); }
+        }
+        cleanup();
+        m_waited = true;
+        if (m_exception) std::rethrow_exception(m_exception);
+    }
+
+private:
+    sshash_type& m_dict;
+    std::string m_filename;
+    sshash::build_configuration m_config;
+    int m_guard_fd;
+    bool m_streaming, m_waited;
+    std::ofstream m_out;
+    std::string m_unitig;
+    std::thread m_thread;
+    std::exception_ptr m_exception;
+
+    void cleanup() {
+        if (m_guard_fd >= 0) ::close(m_guard_fd);
+        m_guard_fd = -1;
+        try {  // remove unitig file
+            std::remove(m_filename.c_str());
+        } catch (std::exception const& e) { std::cerr << e.what() << std::endl; }
+    }
+};
+
+}  // namespace fulgor
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "include/index.hpp"
+#include "include/build_util.hpp"
+#include "include/minhash.hpp"
+#include "include/checkpoint.hpp"
 
 namespace fulgor {
 
@@ -14,7 +17,29 @@ struct differential_permuter {
         const std::vector<float> slices = {0, 0.25, 0.5, 0.75, 1};
         const uint64_t num_slices = slices.size() - 1;
 
-        {
+        std::vector<uint64_t> color_set_ids;
+        std::vector<kmeans::cluster_data> clustering_data(num_slices);
+        std::vector<uint64_t> num_points(num_slices);
+
+        if (m_build_config.clustering == clustering_t::MINHASH) {
+            essentials::logger("step 2. build and cluster MinHash sketches");
+            for (uint64_t slice_id = 0; slice_id != num_slices; slice_id++) {
+                timer.start();
+                auto sketches = build_colors_minhash_sketches_sliced(
+                    index, m_build_config.num_threads, slices[slice_id], slices[slice_id + 1],
+                    color_set_ids);
+                num_points[slice_id] = sketches.size();
+                lsh_clustering_parameters params;
+                params.num_threads = m_build_config.num_threads;
+                params.max_cluster_size = std::max<uint64_t>(
+                    1, 4 * std::sqrt(static_cast<double>(sketches.size())));
+                clustering_data[slice_id] = cluster_minhash_sketches(sketches, params);
+                timer.stop();
+                std::cout << "** sketching and clustering took " << timer.elapsed()
+                          << " seconds / " << timer.elapsed() / 60 << " minutes" << std::endl;
+                timer.reset();
+            }
+        } else {
             essentials::logger("step 2. build sketches");
 
             constexpr uint64_t p = 10;
@@ -23,26 +48,21 @@ struct differential_permuter {
                 build_colors_sketches_sliced(
                     index, p, m_build_config.num_threads,
                     m_build_config.tmp_dirname + "/sketches" + std::to_string(slice_id) + ".bin",
-                    slices[slice_id], slices[slice_id + 1]);
+                    slices[slice_id], slices[slice_id + 1], m_build_config.ram_limit_in_bytes());
                 timer.stop();
                 std::cout << "** building sketches took " << timer.elapsed() << " seconds / "
                           << timer.elapsed() / 60 << " minutes" << std::endl;
                 timer.reset();
             }
-        }
 
-        {
             essentials::logger("step 3. clustering sketches");
-
-            std::vector<uint64_t> color_set_ids;
-            std::vector<kmeans::cluster_data> clustering_data(num_slices);
-            std::vector<uint64_t> num_points(num_slices);
-
             for (uint64_t slice_id = 0; slice_id < num_slices; slice_id++) {
                 num_points[slice_id] = cluster("/sketches" + std::to_string(slice_id) + ".bin",
                                                clustering_data[slice_id], color_set_ids);
             }
+        }
 
+        {
             timer.start();
 
             m_num_partitions = 0;
@@ -120,6 +140,16 @@ struct differential_permuter {
             std::cout << "  ** OTHER operations took " << timer.elapsed() << " seconds / "
                       << timer.elapsed() / 60 << " minutes" << std::endl;
         }
+
+        if (m_build_config.split_clusters) {
+            essentials::logger("step 3.1. splitting heterogeneous clusters");
+            timer.start();
+            split_clusters(index);
+            timer.stop();
+            std::cout << "Split into " << m_num_partitions << " partitions\n";
+            std::cout << "  ** splitting clusters took " << timer.elapsed() << " seconds / "
+                      << timer.elapsed() / 60 << " minutes" << std::endl;
+        }
     }
 
     uint64_t num_partitions() const { return m_num_partitions; }
@@ -132,6 +162,83 @@ private:
     std::vector<std::pair<uint32_t, uint32_t>> m_permutation;
     std::vector<uint32_t> m_partition_size;
 
+    /*
+        Split the clusters whose color sets take fewer bits with two representatives than with
+        one (see differential::representative_optimizer::split), recursively up to
+        max_split_depth times, in parallel over the clusters. Clusters with fewer than
+        min_split_size color sets are kept as they are.
+    */
+    template <typename Index>
+    void split_clusters(Index const& index) {
+        constexpr uint64_t max_split_depth = 3;
+        constexpr uint64_t min_split_size = 8;
+
+        const uint64_t num_color_sets = m_permutation.size();
+        std::vector<uint8_t> cluster_begin(num_color_sets, 0);
+        task_scheduler scheduler(m_build_config.num_threads);
+        {
+            uint64_t load = 0;
+            for (auto [cluster_id, color_set_id] : m_permutation) {
+                load += index.color_set(color_set_id).size();
+            }
+            scheduler.add(
+                0, num_color_sets, scheduler.chunk_weight(load),
+                [&](uint64_t i) { return index.color_set(m_permutation[i].second).size(); },
+                [&](uint64_t i) {  // a cluster is never split among chunks
+                    return i == 0 or m_permutation[i].first != m_permutation[i - 1].first;
+                });
+        }
+
+        scheduler.run([&](uint64_t /* thread_id */, uint64_t chunk_id) {
+            auto const& chunk = scheduler.chunks()[chunk_id];
+            differential::representative_optimizer optimizer(index.num_colors());
+            std::vector<uint8_t> side;
+            std::vector<std::pair<uint32_t, uint32_t>> halves;
+
+            struct range {
+                uint64_t begin, end, depth;
+            };
+            std::vector<range> ranges;
+            for (uint64_t i = chunk.begin; i != chunk.end;) {
+                uint64_t j = i + 1;
+                while (j != chunk.end and m_permutation[j].first == m_permutation[i].first) ++j;
+                ranges.push_back({i, j, 0});
+                i = j;
+            }
+
+            while (!ranges.empty()) {
+                auto [begin, end, depth] = ranges.back();
+                ranges.pop_back();
+                cluster_begin[begin] = 1;
+                if (depth == max_split_depth or end - begin < min_split_size) continue;
+                auto get = [&](uint64_t i) {
+                    return index.color_set(m_permutation[begin + i].second);
+                };
+                if (!optimizer.split(end - begin, get, side)) continue;
+
+                /* the color sets of the first half, then those of the second half */
+                halves.clear();
+                for (uint64_t half = 0; half != 2; ++half) {
+                    for (uint64_t i = begin; i != end; ++i) {
+                        if (side[i - begin] == half) halves.push_back(m_permutation[i]);
+                    }
+                }
+                std::copy(halves.begin(), halves.end(), m_permutation.begin() + begin);
+                const uint64_t middle = begin + std::count(side.begin(), side.end(), 0);
+                ranges.push_back({begin, middle, depth + 1});
+                ranges.push_back({middle, end, depth + 1});
+            }
+        });
+
+        /* renumber the clusters in order */
+        uint32_t cluster_id = 0;
+        for (uint64_t i = 0; i != num_color_sets; ++i) {
+            if (i != 0 and cluster_begin[i]) ++cluster_id;
+            m_permutation[i].first = cluster_id;
+        }
+        m_num_partitions = num_color_sets == 0 ? 0 : cluster_id + 1;
+    }
+
     uint64_t cluster(std::string filename, kmeans::cluster_data& clustering_data,
                      std::vector<uint64_t>& color_set_ids) {
         essentials::timer<std::chrono::high_resolution_clock, std::chrono::seconds> timer;
@@ -213,53 +320,69 @@ struct index<ColorSets>::differential_builder {
 
         essentials::timer<std::chrono::high_resolution_clock, std::chrono::seconds> timer;
 
-        differential_permuter p(m_build_config);
-        p.permute(index);
-        std::swap(permutation, p.permutation());
-        const uint64_t num_partitions = p.num_partitions();
+        checkpoint cp(m_build_config, ColorSets::type);
+        uint64_t num_partitions = 0;
+        std::vector<uint32_t> group_ids, color_set_ids;  // the two components of permutation
+        if (cp.completed("diff.permutation")) {
+            cp.load("diff.permutation", num_partitions, group_ids, color_set_ids);
+            permutation.resize(group_ids.size());
+            for (uint64_t i = 0; i != permutation.size(); ++i) {
+                permutation[i] = {group_ids[i], color_set_ids[i]};
+            }
+        } else {
+            differential_permuter p(m_build_config);
+            p.permute(index);
+            std::swap(permutation, p.permutation());
+            num_partitions = p.num_partitions();
+            group_ids.reserve(permutation.size());
+            color_set_ids.reserve(permutation.size());
+            for (auto [group_id, color_set_id] : permutation) {
+                group_ids.push_back(group_id);
+                color_set_ids.push_back(color_set_id);
+            }
+            cp.save("diff.permutation", num_partitions, group_ids, color_set_ids);
+        }
+        std::vector<uint32_t>().swap(group_ids);
+        std::vector<uint32_t>().swap(color_set_ids);
+
         const uint64_t num_color_sets = index.num_color_sets();
         const uint64_t num_colors = index.num_colors();
         std::cout << "num_partitions = " << num_partitions << std::endl;
 
-        {
+        if (cp.completed("diff.color_sets")) {
+            essentials::logger("step 4. loading differential color sets");
+            cp.load("diff.color_sets", idx.m_color_sets);
+        } else {
             essentials::logger("step 4. building differential color sets");
             timer.start();
 
-            struct slice {
-                uint64_t begin, end;
-            };
-            std::vector<slice> thread_slices;
-
-            uint64_t load = 0;
-            for (uint32_t color_set_id = 0; color_set_id < num_color_sets; ++color_set_id) {
-                load += index.color_set(color_set_id).size();
-            }
-            const uint64_t load_per_thread = load / num_threads;
-
-            slice s = {0, 0};
-            uint64_t curr_load = 0;
-            uint64_t prev_cluster = permutation[0].first;
-            for (uint64_t i = 0; i < num_color_sets; ++i) {
-                auto& [cluster_id, color_set_id] = permutation[i];
-                if (cluster_id != prev_cluster && curr_load >= load_per_thread) {
-                    s.end = i;
-                    thread_slices.push_back(s);
-                    s.begin = i;
-                    curr_load = 0;
+            /*
+                The groups are encoded in chunks of about the same total size, taken
+                dynamically by the threads: every chunk is encoded by its own builder and the
+                builders are appended in chunk order.
+            */
+            task_scheduler scheduler(num_threads);
+            {
+                uint64_t load = 0;
+                for (uint32_t color_set_id = 0; color_set_id < num_color_sets; ++color_set_id) {
+                    load += index.color_set(color_set_id).size();
                 }
-                curr_load += index.color_set(color_set_id).size();
+                scheduler.add(
+                    0, num_color_sets, scheduler.chunk_weight(load),
+                    [&](uint64_t i) { return index.color_set(permutation[i].second).size(); },
+                    [&](uint64_t i) {  // a group is never split
+                        return i == 0 or permutation[i].first != permutation[i - 1].first;
+                    });
             }
-            s.end = num_color_sets;
-            thread_slices.push_back(s);
 
-            std::vector<typename ColorSets::builder> thread_builders(thread_slices.size(),
-                                                                     num_colors);
-            std::vector<std::thread> threads(thread_slices.size());
+            std::vector<typename ColorSets::builder> chunk_builders(scheduler.num_chunks(),
+                                                                    num_colors);
 
-            auto encode_color_sets = [&](uint64_t thread_id) {
-                auto& color_sets_builder = thread_builders[thread_id];
-                auto& [begin, end] = thread_slices[thread_id];
-                color_sets_builder.reserve_num_bits(16 * essentials::GB * 8);
+            auto encode_color_sets = [&](uint64_t /* thread_id */, uint64_t chunk_id) {
+                auto& color_sets_builder = chunk_builders[chunk_id];
+                auto const& [group, begin, end] = scheduler.chunks()[chunk_id];
+                color_sets_builder.reserve_num_bits(
+                    m_build_config.ram_limit_in_bytes(2 * scheduler.num_chunks()) * 8);
 
                 std::vector<uint64_t> group_endpoints;
                 uint64_t curr_group = permutation[begin].first + 1;  // different from first group
@@ -272,24 +395,15 @@ struct index<ColorSets>::differential_builder {
                 }
                 group_endpoints.push_back(end);
 
-                std::vector<uint32_t> distribution(num_colors, 0);
+                differential::representative_optimizer optimizer(num_colors);
+                std::vector<uint32_t> representative;
                 for (uint64_t group = 0; group < group_endpoints.size() - 1; ++group) {
                     uint64_t g_begin = group_endpoints[group];
                     uint64_t g_end = group_endpoints[group + 1];
-                    std::vector<uint32_t> representative;
-                    representative.reserve(num_colors);
-
-                    for (uint64_t i = g_begin; i < g_end; ++i) {
-                        auto& [group_id, color_set_id] = permutation[i];
-                        auto it = index.color_set(color_set_id);
-                        uint64_t it_size = it.size();
-                        for (uint64_t pos = 0; pos < it_size; ++pos, ++it) { distribution[*it]++; }
-                    }
-                    uint64_t g_size = g_end - g_begin;
-                    for (uint64_t color = 0; color < num_colors; ++color) {
-                        if (distribution[color] >= ceil(1. * g_size / 2.))
-                            representative.push_back(color);
-                    }
+                    auto get = [&](uint64_t i) {
+                        return index.color_set(permutation[g_begin + i].second);
+                    };
+                    optimizer.optimize(g_end - g_begin, get, representative);
                     color_sets_builder.process_partition(representative);
 
                     for (uint64_t i = g_begin; i < g_end; ++i) {
@@ -297,36 +411,68 @@ struct index<ColorSets>::differential_builder {
                         auto it = index.color_set(color_set_id);
                         color_sets_builder.process_color_set(it);
                     }
-                    std::fill(distribution.begin(), distribution.end(), 0);
                 }
             };
 
-            for (uint64_t thread_id = 0; thread_id < thread_slices.size(); thread_id++) {
-                threads[thread_id] = std::thread(encode_color_sets, thread_id);
-            }
-            for (auto& t : threads) {
-                if (t.joinable()) t.join();
-            }
+            scheduler.run(encode_color_sets);
 
-            for (uint64_t thread_id = 1; thread_id < thread_builders.size(); thread_id++) {
-                thread_builders[0].append(thread_builders[thread_id]);
+            for (uint64_t chunk_id = 1; chunk_id < chunk_builders.size(); chunk_id++) {
+                chunk_builders[0].append(chunk_builders[chunk_id]);
+                chunk_builders[chunk_id] = {};  // release memory
             }
-            thread_builders[0].build(idx.m_color_sets);
+            chunk_builders[0].build(idx.m_color_sets);
 
             timer.stop();
             std::cout << "** building color sets took " << timer.elapsed() << " seconds / "
                       << timer.elapsed() / 60 << " minutes" << std::endl;
             timer.reset();
+
+            cp.save("diff.color_sets", idx.m_color_sets);
         }
 
-        {
+        /* the unitigs of an index with a u2c map (e.g., a merged one) are not grouped by
+           color set: they can only be mapped */
+        if (m_build_config.rebuild_k2u and index.get_u2c_map().size() != 0) {
+            std::cout << "option '--rebuild-k2u' is ignored: the index has a map from unitigs "
+                         "to color sets"
+                      << std::endl;
+        }
+        if (!m_build_config.rebuild_k2u or index.get_u2c_map().size() != 0) {
+            essentials::logger("step 5. map unitigs to the permuted color sets");
+            timer.start();
+            std::vector<uint32_t> new_color_set_id(num_color_sets);
+            for (uint64_t i = 0; i != num_color_sets; ++i) {
+                new_color_set_id[permutation[i].second] = i;
+            }
+            idx.permute_color_set_ids(index, new_color_set_id);
+            timer.stop();
+            std::cout << "** mapping unitigs took " << timer.elapsed() << " seconds / "
+                      << timer.elapsed() / 60 << " minutes" << std::endl;
+            timer.reset();
+        } else if (cp.completed("diff.k2u")) {
+            essentials::logger("step 5. loading permuted unitigs and k2u");
+            cp.load("diff.k2u", idx.m_k2u, idx.m_u2c);
+            idx.m_u2c_rank1_index.build(idx.m_u2c);
+        } else {
             essentials::logger("step 5. permute unitigs and rebuild k2u");
             timer.start();
 
+            auto const& dict = index.get_k2u();
+
+            /* build a new sshash::dictionary on the permuted unitigs, while they are written */
+            sshash::build_configuration sshash_config;
+            sshash_config.k = dict.k();
+            sshash_config.m = dict.m();
+            assert(dict.canonical() == true);
+            sshash_config.canonical = dict.canonical();
+            sshash_config.verbose = m_build_config.verbose;
+            sshash_config.tmp_dirname = m_build_config.tmp_dirname;
+            sshash_config.num_threads = util::largest_power_of_2(m_build_config.num_threads);
+            sshash_config.print();
             const std::string permuted_unitigs_filename =
                 m_build_config.tmp_dirname + "/permuted_unitigs.fa";
-            std::ofstream out(permuted_unitigs_filename.c_str());
-            if (!out.is_open()) throw std::runtime_error("cannot open output file");
+            concurrent_sshash_builder k2u_builder(idx.m_k2u, permuted_unitigs_filename,
+                                                  sshash_config);
 
             auto const& u2c = index.get_u2c();
             bits::darray1 d;  // for select_1 on u2c
@@ -335,9 +481,6 @@ struct index<ColorSets>::differential_builder {
             const uint64_t num_unitigs = u2c.num_bits();
             bits::bit_vector::builder u2c_builder(num_unitigs + 1, 0);
 
-            auto const& dict = index.get_k2u();
-            const uint64_t k = dict.k();
-
             uint64_t pos = 0;
             for (uint64_t new_color_set_id = 0; new_color_set_id != num_color_sets;
                  ++new_color_set_id) {
@@ -357,43 +500,23 @@ struct index<ColorSets>::differential_builder {
                 u2c_builder.set(pos - 1, 1);
 
                 for (uint64_t i = old_unitig_id_begin; i != old_unitig_id_end; ++i) {
-                    auto it = dict.at_contig_id(i);
-                    out << ">\n";
-                    auto [_, kmer] = it.next();
-                    out << kmer;
-                    while (it.has_next()) {
-                        auto [_, kmer] = it.next();
-                        out << kmer[k - 1];  // overlaps!
-                    }
-                    out << '\n';
+                    k2u_builder.append(dict, i);
                 }
             }
 
             assert(pos == num_unitigs);
-            out.close();
             u2c_builder.build(idx.m_u2c);
             idx.m_u2c_rank1_index.build(idx.m_u2c);
 
-            /* build a new sshash::dictionary on the permuted unitigs */
-            sshash::build_configuration sshash_config;
-            sshash_config.k = dict.k();
-            sshash_config.m = dict.m();
-            assert(dict.canonical() == true);
-            sshash_config.canonical = dict.canonical();
-            sshash_config.verbose = m_build_config.verbose;
-            sshash_config.tmp_dirname = m_build_config.tmp_dirname;
-            sshash_config.num_threads = util::largest_power_of_2(m_build_config.num_threads);
-            sshash_config.print();
-            idx.m_k2u.build(permuted_unitigs_filename, sshash_config);
+            k2u_builder.wait();
             assert(idx.get_k2u().size() == dict.size());
-            try {  // remove unitig file
-                std::remove(permuted_unitigs_filename.c_str());
-            } catch (std::exception const& e) { std::cerr << e.what() << std::endl; }
 
             timer.stop();
             std::cout << "** permuting unitigs and rebuilding k2u took " << timer.elapsed()
                       << " seconds / " << timer.elapsed() / 60 << " minutes" << std::endl;
             timer.reset();
+
+            cp.save("diff.k2u", idx.m_k2u, idx.m_u2c);
         }
 
         {
@@ -0,0 +1,388 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "include/index.hpp"
+#include "include/task_scheduler.hpp"
+#include "include/builders/builder.hpp"
+
+namespace fulgor {
+
+/*
+    Merge two indexes built with the same k and minimizer length: the colors
+    of the second index are appended after those of the first one.
+
+    Instead of recomputing the compacted dBG from the references, the unitigs
+    of both indexes are split into runs of k-mers that have the same colors
+    in the merged index:
+    - a unitig of the first index is split where the color set of its k-mers
+      in the second index changes (looked up in the second k2u);
+    - a unitig of the second index is split around the k-mers that are also in
+      the first index, since those were already written in the first pass.
+    The runs are a spectrum-preserving string set of the union of the k-mers, so they
+    are the contigs of the new SSHash dictionary. The color set of a run only depends on
+    the pair (color set in the first index, color set in the second index): the pairs are
+    the merged color sets, in the order they are first seen, and m_u2c_map maps the runs
+    of contigs to them. The unitigs are split in parallel, since the lookups in the other
+    dictionary dominate the running time.
+*/
+template <typename ColorSets>
+struct index<ColorSets>::merge_builder {
+    merge_builder() {}
+
+    merge_builder(build_configuration const& build_config) : m_build_config(build_config) {}
+
+    template <typename Index>
+    void build(index& idx, Index const& first, Index const& second) {
+        if (idx.m_k2u.size() != 0) throw std::runtime_error("index already built");
+        if (first.k() != second.k() or first.get_k2u().m() != second.get_k2u().m()) {
+            throw std::runtime_error("the indexes must have the same k and minimizer length");
+        }
+        if (uint64_t(first.num_colors()) + second.num_colors() >= (uint64_t(1) << 32)) {
+            throw std::runtime_error("too many colors");
+        }
+
+        essentials::timer<std::chrono::high_resolution_clock, std::chrono::seconds> timer;
+
+        auto const& first_dict = first.get_k2u();
+        auto const& second_dict = second.get_k2u();
+
+        sshash::build_configuration sshash_config;
+        sshash_config.k = first_dict.k();
+        sshash_config.m = first_dict.m();
+        sshash_config.canonical = true;
+        sshash_config.verbose = m_build_config.verbose;
+        sshash_config.tmp_dirname = m_build_config.tmp_dirname;
+        sshash_config.num_threads = util::largest_power_of_2(m_build_config.num_threads);
+        sshash_config.print();
+        concurrent_sshash_builder k2u_builder(idx.m_k2u,
+                                              m_build_config.tmp_dirname + "/merged_unitigs.fa",
+                                              sshash_config);
+
+        std::unordered_map<uint64_t, uint32_t> color_set_ids;  // (first, second) -> merged id
+        std::vector<uint64_t> merged_color_sets;                // the pairs, by merged id
+        std::vector<uint32_t> run_color_set_ids;                // the merged id of every run
+        bits::bit_vector::builder u2c_builder;
+        uint64_t num_contigs = 0;
+        uint64_t prev_pair = none_pair;
+
+        auto write_contig = [&](segment const& s) {
+            if (s.pair != prev_pair) {
+                if (num_contigs > 0) u2c_builder.set(num_contigs - 1, 1);
+                auto it = color_set_ids.find(s.pair);
+                if (it == color_set_ids.end()) {
+                    it = color_set_ids.insert({s.pair, merged_color_sets.size()}).first;
+                    merged_color_sets.push_back(s.pair);
+                }
+                run_color_set_ids.push_back(it->second);
+                prev_pair = s.pair;
+            }
+            u2c_builder.push_back(0);
+            k2u_builder.append(s.contig.data(), s.contig.size());
+            num_contigs += 1;
+        };
+
+        {
+            essentials::logger("step 1. splitting the unitigs of the first index...");
+            timer.start();
+            split_unitigs(
+                first_dict,
+                [&](const uint64_t unitig_id, std::vector<segment>& segments) {
+                    const uint64_t first_color_set_id = first.u2c(unitig_id);
+                    const uint64_t begin = segments.size();
+                    auto it = first_dict.at_contig_id(unitig_id);
+                    while (it.has_next()) {
+                        auto [_, kmer] = it.next();
+                        auto answer = second_dict.lookup_advanced(kmer.c_str());
+                        const uint64_t second_color_set_id =
+                            answer.kmer_id != sshash::constants::invalid_uint64
+                                ? second.u2c(answer.contig_id)
+                                : none;
+                        const uint64_t pair = (first_color_set_id << 32) | second_color_set_id;
+                        if (segments.size() == begin or segments.back().pair != pair) {
+                            segments.push_back({pair, kmer});
+                        } else {
+                            segments.back().contig.push_back(kmer.back());
+                        }
+                    }
+                },
+                write_contig);
+            timer.stop();
+            std::cout << "** splitting the unitigs took " << timer.elapsed() << " seconds / "
+                      << timer.elapsed() / 60 << " minutes" << std::endl;
+            timer.reset();
+        }
+
+        {
+            essentials::logger("step 2. adding the unitigs of the second index...");
+            timer.start();
+            split_unitigs(
+                second_dict,
+                [&](const uint64_t unitig_id, std::vector<segment>& segments) {
+                    const uint64_t pair = (none << 32) | second.u2c(unitig_id);
+                    bool extend = false;
+                    auto it = second_dict.at_contig_id(unitig_id);
+                    while (it.has_next()) {
+                        auto [_, kmer] = it.next();
+                        auto answer = first_dict.lookup_advanced(kmer.c_str());
+                        if (answer.kmer_id != sshash::constants::invalid_uint64) {
+                            extend = false;  // already written in step 1
+                        } else if (extend) {
+                            segments.back().contig.push_back(kmer.back());
+                        } else {
+                            segments.push_back({pair, kmer});
+                            extend = true;
+                        }
+                    }
+                },
+                write_contig);
+            timer.stop();
+            std::cout << "** adding the unitigs took " << timer.elapsed() << " seconds / "
+                      << timer.elapsed() / 60 << " minutes" << std::endl;
+            timer.reset();
+        }
+
+        assert(num_contigs > 0);
+        u2c_builder.set(num_contigs - 1, 1);
+        u2c_builder.build(idx.m_u2c);
+        idx.m_u2c_rank1_index.build(idx.m_u2c);
+        {
+            const uint64_t num_runs = run_color_set_ids.size();
+            assert(idx.m_u2c_rank1_index.num_ones() == num_runs);
+            const uint64_t width =
+                std::max<uint64_t>(std::ceil(std::log2(merged_color_sets.size())), 1);
+            bits::compact_vector::builder map_builder(num_runs, width);
+            for (uint64_t i = 0; i != num_runs; ++i) map_builder.set(i, run_color_set_ids[i]);
+            map_builder.build(idx.m_u2c_map);
+        }
+        std::cout << "num_unitigs " << num_contigs << std::endl;
+        std::cout << "num_color_sets " << merged_color_sets.size() << std::endl;
+
+        {
+            essentials::logger("step 3. encoding the merged color sets...");
+            timer.start();
+
+            const uint64_t num_colors = first.num_colors() + second.num_colors();
+            typename ColorSets::builder main_builder(num_colors);
+            {
+                constexpr uint64_t MAX_BUFFER_SIZE = 1 << 28;
+                const uint64_t buffer_size = std::max(
+                    std::min(m_build_config.ram_limit_in_bytes(2 * m_build_config.num_threads) / 8,
+                             MAX_BUFFER_SIZE),
+                    2 * (num_colors + 1));
+                ordered_color_sets_encoder encoder(main_builder, num_colors,
+                                                   m_build_config.num_threads, buffer_size);
+                std::vector<uint32_t> color_set;
+                color_set.reserve(num_colors);
+                for (uint64_t pair : merged_color_sets) {
+                    const uint64_t first_color_set_id = pair >> 32;
+                    const uint64_t second_color_set_id = pair & none;
+                    if (first_color_set_id != none) {
+                        auto it = first.color_set(first_color_set_id);
+                        const uint64_t size = it.size();
+                        for (uint64_t i = 0; i != size; ++i, ++it) color_set.push_back(*it);
+                    }
+                    if (second_color_set_id != none) {
+                        auto it = second.color_set(second_color_set_id);
+                        const uint64_t size = it.size();
+                        for (uint64_t i = 0; i != size; ++i, ++it) {
+                            color_set.push_back(first.num_colors() + *it);
+                        }
+                    }
+                    encoder.insert(color_set.data(), color_set.size());
+                    color_set.clear();
+                }
+                encoder.finish();
+            }
+            main_builder.build(idx.m_color_sets);
+
+            timer.stop();
+            std::cout << "** encoding color sets took " << timer.elapsed() << " seconds / "
+                      << timer.elapsed() / 60 << " minutes" << std::endl;
+            timer.reset();
+        }
+
+        {
+            essentials::logger("step 4. building SSHash...");
+            timer.start();
+            k2u_builder.wait();
+            assert(idx.m_k2u.num_contigs() == num_contigs);
+            timer.stop();
+            std::cout << "** building SSHash took " << timer.elapsed() << " more seconds / "
+                      << timer.elapsed() / 60 << " minutes" << std::endl;
+            timer.reset();
+        }
+
+        {
+            std::vector<std::string> filenames;
+            filenames.reserve(first.num_colors() + second.num_colors());
+            for (uint64_t i = 0; i != first.num_colors(); ++i) {
+                filenames.emplace_back(first.filename(i));
+            }
+            for (uint64_t i = 0; i != second.num_colors(); ++i) {
+                filenames.emplace_back(second.filename(i));
+            }
+            idx.m_filenames.build(filenames);
+        }
+    }
+
+    /* check that every k-mer of the two indexes has the union of its colors */
+    template <typename Index>
+    bool check(index const& idx, Index const& first, Index const& second) const {
+        essentials::logger("checking correctness...");
+        std::vector<uint32_t> expected, got;
+        auto colors = [](auto it, std::vector<uint32_t>& out, const uint32_t offset) {
+            const uint64_t size = it.size();
+            for (uint64_t i = 0; i != size; ++i, ++it) out.push_back(offset + *it);
+        };
+        auto check_kmers_of = [&](auto const& from, auto const& other, const bool from_first) {
+            for (uint64_t unitig_id = 0; unitig_id != from.num_unitigs(); ++unitig_id) {
+                auto it = from.get_k2u().at_contig_id(unitig_id);
+                while (it.has_next()) {
+                    auto [_, kmer] = it.next();
+                    expected.clear();
+                    got.clear();
+                    auto other_answer = other.get_k2u().lookup_advanced(kmer.c_str());
+                    const bool in_other = other_answer.kmer_id != sshash::constants::invalid_uint64;
+                    auto const& f = from_first ? from : other;
+                    auto const& s = from_first ? other : from;
+                    if (from_first or in_other) {
+                        colors(f.color_set(f.u2c(from_first ? unitig_id : other_answer.contig_id)),
+                               expected, 0);
+                    }
+                    if (!from_first or in_other) {
+                        colors(s.color_set(s.u2c(from_first ? other_answer.contig_id : unitig_id)),
+                               expected, first.num_colors());
+                    }
+                    auto answer = idx.m_k2u.lookup_advanced(kmer.c_str());
+                    if (answer.kmer_id == sshash::constants::invalid_uint64) {
+                        std::cout << "\033[1;31m"
+                                  << "k-mer " << kmer << " not found\033[0m" << std::endl;
+                        return false;
+                    }
+                    colors(idx.color_set(idx.u2c(answer.contig_id)), got, 0);
+                    if (got != expected) {
+                        std::cout << "\033[1;31m"
+                                  << "wrong color set for k-mer " << kmer << "\033[0m"
+                                  << std::endl;
+                        return false;
+                    }
+                }
+            }
+            return true;
+        };
+        if (!check_kmers_of(first, second, true)) return false;
+        if (!check_kmers_of(second, first, false)) return false;
+        essentials::logger("CHECK DONE!");
+        return true;
+    }
+
+private:
+    build_configuration m_build_config;
+
+    static constexpr uint64_t none = uint32_t(-1);  // no color set in one of the two indexes
+    static constexpr uint64_t none_pair = uint64_t(-1);
+
+    /* a run of consecutive k-mers of a unitig with the same merged color set */
+    struct segment {
+        uint64_t pair;
+        std::string contig;
+    };
+
+    /*
+        Split the unitigs of dict in chunks of about the same number of k-mers, scheduled on
+        num_threads threads, while the segments of the chunks already split are written, in
+        the order of the unitigs: the merged index does not depend on the number of threads.
+        At most max_chunks_in_flight chunks are split and not yet written, to bound the memory.
+    */
+    template <typename Dictionary, typename Split, typename Write>
+    void split_unitigs(Dictionary const& dict, Split const& split, Write const& write) const {
+        constexpr uint64_t max_chunk_weight = 1 << 20;  // k-mers
+        const uint64_t num_threads = m_build_config.num_threads;
+        const uint64_t max_chunks_in_flight = 4 * num_threads;
+
+        const std::vector<uint32_t> sizes = unitig_sizes(dict);
+        task_scheduler scheduler(num_threads);
+        const uint64_t chunk_weight =
+            std::min<uint64_t>(scheduler.chunk_weight(dict.size()), max_chunk_weight);
+        scheduler.add(
+            0, sizes.size(), chunk_weight, [&](uint64_t unitig_id) { return sizes[unitig_id]; },
+            [](uint64_t) { return true; });
+        const uint64_t num_chunks = scheduler.num_chunks();
+
+        std::vector<std::vector<segment>> segments(num_chunks);
+        std::vector<bool> split_done(num_chunks, false);
+        uint64_t num_written = 0;
+        bool failed = false;
+        std::exception_ptr exception;
+        std::mutex mutex;
+        std::condition_variable split_cv, written_cv;
+
+        std::thread writer([&]() {
+            try {
+                for (uint64_t chunk_id = 0; chunk_id != num_chunks; ++chunk_id) {
+                    std::vector<segment> chunk_segments;
+                    {
+                        std::unique_lock lock(mutex);
+                        split_cv.wait(lock, [&]() { return split_done[chunk_id] or failed; });
+                        if (failed) return;
+                        chunk_segments.swap(segments[chunk_id]);
+                    }
+                    for (auto const& s : chunk_segments) write(s);
+                    {
+                        std::lock_guard lock(mutex);
+                        num_written = chunk_id + 1;
+                    }
+                    written_cv.notify_all();
+                }
+            } catch (...) {
+                std::lock_guard lock(mutex);
+                if (!exception) exception = std::current_exception();
+                failed = true;
+                written_cv.notify_all();
+            }
+        });
+
+        try {
+            scheduler.run([&](uint64_t, uint64_t chunk_id) {
+                {
+                    std::unique_lock lock(mutex);
+                    written_cv.wait(lock, [&]() {
+                        return chunk_id < num_written + max_chunks_in_flight or failed;
+                    });
+                    if (failed) return;
+                }
+                auto const& chunk = scheduler.chunks()[chunk_id];
+                std::vector<segment> chunk_segments;
+                try {
+                    for (uint64_t i = chunk.begin; i != chunk.end; ++i) split(i, chunk_segments);
+                } catch (...) {
+                    /* stop the writer and the threads waiting for it */
+                    {
+                        std::lock_guard lock(mutex);
+                        failed = true;
+                    }
+                    split_cv.notify_all();
+                    written_cv.notify_all();
+                    throw;
+                }
+                {
+                    std::lock_guard lock(mutex);
+                    segments[chunk_id].swap(chunk_segments);
+                    split_done[chunk_id] = true;
+                }
+                split_cv.notify_all();
+            });
+        } catch (...) {
+            writer.join();
+            throw;
+        }
+        writer.join();
+        if (exception) std::rethrow_exception(exception);
+    }
+};
+
+}  // namespace fulgor
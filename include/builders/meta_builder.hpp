@@ -2,8 +2,10 @@
 
 #include "include/index.hpp"
 #include "include/build_util.hpp"
+#include "include/minhash.hpp"
+#include "include/checkpoint.hpp"
 
-#include <shared_mutex>
+#include <mutex>
 
 namespace fulgor {
 
@@ -11,95 +13,88 @@ struct partition_endpoint {
     uint64_t begin, end;  // [..)
 };
 
-struct permuter {
-    permuter(build_configuration const& build_config)
-        : m_build_config(build_config), m_num_partitions(0), m_max_partition_size(0) {}
+/*
+    Map from 128-bit hashes to values, split into shards that are locked independently:
+    threads inserting keys of different shards never wait for each other.
+    Every shard is an open-addressing table with linear probing.
+*/
+struct sharded_hash_table {
+    sharded_hash_table(const uint64_t num_shards) : m_shards(num_shards) {
+        assert(num_shards > 0 and (num_shards & (num_shards - 1)) == 0);
+    }
 
-    void permute(hfur_index_t const& index) {
-        essentials::timer<std::chrono::high_resolution_clock, std::chrono::seconds> timer;
+    /*
+        Insert (key, value) if key is not present. Return the value of key
+        and true if it was inserted.
+    */
+    std::pair<uint64_t, bool> insert(const __uint128_t key, const uint64_t value) {
+        assert(value != empty);
+        auto& s = m_shards[static_cast<uint64_t>(key >> 64) & (m_shards.size() - 1)];
+        std::lock_guard lock(s.mutex);
+        if (2 * (s.size + 1) > s.entries.size()) s.grow();
+        auto& e = s.find(key);
+        if (e.value != empty) return {e.value, false};
+        e = {key, value};
+        s.size += 1;
+        return {value, true};
+    }
 
-        {
-            essentials::logger("step 2. build sketches");
-            timer.start();
-            constexpr uint64_t p = 10;  // use 2^p bytes per HLL sketch
-            build_reference_sketches(index, p, m_build_config.num_threads,
-                                     m_build_config.tmp_dirname + "/sketches.bin");
-            timer.stop();
-            std::cout << "** building sketches took " << timer.elapsed() << " seconds / "
-                      << timer.elapsed() / 60 << " minutes" << std::endl;
-            timer.reset();
+private:
+    static constexpr uint64_t empty = uint64_t(-1);
+
+    struct entry {
+        __uint128_t key;
+        uint64_t value = empty;
+    };
+
+    struct shard {
+        std::mutex mutex;
+        std::vector<entry> entries;  // size is 0 or a power of 2
+        uint64_t size = 0;
+
+        entry& find(const __uint128_t key) {
+            const uint64_t mask = entries.size() - 1;
+            for (uint64_t i = static_cast<uint64_t>(key) & mask;; i = (i + 1) & mask) {
+                if (entries[i].value == empty or entries[i].key == key) return entries[i];
+            }
         }
 
-        {
-            essentials::logger("step 3. clustering sketches");
-            timer.start();
-
-            std::ifstream in(m_build_config.tmp_dirname + "/sketches.bin", std::ios::binary);
-            if (!in.is_open()) throw std::runtime_error("error in opening file");
-
-            std::vector<kmeans::point> points;
-            uint64_t num_bytes_per_point = 0;
-            uint64_t num_points = 0;
-            in.read(reinterpret_cast<char*>(&num_bytes_per_point), sizeof(uint64_t));
-            in.read(reinterpret_cast<char*>(&num_points), sizeof(uint64_t));
-            points.resize(num_points, kmeans::point(num_bytes_per_point));
-            for (auto& point : points) {
-                in.read(reinterpret_cast<char*>(point.data()), num_bytes_per_point);
+        void grow() {
+            std::vector<entry> old(std::max<uint64_t>(2 * entries.size(), 64));
+            old.swap(entries);
+            for (auto const& e : old) {
+                if (e.value != empty) find(e.key) = e;
             }
-            in.close();
-
-            std::remove((m_build_config.tmp_dirname + "/sketches.bin").c_str());
-
-            kmeans::clustering_parameters params;
-
-            /* kmeans_divisive */
-            constexpr float min_delta = 0.0001;
-            constexpr float max_iteration = 10;
-            constexpr uint64_t min_cluster_size = 50;
-            constexpr uint64_t seed = 0;
-            params.set_min_delta(min_delta);
-            params.set_max_iteration(max_iteration);
-            params.set_min_cluster_size(min_cluster_size);
-            params.set_random_seed(seed);
-            params.set_num_threads(m_build_config.num_threads);
-            auto clustering_data = kmeans::kmeans_divisive(points.begin(), points.end(), params);
-
-            timer.stop();
-            std::cout << "** clustering sketches took " << timer.elapsed() << " seconds / "
-                      << timer.elapsed() / 60 << " minutes" << std::endl;
-            timer.reset();
-
-            m_num_partitions = clustering_data.num_clusters;
-
-            m_partition_size.resize(m_num_partitions + 1, 0);
-            for (auto c : clustering_data.clusters) m_partition_size[c] += 1;
+        }
+    };
 
-            /* take prefix sums */
-            uint64_t val = 0;
-            for (auto& size : m_partition_size) {
-                if (size > m_max_partition_size) m_max_partition_size = size;
-                uint64_t tmp = size;
-                size = val;
-                val += tmp;
-            }
+    std::vector<shard> m_shards;
+};
 
-            const uint64_t num_colors = index.num_colors();
+struct permuter {
+    permuter(build_configuration const& build_config)
+        : m_build_config(build_config), m_num_partitions(0), m_max_partition_size(0) {}
 
-            /* build permutation */
-            auto counts = m_partition_size;  // copy
-            m_permutation.resize(num_colors);
-            assert(clustering_data.clusters.size() == num_colors);
-            for (uint64_t i = 0; i != num_colors; ++i) {
-                uint32_t cluster_id = clustering_data.clusters[i];
-                m_permutation[i] = counts[cluster_id];
-                counts[cluster_id] += 1;
-            }
+    void permute(hfur_index_t const& index) {
+        checkpoint cp(m_build_config, index_t::META);
+        if (cp.completed("meta.permutation")) {
+            cp.load("meta.permutation", *this);
+        } else {
+            cluster(index);
+            cp.save("meta.permutation", *this);
+        }
 
-            /* permute filenames */
-            m_filenames.resize(num_colors);
-            for (uint64_t i = 0; i != num_colors; ++i) {
-                m_filenames[m_permutation[i]] = index.filename(i);
-            }
+        /* permute filenames */
+        const uint64_t num_colors = index.num_colors();
+        if (m_permutation.size() != num_colors) {
+            throw std::runtime_error("the permutation of the references has " +
+                                     std::to_string(m_permutation.size()) + " colors instead of " +
+                                     std::to_string(num_colors) + ": remove the checkpoint in '" +
+                                     m_build_config.tmp_dirname + "' and start again");
+        }
+        m_filenames.resize(num_colors);
+        for (uint64_t i = 0; i != num_colors; ++i) {
+            m_filenames[m_permutation[i]] = index.filename(i);
         }
     }
 
@@ -114,13 +109,147 @@ struct permuter {
     std::vector<uint32_t> partition_size() const { return m_partition_size; }
     std::vector<std::string> filenames() const { return m_filenames; }
 
+    template <typename Visitor>
+    void visit(Visitor& visitor) {
+        visit_impl(visitor, *this);
+    }
+
+    template <typename Visitor>
+    void visit(Visitor& visitor) const {
+        visit_impl(visitor, *this);
+    }
+
 private:
+    static constexpr uint64_t min_cluster_size = 50;
+
     build_configuration m_build_config;
     uint64_t m_num_partitions;
     uint64_t m_max_partition_size;
     std::vector<uint32_t> m_permutation;
     std::vector<uint32_t> m_partition_size;
     std::vector<std::string> m_filenames;
+
+    template <typename Visitor, typename T>
+    static void visit_impl(Visitor& visitor, T&& t) {
+        visitor.visit(t.m_num_partitions);
+        visitor.visit(t.m_max_partition_size);
+        visitor.visit(t.m_permutation);
+        visitor.visit(t.m_partition_size);
+    }
+
+    void cluster(hfur_index_t const& index) {
+        auto clustering_data = m_build_config.clustering == clustering_t::MINHASH
+                                   ? cluster_minhash(index)
+                                   : cluster_kmeans(index);
+
+        m_num_partitions = clustering_data.num_clusters;
+
+        m_partition_size.resize(m_num_partitions + 1, 0);
+        for (auto c : clustering_data.clusters) m_partition_size[c] += 1;
+
+        /* take prefix sums */
+        uint64_t val = 0;
+        for (auto& size : m_partition_size) {
+            if (size > m_max_partition_size) m_max_partition_size = size;
+            uint64_t tmp = size;
+            size = val;
+            val += tmp;
+        }
+
+        const uint64_t num_colors = index.num_colors();
+
+        /* build permutation */
+        auto counts = m_partition_size;  // copy
+        m_permutation.resize(num_colors);
+        assert(clustering_data.clusters.size() == num_colors);
+        for (uint64_t i = 0; i != num_colors; ++i) {
+            uint32_t cluster_id = clustering_data.clusters[i];
+            m_permutation[i] = counts[cluster_id];
+            counts[cluster_id] += 1;
+        }
+    }
+
+    kmeans::cluster_data cluster_kmeans(hfur_index_t const& index) {
+        essentials::timer<std::chrono::high_resolution_clock, std::chrono::seconds> timer;
+
+        {
+            essentials::logger("step 2. build sketches");
+            timer.start();
+            constexpr uint64_t p = 10;  // use 2^p bytes per HLL sketch
+            build_reference_sketches(index, p, m_build_config.num_threads,
+                                     m_build_config.tmp_dirname + "/sketches.bin",
+                                     m_build_config.ram_limit_in_bytes());
+            timer.stop();
+            std::cout << "** building sketches took " << timer.elapsed() << " seconds / "
+                      << timer.elapsed() / 60 << " minutes" << std::endl;
+            timer.reset();
+        }
+
+        essentials::logger("step 3. clustering sketches");
+        timer.start();
+
+        std::ifstream in(m_build_config.tmp_dirname + "/sketches.bin", std::ios::binary);
+        if (!in.is_open()) throw std::runtime_error("error in opening file");
+
+        std::vector<kmeans::point> points;
+        uint64_t num_bytes_per_point = 0;
+        uint64_t num_points = 0;
+        in.read(reinterpret_cast<char*>(&num_bytes_per_point), sizeof(uint64_t));
+        in.read(reinterpret_cast<char*>(&num_points), sizeof(uint64_t));
+        points.resize(num_points, kmeans::point(num_bytes_per_point));
+        for (auto& point : points) {
+            in.read(reinterpret_cast<char*>(point.data()), num_bytes_per_point);
+        }
+        in.close();
+
+        std::remove((m_build_config.tmp_dirname + "/sketches.bin").c_str());
+
+        kmeans::clustering_parameters params;
+
+        /* kmeans_divisive */
+        constexpr float min_delta = 0.0001;
+        constexpr float max_iteration = 10;
+        constexpr uint64_t seed = 0;
+        params.set_min_delta(min_delta);
+        params.set_max_iteration(max_iteration);
+        params.set_min_cluster_size(min_cluster_size);
+        params.set_random_seed(seed);
+        params.set_num_threads(m_build_config.num_threads);
+        auto clustering_data = kmeans::kmeans_divisive(points.begin(), points.end(), params);
+
+        timer.stop();
+        std::cout << "** clustering sketches took " << timer.elapsed() << " seconds / "
+                  << timer.elapsed() / 60 << " minutes" << std::endl;
+        return clustering_data;
+    }
+
+    kmeans::cluster_data cluster_minhash(hfur_index_t const& index) {
+        essentials::timer<std::chrono::high_resolution_clock, std::chrono::seconds> timer;
+
+        essentials::logger("step 2. build MinHash sketches");
+        timer.start();
+        auto sketches = build_reference_minhash_sketches(index, m_build_config.num_threads);
+        timer.stop();
+        std::cout << "** building sketches took " << timer.elapsed() << " seconds / "
+                  << timer.elapsed() / 60 << " minutes" << std::endl;
+        timer.reset();
+
+        essentials::logger("step 3. clustering sketches with LSH");
+        timer.start();
+        lsh_clustering_parameters params;
+        params.num_threads = m_build_config.num_threads;
+        /* bound the partitions, as k-means does not split clusters smaller than
+           min_cluster_size: similar references would otherwise end up in a single one,
+           and references without similar ones in as many partitions */
+        params.min_cluster_size = min_cluster_size;
+        params.max_cluster_size = std::max<uint64_t>(
+            2 * min_cluster_size, 4 * std::sqrt(static_cast<double>(sketches.size())));
+        auto clustering_data = cluster_minhash_sketches(sketches, params);
+        timer.stop();
+        std::cout << "** clustering sketches took " << timer.elapsed() << " seconds / "
+                  << timer.elapsed() / 60 << " minutes" << std::endl;
+        return clustering_data;
+    }
 };
 
 template <typename ColorSets>
@@ -151,7 +280,11 @@ struct index<ColorSets>::meta_builder {
         std::cout << "num_partitions = " << num_partitions << std::endl;
         std::cout << "max_partition_size = " << max_partition_size << std::endl;
 
-        {
+        checkpoint cp(m_build_config, ColorSets::type);
+        if (cp.completed("meta.color_sets")) {
+            essentials::logger("step 4. loading partial/meta color sets");
+            cp.load("meta.color_sets", idx.m_color_sets);
+        } else {
             essentials::logger("step 4. building partial/meta color sets");
             timer.start();
 
@@ -165,72 +298,143 @@ struct index<ColorSets>::meta_builder {
                 auto endpoints = p.partition_endpoints(partition_id);
                 uint64_t num_colors_in_partition = endpoints.end - endpoints.begin;
                 color_sets_builder.init_partition(partition_id, num_colors_in_partition);
-                color_sets_builder.reserve_num_bits(partition_id, 8 * essentials::GB * 8);
+                color_sets_builder.reserve_num_bits(
+                    partition_id, m_build_config.ram_limit_in_bytes(2 * num_partitions) * 8);
             }
 
-            std::vector<std::unordered_map<__uint128_t,            // key
-                                           uint32_t,               // value
-                                           util::hasher_uint128_t  // key's hasher
-                                           >>
-                hashes;  // (hash, id)
-            hashes.resize(num_partitions);
-
-            std::vector<std::thread> threads(num_threads);
-            std::vector<uint32_t> thread_slices(num_threads + 1);
-            std::vector<std::shared_mutex> partitions_mutex(num_partitions);
-
-            for (uint64_t i = 0; i < num_threads; ++i) {
-                thread_slices[i] = base_index.num_color_sets() / num_threads * i;
+            /*
+                The partial color sets are deduplicated in a table shared by all threads, but
+                every thread encodes the new ones it finds in its own builders: the id of a
+                partial color set is (thread_id, id among those encoded by the thread) until
+                all builders of a partition are appended, in thread order.
+            */
+            sharded_hash_table hashes(
+                uint64_t(1) << static_cast<uint64_t>(std::ceil(std::log2(64 * num_threads))));
+            std::vector<std::vector<typename ColorSets::builder::partial_color_sets_builder>>
+                thread_builders(num_threads);
+            for (auto& builders : thread_builders) {
+                builders.resize(num_partitions);
+                for (uint64_t partition_id = 0; partition_id != num_partitions; ++partition_id) {
+                    auto endpoints = p.partition_endpoints(partition_id);
+                    builders[partition_id].init(endpoints.end - endpoints.begin);
+                }
+            }
+            std::vector<std::vector<uint32_t>> thread_num_partial_color_sets(
+                num_threads, std::vector<uint32_t>(num_partitions, 0));
+
+            if constexpr (std::is_same_v<typename ColorSets::builder::partial_color_sets_builder,
+                                         hybrid::builder>) {
+                /* only the hybrid encoding has thresholds */
+                if (m_build_config.tune_for != tuning_t::NO_TUNING) {
+                    auto thresholds = tune_thresholds(p);
+                    uint64_t num_bits = 0, default_num_bits = 0;
+                    double nanosec = 0, default_nanosec = 0;
+                    for (uint64_t partition_id = 0; partition_id != num_partitions;
+                         ++partition_id) {
+                        auto const& t = thresholds[partition_id];
+                        color_sets_builder.set_thresholds(partition_id, t.sparse_set_threshold_size,
+                                                          t.very_dense_set_threshold_size);
+                        for (auto& builders : thread_builders) {
+                            builders[partition_id].set_thresholds(t.sparse_set_threshold_size,
+                                                                  t.very_dense_set_threshold_size);
+                        }
+                        num_bits += t.num_bits;
+                        default_num_bits += t.default_num_bits;
+                        nanosec += t.nanosec;
+                        default_nanosec += t.default_nanosec;
+                    }
+                    std::cout << "tuned the thresholds of " << num_partitions
+                              << " partitions (sample: " << num_bits << " bits, decoded in "
+                              << nanosec / 1000 << " us; with the default thresholds: "
+                              << default_num_bits << " bits, " << default_nanosec / 1000 << " us)"
+                              << std::endl;
+                }
             }
-            thread_slices[num_threads] = base_index.num_color_sets();
 
-            auto exe = [&](uint64_t thread_id) {
+            /*
+                The color sets are processed in chunks of about the same total size, taken
+                dynamically by the threads. The meta color sets of a chunk are kept in memory
+                if they all fit in half of the RAM limit (the other half is reserved for the
+                partial color sets); otherwise every thread writes those of its chunks, in
+                order, to its own file and chunk_owner records which file holds a chunk.
+            */
+            task_scheduler scheduler(num_threads);
+            bool in_memory = false;
+            {
+                uint64_t total_size = 0;
+                uint64_t max_num_integers = 0;  // in the meta color sets, with their sizes
+                for (uint64_t color_set_id = 0; color_set_id != num_color_sets; ++color_set_id) {
+                    const uint64_t size = base_index.color_set(color_set_id).size();
+                    total_size += size;
+                    max_num_integers += 3 * std::min(size, num_partitions) + 1;
+                }
+                in_memory = max_num_integers * sizeof(uint32_t) <=
+                            m_build_config.ram_limit_in_bytes(2);
+                scheduler.add(
+                    0, num_color_sets, scheduler.chunk_weight(total_size),
+                    [&](uint64_t color_set_id) {
+                        return base_index.color_set(color_set_id).size();
+                    },
+                    [](uint64_t) { return true; });
+            }
+            std::vector<uint32_t> chunk_owner(scheduler.num_chunks());
+            std::vector<uint64_t> chunk_num_integers(scheduler.num_chunks());
+            std::vector<std::vector<uint32_t>> chunk_metacolor_sets(scheduler.num_chunks());
+            std::cout << "keeping the meta color sets " << (in_memory ? "in memory" : "on disk")
+                      << std::endl;
+
+            std::vector<std::ofstream> metacolor_sets_ofstreams(in_memory ? 0 : num_threads);
+            for (uint64_t thread_id = 0; thread_id != metacolor_sets_ofstreams.size();
+                 ++thread_id) {
                 std::string tmp_filename = metacolor_set_file_name(thread_id);
+                metacolor_sets_ofstreams[thread_id].open(tmp_filename, std::ios::binary);
+                if (!metacolor_sets_ofstreams[thread_id].is_open()) {
+                    throw std::runtime_error("error in opening file: " + tmp_filename);
+                }
+            }
+
+            auto exe = [&](uint64_t thread_id, uint64_t chunk_id) {
                 uint64_t partition_id = 0;
                 uint32_t meta_color_set_size = 0;
                 std::vector<uint32_t> partial_color_set;
                 std::vector<uint32_t> permuted_set;
-                std::ofstream metacolor_sets_ofstream(tmp_filename, std::ios::binary);
-                if (!metacolor_sets_ofstream.is_open()) {
-                    throw std::runtime_error("error in opening file");
-                }
+                auto& metacolor_sets = chunk_metacolor_sets[chunk_id];
+                auto const& chunk = scheduler.chunks()[chunk_id];
+                chunk_owner[chunk_id] = thread_id;
 
                 partial_color_set.reserve(max_partition_size);
                 permuted_set.reserve(num_colors);
 
+                auto& builders = thread_builders[thread_id];
+                auto& num_partial_color_sets_of_thread = thread_num_partial_color_sets[thread_id];
+
                 auto hash_and_compress = [&]() {
-                    std::lock_guard<std::shared_mutex> lock(partitions_mutex[partition_id]);
                     assert(!partial_color_set.empty());
-                    uint32_t partial_color_set_id = 0;
                     auto hash =
                         util::hash128(reinterpret_cast<char const*>(partial_color_set.data()),
-                                      partial_color_set.size() * sizeof(uint32_t));
-                    auto it = hashes[partition_id].find(hash);
-
-                    if (it == hashes[partition_id].cend()) {  // new partial color
-                        partial_color_set_id = hashes[partition_id].size();
-                        hashes[partition_id].insert({hash, partial_color_set_id});
-                        color_sets_builder.encode_color_set(partition_id, partial_color_set.data(),
-                                                            partial_color_set.size());
-                    } else {
-                        partial_color_set_id = (*it).second;
+                                      partial_color_set.size() * sizeof(uint32_t), partition_id);
+                    const uint64_t local_id = num_partial_color_sets_of_thread[partition_id];
+                    auto [id, inserted] = hashes.insert(hash, (thread_id << 32) | local_id);
+                    if (inserted) {  // new partial color
+                        num_partial_color_sets_of_thread[partition_id] += 1;
+                        builders[partition_id].encode_color_set(partial_color_set.data(),
+                                                                partial_color_set.size());
                     }
 
-                    /*  write meta color: (partition_id, partial_color_set_id)
+                    /*  append meta color: (partition_id, thread_id, partial_color_set_id)
                         Note: at this stage, partial_color_set_id is relative
-                              to its partition (is not global yet).
+                              to its partition and to the thread that encoded it.
                     */
-                    metacolor_sets_ofstream.write(reinterpret_cast<char const*>(&partition_id),
-                                                  sizeof(uint32_t));
-                    metacolor_sets_ofstream.write(
-                        reinterpret_cast<char const*>(&partial_color_set_id), sizeof(uint32_t));
+                    metacolor_sets.push_back(partition_id);
+                    metacolor_sets.push_back(id >> 32);
+                    metacolor_sets.push_back(id & uint32_t(-1));
 
                     partial_color_set.clear();
                     meta_color_set_size += 1;
                 };
 
-                for (uint64_t color_set_id = thread_slices[thread_id];
-                     color_set_id != thread_slices[thread_id + 1]; ++color_set_id) {
+                for (uint64_t color_set_id = chunk.begin; color_set_id != chunk.end;
+                     ++color_set_id) {
                     /* permute set */
                     permuted_set.clear();
                     auto it = base_index.color_set(color_set_id);
@@ -248,8 +452,8 @@ struct index<ColorSets>::meta_builder {
                     assert(partial_color_set.empty());
 
                     /* reserve space to hold the size of the meta color set */
-                    metacolor_sets_ofstream.write(
-                        reinterpret_cast<char const*>(&meta_color_set_size), sizeof(uint32_t));
+                    const uint64_t size_pos = metacolor_sets.size();
+                    metacolor_sets.push_back(meta_color_set_size);
 
                     for (uint64_t i = 0; i != set_size; ++i) {
                         uint32_t ref_id = permuted_set[i];
@@ -265,35 +469,38 @@ struct index<ColorSets>::meta_builder {
 
                     num_integers_in_metacolor_sets += meta_color_set_size;
 
-                    /* write size of meta color set */
-                    uint64_t current_pos = metacolor_sets_ofstream.tellp();
-                    uint64_t num_bytes_in_meta_color_set =
-                        2 * meta_color_set_size * sizeof(uint32_t) + sizeof(uint32_t);
-                    assert(current_pos >= num_bytes_in_meta_color_set);
-                    uint64_t pos = current_pos - num_bytes_in_meta_color_set;
-                    metacolor_sets_ofstream.seekp(pos);
-                    metacolor_sets_ofstream.write(
-                        reinterpret_cast<char const*>(&meta_color_set_size), sizeof(uint32_t));
-                    metacolor_sets_ofstream.seekp(current_pos);
+                    metacolor_sets[size_pos] = meta_color_set_size;
                 }
 
-                metacolor_sets_ofstream.close();
+                chunk_num_integers[chunk_id] = metacolor_sets.size();
+                if (!in_memory) {
+                    auto& out = metacolor_sets_ofstreams[thread_id];
+                    out.write(reinterpret_cast<char const*>(metacolor_sets.data()),
+                              metacolor_sets.size() * sizeof(uint32_t));
+                    std::vector<uint32_t>().swap(metacolor_sets);
+                }
             };
 
-            for (uint64_t i = 0; i != num_threads; ++i) threads[i] = std::thread(exe, i);
-
-            for (auto& t : threads) {
-                if (t.joinable()) t.join();
-            }
+            scheduler.run(exe);
+            for (auto& out : metacolor_sets_ofstreams) out.close();
 
-            std::vector<uint64_t> num_partial_color_sets_before;
+            /* global id of the first partial color set encoded by each thread, per partition */
+            std::vector<std::vector<uint64_t>> num_partial_color_sets_before(
+                num_partitions, std::vector<uint64_t>(num_threads));
             std::vector<uint32_t> num_sets_in_partition;
-            num_partial_color_sets_before.reserve(num_partitions);
             num_sets_in_partition.reserve(num_partitions);
             num_partial_color_sets = 0;
             for (uint64_t partition_id = 0; partition_id != num_partitions; ++partition_id) {
-                num_partial_color_sets_before.push_back(num_partial_color_sets);
-                uint64_t num_partial_color_sets_in_partition = hashes[partition_id].size();
+                uint64_t num_partial_color_sets_in_partition = 0;
+                for (uint64_t thread_id = 0; thread_id != num_threads; ++thread_id) {
+                    num_partial_color_sets_before[partition_id][thread_id] =
+                        num_partial_color_sets + num_partial_color_sets_in_partition;
+                    num_partial_color_sets_in_partition +=
+                        thread_num_partial_color_sets[thread_id][partition_id];
+                    color_sets_builder.append_color_sets(partition_id,
+                                                         thread_builders[thread_id][partition_id]);
+                    thread_builders[thread_id][partition_id] = {};  // release memory
+                }
                 num_partial_color_sets += num_partial_color_sets_in_partition;
                 num_sets_in_partition.push_back(num_partial_color_sets_in_partition);
                 std::cout << "num_partial_color_sets_in_partition-" << partition_id << ": "
@@ -306,51 +513,78 @@ struct index<ColorSets>::meta_builder {
                 num_integers_in_metacolor_sets + num_color_sets, num_partial_color_sets,
                 p.partition_size(), num_sets_in_partition);
 
-            std::vector<uint32_t> metacolor_set;
-            metacolor_set.reserve(num_partitions);  // at most
-
-            std::ifstream metacolor_set_in(metacolor_set_file_name(0), std::ios::binary);
-            if (!metacolor_set_in.is_open()) throw std::runtime_error("error in opening file");
-
-            uint64_t thread_id = 0;
-            for (uint64_t color_set_id = 0; color_set_id != num_color_sets; ++color_set_id) {
-                if (color_set_id >= thread_slices[thread_id + 1]) {
-                    metacolor_set_in.close();
-                    std::remove(metacolor_set_file_name(thread_id).c_str());
+            /*
+                Transform the partial color set ids of a chunk into global ids, in place, so that
+                every meta color set becomes (size, ids...): return the number of integers left.
+            */
+            auto remap = [&](std::vector<uint32_t>& metacolor_sets) {
+                uint64_t out = 0;
+                for (uint64_t in = 0; in != metacolor_sets.size();) {
+                    const uint32_t meta_color_set_size = metacolor_sets[in++];
+                    metacolor_sets[out++] = meta_color_set_size;
+                    for (uint32_t i = 0; i != meta_color_set_size; ++i, in += 3) {
+                        const uint32_t partition_id = metacolor_sets[in];
+                        const uint32_t owner = metacolor_sets[in + 1];
+                        const uint32_t partial_color_set_id = metacolor_sets[in + 2];
+                        metacolor_sets[out++] =
+                            partial_color_set_id +
+                            num_partial_color_sets_before[partition_id][owner];
+                    }
+                }
+                return out;
+            };
+            auto encode = [&](std::vector<uint32_t> const& metacolor_sets, uint64_t size) {
+                for (uint64_t pos = 0; pos != size;) {
+                    const uint32_t meta_color_set_size = metacolor_sets[pos++];
+                    color_sets_builder.encode_metacolor_set(metacolor_sets.data() + pos,
+                                                            meta_color_set_size);
+                    pos += meta_color_set_size;
+                }
+            };
 
-                    thread_id++;
+            if (in_memory) {
+                std::vector<uint64_t> chunk_size(scheduler.num_chunks());
+                scheduler.run([&](uint64_t /* thread_id */, uint64_t chunk_id) {
+                    chunk_size[chunk_id] = remap(chunk_metacolor_sets[chunk_id]);
+                });
+                for (uint64_t chunk_id = 0; chunk_id != scheduler.num_chunks(); ++chunk_id) {
+                    encode(chunk_metacolor_sets[chunk_id], chunk_size[chunk_id]);
+                    std::vector<uint32_t>().swap(chunk_metacolor_sets[chunk_id]);
+                }
+            } else {
+                /* every thread took its chunks in increasing order: every file is read once */
+                std::vector<std::ifstream> metacolor_sets_ifstreams(num_threads);
+                for (uint64_t thread_id = 0; thread_id != num_threads; ++thread_id) {
                     std::string tmp_filename = metacolor_set_file_name(thread_id);
-                    metacolor_set_in = std::ifstream(tmp_filename, std::ios::binary);
-                    if (!metacolor_set_in.is_open())
+                    metacolor_sets_ifstreams[thread_id].open(tmp_filename, std::ios::binary);
+                    if (!metacolor_sets_ifstreams[thread_id].is_open()) {
                         throw std::runtime_error("error in opening file: " + tmp_filename);
+                    }
                 }
 
-                assert(metacolor_set.empty());
-                uint32_t meta_color_set_size = 0;
-                metacolor_set_in.read(reinterpret_cast<char*>(&meta_color_set_size),
-                                      sizeof(uint32_t));
-                for (uint32_t i = 0; i != meta_color_set_size; ++i) {
-                    uint32_t partition_id = 0;
-                    uint32_t partial_color_set_id = 0;
-                    metacolor_set_in.read(reinterpret_cast<char*>(&partition_id), sizeof(uint32_t));
-                    metacolor_set_in.read(reinterpret_cast<char*>(&partial_color_set_id),
-                                          sizeof(uint32_t));
-                    /* transform the partial_color_set_id into a global id */
-                    metacolor_set.push_back(partial_color_set_id +
-                                            num_partial_color_sets_before[partition_id]);
+                std::vector<uint32_t> metacolor_sets;
+                for (uint64_t chunk_id = 0; chunk_id != scheduler.num_chunks(); ++chunk_id) {
+                    auto& in = metacolor_sets_ifstreams[chunk_owner[chunk_id]];
+                    metacolor_sets.resize(chunk_num_integers[chunk_id]);
+                    in.read(reinterpret_cast<char*>(metacolor_sets.data()),
+                            metacolor_sets.size() * sizeof(uint32_t));
+                    if (!in) throw std::runtime_error("error in reading meta color sets");
+                    encode(metacolor_sets, remap(metacolor_sets));
                 }
-                color_sets_builder.encode_metacolor_set(metacolor_set.data(), metacolor_set.size());
-                metacolor_set.clear();
-            }
 
-            metacolor_set_in.close();
-            std::remove(metacolor_set_file_name(thread_id).c_str());
+                for (uint64_t thread_id = 0; thread_id != num_threads; ++thread_id) {
+                    metacolor_sets_ifstreams[thread_id].close();
+                    std::remove(metacolor_set_file_name(thread_id).c_str());
+                }
+            }
             color_sets_builder.build(idx.m_color_sets);
 
             timer.stop();
             std::cout << "** building partial/meta color sets took " << timer.elapsed()
                       << " seconds / " << timer.elapsed() / 60 << " minutes" << std::endl;
             timer.reset();
+
+            cp.save("meta.color_sets", idx.m_color_sets);
         }
 
         {
@@ -358,6 +592,7 @@ struct index<ColorSets>::meta_builder {
             timer.start();
             idx.m_u2c = base_index.get_u2c();
             idx.m_u2c_rank1_index = base_index.get_u2c_rank1_index();
+            idx.m_u2c_map = base_index.get_u2c_map();
             idx.m_k2u = base_index.get_k2u();
             timer.stop();
             std::cout << "** copying u2c and k2u took " << timer.elapsed() << " seconds / "
@@ -459,11 +694,63 @@ struct index<ColorSets>::meta_builder {
         essentials::logger("DONE!");
     }
 
+    /* the new color of every color of the input index */
+    std::vector<uint32_t> const& get_permutation() const { return permutation; }
+
 private:
     build_configuration m_build_config;
     hfur_index_t base_index;
     std::vector<uint32_t> permutation;
 
+    /*
+        Tune the thresholds of the partial color sets of every partition on the partial color
+        sets of evenly spaced color sets of the base index.
+    */
+    std::vector<hybrid::thresholds_tuner::thresholds> tune_thresholds(permuter const& p) const {
+        const uint64_t num_partitions = p.num_partitions();
+        const uint64_t num_color_sets = base_index.num_color_sets();
+        std::vector<hybrid::thresholds_tuner> tuners;
+        tuners.reserve(num_partitions);
+        for (uint64_t partition_id = 0; partition_id != num_partitions; ++partition_id) {
+            auto endpoints = p.partition_endpoints(partition_id);
+            tuners.emplace_back(endpoints.end - endpoints.begin);
+        }
+
+        /* sample as many color sets as the tuner of the largest partition takes */
+        const uint64_t sample_size =
+            hybrid::thresholds_tuner(p.max_partition_size()).max_num_sets();
+        const uint64_t stride = (num_color_sets + sample_size - 1) / sample_size;
+        std::vector<uint32_t> permuted_set;
+        std::vector<uint32_t> partial_color_set;
+        for (uint64_t color_set_id = 0; color_set_id < num_color_sets; color_set_id += stride) {
+            permuted_set.clear();
+            auto it = base_index.color_set(color_set_id);
+            const uint64_t set_size = it.size();
+            for (uint64_t i = 0; i != set_size; ++i, ++it) permuted_set.push_back(permutation[*it]);
+            std::sort(permuted_set.begin(), permuted_set.end());
+
+            uint64_t partition_id = 0;
+            partition_endpoint curr_partition = p.partition_endpoints(0);
+            for (uint64_t i = 0; i <= set_size; ++i) {
+                if (i == set_size or permuted_set[i] >= curr_partition.end) {
+                    tuners[partition_id].add(partial_color_set.data(), partial_color_set.size());
+                    partial_color_set.clear();
+                    if (i == set_size) break;
+                    while (permuted_set[i] >= curr_partition.end) {
+                        partition_id += 1;
+                        curr_partition = p.partition_endpoints(partition_id);
+                    }
+                }
+                partial_color_set.push_back(permuted_set[i] - curr_partition.begin);
+            }
+        }
+
+        std::vector<hybrid::thresholds_tuner::thresholds> thresholds;
+        thresholds.reserve(num_partitions);
+        for (auto const& tuner : tuners) thresholds.push_back(tuner.tune(m_build_config.tune_for));
+        return thresholds;
+    }
+
     std::string metacolor_set_file_name(uint32_t id) {
         return m_build_config.tmp_dirname + "/metacolor_set_" + std::to_string(id) + ".bin";
     }
@@ -2,6 +2,7 @@
 
 #include "include/index.hpp"
 #include "include/build_util.hpp"
+#include "include/checkpoint.hpp"
 
 namespace fulgor {
 
@@ -28,136 +29,151 @@ struct index<ColorSets>::meta_differential_builder {
         builder.init(meta_index.num_colors(), num_partitions);
 
         std::vector<std::vector<uint32_t>> partial_permutations(num_partitions);
+        checkpoint cp(m_build_config, ColorSets::type);
+        const bool color_sets_done = cp.completed("meta_diff.color_sets");
 
-        {
+        if (!color_sets_done) {
             essentials::logger("step 2. building differential partial/meta color sets");
             timer.start();
 
             std::vector<hybrid> const& pc = meta_index.get_color_sets().partial_colors();
             assert(pc.size() == num_partitions);
 
+            /*
+                The partitions are clustered one after the other (every permuter uses the same
+                temporary files), then the groups of all partitions are encoded concurrently,
+                in chunks of about the same total size taken dynamically by the threads:
+                a thread is not left idle waiting for the last chunks of a partition.
+            */
+            std::vector<std::vector<std::pair<uint32_t, uint32_t>>> permutations(num_partitions);
+            std::vector<bool> partition_done(num_partitions, false);
+            uint64_t load = 0;
             for (uint64_t meta_partition_id = 0; meta_partition_id < num_partitions;
                  meta_partition_id++) {
-                std::cout << " Partition " << meta_partition_id << " / " << num_partitions - 1
-                          << std::endl;
+                const std::string stage =
+                    "meta_diff.partition_" + std::to_string(meta_partition_id);
+                if (cp.completed(stage)) {
+                    partition_done[meta_partition_id] = true;
+                    continue;
+                }
+
+                std::cout << " Clustering partition " << meta_partition_id << " / "
+                          << num_partitions - 1 << std::endl;
                 auto& meta_partition = pc[meta_partition_id];
                 const uint64_t num_partition_color_sets = meta_partition.num_color_sets();
-                const uint64_t num_partition_colors = meta_partition.num_colors();
-
                 differential_permuter dp(m_build_config);
                 dp.permute(meta_partition);
-                auto const& permutation = dp.permutation();
+                std::swap(permutations[meta_partition_id], dp.permutation());
+
+                auto const& permutation = permutations[meta_partition_id];
                 partial_permutations[meta_partition_id].resize(num_partition_color_sets);
+                for (uint64_t i = 0; i < num_partition_color_sets; i++) {
+                    auto& [group_id, color_set_id] = permutation[i];
+                    partial_permutations[meta_partition_id][color_set_id] = i;
+                    load += meta_partition.color_set(color_set_id).size();
+                }
+            }
 
-                essentials::timer<std::chrono::high_resolution_clock, std::chrono::seconds> timer;
-                timer.start();
+            task_scheduler scheduler(num_threads);
+            const uint64_t chunk_weight = scheduler.chunk_weight(load);
+            for (uint64_t meta_partition_id = 0; meta_partition_id < num_partitions;
+                 meta_partition_id++) {
+                if (partition_done[meta_partition_id]) continue;
+                auto const& meta_partition = pc[meta_partition_id];
+                auto const& permutation = permutations[meta_partition_id];
+                scheduler.add(
+                    meta_partition_id, meta_partition.num_color_sets(), chunk_weight,
+                    [&](uint64_t i) {
+                        return meta_partition.color_set(permutation[i].second).size();
+                    },
+                    [&](uint64_t i) {  // a group is never split
+                        return i == 0 or permutation[i].first != permutation[i - 1].first;
+                    });
+            }
 
-                struct slice {
-                    uint64_t begin, end;
-                };
-                std::vector<slice> thread_slices;
+            std::vector<differential::builder> chunk_builders;
+            chunk_builders.reserve(scheduler.num_chunks());
+            for (auto const& chunk : scheduler.chunks()) {
+                chunk_builders.emplace_back(pc[chunk.group].num_colors());
+            }
+            const uint64_t num_bits_per_chunk =
+                m_build_config.ram_limit_in_bytes(2 * scheduler.num_chunks()) * 8;
+
+            auto encode_color_sets = [&](uint64_t /* thread_id */, uint64_t chunk_id) {
+                auto& color_sets_builder = chunk_builders[chunk_id];
+                auto const& [meta_partition_id, begin, end] = scheduler.chunks()[chunk_id];
+                auto const& meta_partition = pc[meta_partition_id];
+                auto const& permutation = permutations[meta_partition_id];
+                const uint64_t num_partition_colors = meta_partition.num_colors();
+                color_sets_builder.reserve_num_bits(num_bits_per_chunk);
 
-                uint64_t load = 0;
-                for (uint32_t color_set_id = 0; color_set_id < num_partition_color_sets;
-                     ++color_set_id) {
-                    load += meta_partition.color_set(color_set_id).size();
-                }
-                const uint64_t load_per_thread = load / num_threads;
-
-                slice s = {0, 0};
-                uint64_t curr_load = 0;
-                uint64_t prev_cluster = permutation[0].first;
-                for (uint64_t i = 0; i < num_partition_color_sets; ++i) {
-                    auto& [cluster_id, color_set_id] = permutation[i];
-                    if (cluster_id != prev_cluster && curr_load >= load_per_thread) {
-                        s.end = i;
-                        thread_slices.push_back(s);
-                        s.begin = i;
-                        curr_load = 0;
+                std::vector<uint64_t> group_endpoints;
+                uint64_t curr_group = permutation[begin].first + 1;  // different from first group
+                for (uint64_t i = begin; i < end; i++) {
+                    auto& [group_id, color_set_id] = permutation[i];
+                    if (group_id != curr_group) {
+                        group_endpoints.push_back(i);
+                        curr_group = group_id;
                     }
-                    curr_load += meta_partition.color_set(color_set_id).size();
                 }
-                s.end = num_partition_color_sets;
-                thread_slices.push_back(s);
-
-                std::vector<differential::builder> thread_builders(thread_slices.size(),
-                                                                   num_partition_colors);
-                std::vector<std::thread> threads(thread_slices.size());
-
-                auto encode_color_sets = [&thread_builders, &thread_slices, &permutation,
-                                          &meta_partition,
-                                          num_partition_colors](uint64_t thread_id) {
-                    auto& color_sets_builder = thread_builders[thread_id];
-                    auto& [begin, end] = thread_slices[thread_id];
-                    color_sets_builder.reserve_num_bits(16 * essentials::GB * 8);
-
-                    std::vector<uint64_t> group_endpoints;
-                    uint64_t curr_group =
-                        permutation[begin].first + 1;  // different from first group
-                    for (uint64_t i = begin; i < end; i++) {
+                group_endpoints.push_back(end);
+
+                differential::representative_optimizer optimizer(num_partition_colors);
+                std::vector<uint32_t> representative;
+                for (uint64_t group = 0; group < group_endpoints.size() - 1; ++group) {
+                    uint64_t g_begin = group_endpoints[group];
+                    uint64_t g_end = group_endpoints[group + 1];
+                    auto get = [&](uint64_t i) {
+                        return meta_partition.color_set(permutation[g_begin + i].second);
+                    };
+                    optimizer.optimize(g_end - g_begin, get, representative);
+                    color_sets_builder.process_partition(representative);
+
+                    for (uint64_t i = g_begin; i < g_end; ++i) {
                         auto& [group_id, color_set_id] = permutation[i];
-                        if (group_id != curr_group) {
-                            group_endpoints.push_back(i);
-                            curr_group = group_id;
-                        }
+                        auto it = meta_partition.color_set(color_set_id);
+                        color_sets_builder.process_color_set(it);
                     }
-                    group_endpoints.push_back(end);
-
-                    std::vector<uint32_t> distribution(num_partition_colors, 0);
-                    for (uint64_t group = 0; group < group_endpoints.size() - 1; ++group) {
-                        uint64_t g_begin = group_endpoints[group];
-                        uint64_t g_end = group_endpoints[group + 1];
-                        std::vector<uint32_t> representative;
-                        representative.reserve(num_partition_colors);
-
-                        for (uint64_t i = g_begin; i < g_end; ++i) {
-                            auto& [group_id, color_set_id] = permutation[i];
-                            auto it = meta_partition.color_set(color_set_id);
-                            uint64_t it_size = it.size();
-                            for (uint64_t pos = 0; pos < it_size; ++pos, ++it) {
-                                distribution[*it]++;
-                            }
-                        }
-                        uint64_t g_size = g_end - g_begin;
-                        for (uint64_t color = 0; color < num_partition_colors; ++color) {
-                            if (distribution[color] >= ceil(1. * g_size / 2.))
-                                representative.push_back(color);
-                        }
-                        color_sets_builder.process_partition(representative);
-
-                        for (uint64_t i = g_begin; i < g_end; ++i) {
-                            auto& [group_id, color_set_id] = permutation[i];
-                            auto it = meta_partition.color_set(color_set_id);
-                            color_sets_builder.process_color_set(it);
-                        }
-                        std::fill(distribution.begin(), distribution.end(), 0);
-                    }
-                };
-
-                for (uint64_t i = 0; i < num_partition_color_sets; i++) {
-                    auto& [group_id, color_set_id] = permutation[i];
-                    partial_permutations[meta_partition_id][color_set_id] = i;
-                }
-
-                for (uint64_t thread_id = 0; thread_id < thread_slices.size(); thread_id++) {
-                    threads[thread_id] = std::thread(encode_color_sets, thread_id);
                 }
-                for (auto& t : threads) {
-                    if (t.joinable()) t.join();
+            };
+
+            essentials::timer<std::chrono::high_resolution_clock, std::chrono::seconds>
+                encoding_timer;
+            encoding_timer.start();
+            scheduler.run(encode_color_sets);
+            encoding_timer.stop();
+            std::cout << "  ** encoding the color sets of all partitions took "
+                      << encoding_timer.elapsed() << " seconds / "
+                      << encoding_timer.elapsed() / 60 << " minutes" << std::endl;
+
+            /* the chunks of a partition are contiguous and in order */
+            uint64_t chunk_id = 0;
+            for (uint64_t meta_partition_id = 0; meta_partition_id < num_partitions;
+                 meta_partition_id++) {
+                const std::string stage =
+                    "meta_diff.partition_" + std::to_string(meta_partition_id);
+                differential d;
+                if (partition_done[meta_partition_id]) {
+                    cp.load(stage, d, partial_permutations[meta_partition_id]);
+                    builder.process_partition(d);
+                    continue;
                 }
 
-                for (uint64_t thread_id = 1; thread_id < thread_builders.size(); thread_id++) {
-                    thread_builders[0].append(thread_builders[thread_id]);
+                assert(chunk_id < scheduler.num_chunks());
+                assert(scheduler.chunks()[chunk_id].group == meta_partition_id);
+                auto& partition_builder = chunk_builders[chunk_id++];
+                for (; chunk_id != scheduler.num_chunks() and
+                       scheduler.chunks()[chunk_id].group == meta_partition_id;
+                     ++chunk_id) {
+                    partition_builder.append(chunk_builders[chunk_id]);
+                    chunk_builders[chunk_id] = {};  // release memory
                 }
-                differential d;
-                thread_builders[0].build(d);
+                partition_builder.build(d);
+                partition_builder = {};
+                cp.save(stage, d, partial_permutations[meta_partition_id]);
                 builder.process_partition(d);
-
-                timer.stop();
-                std::cout << "  ** building the color sets for partition " << meta_partition_id
-                          << " took " << timer.elapsed() << " seconds / " << timer.elapsed() / 60
-                          << " minutes" << std::endl;
             }
+            assert(chunk_id == scheduler.num_chunks());
 
             timer.stop();
             std::cout << "** building partial/meta color sets took " << timer.elapsed()
@@ -167,7 +183,10 @@ struct index<ColorSets>::meta_differential_builder {
 
         std::vector<uint32_t> permutation(num_color_sets);
 
-        {
+        if (color_sets_done) {
+            essentials::logger("step 5. loading differential-meta color sets");
+            cp.load("meta_diff.color_sets", idx.m_color_sets, permutation);
+        } else {
             essentials::logger("step 5. build differential-meta color sets");
             timer.start();
 
@@ -262,16 +281,47 @@ struct index<ColorSets>::meta_differential_builder {
             std::cout << "** building differential-meta color sets took " << timer.elapsed()
                       << " seconds / " << timer.elapsed() / 60 << " minutes" << std::endl;
             timer.reset();
+
+            cp.save("meta_diff.color_sets", idx.m_color_sets, permutation);
         }
 
-        {
+        /* the unitigs of an index with a u2c map (e.g., a merged one) are not grouped by
+           color set: they can only be mapped */
+        if (m_build_config.rebuild_k2u and meta_index.get_u2c_map().size() != 0) {
+            std::cout << "option '--rebuild-k2u' is ignored: the index has a map from unitigs "
+                         "to color sets"
+                      << std::endl;
+        }
+        if (!m_build_config.rebuild_k2u or meta_index.get_u2c_map().size() != 0) {
+            essentials::logger("step 6. map unitigs to the permuted color sets");
+            timer.start();
+            std::vector<uint32_t> new_color_set_id(num_color_sets);
+            for (uint64_t i = 0; i != num_color_sets; ++i) new_color_set_id[permutation[i]] = i;
+            idx.permute_color_set_ids(meta_index, new_color_set_id);
+            timer.stop();
+            std::cout << "** mapping unitigs took " << timer.elapsed() << " seconds / "
+                      << timer.elapsed() / 60 << " minutes" << std::endl;
+            timer.reset();
+        } else {
             essentials::logger("step 6. build u2c and k2u");
             timer.start();
 
+            auto const& dict = meta_index.get_k2u();
+
+            /* build a new sshash::dictionary on the permuted unitigs, while they are written */
+            sshash::build_configuration sshash_config;
+            sshash_config.k = dict.k();
+            sshash_config.m = dict.m();
+            assert(dict.canonical() == true);
+            sshash_config.canonical = dict.canonical();
+            sshash_config.verbose = m_build_config.verbose;
+            sshash_config.tmp_dirname = m_build_config.tmp_dirname;
+            sshash_config.num_threads = util::largest_power_of_2(m_build_config.num_threads);
+            sshash_config.print();
             const std::string permuted_unitigs_filename =
                 m_build_config.tmp_dirname + "/permuted_unitigs.fa";
-            std::ofstream out(permuted_unitigs_filename.c_str());
-            if (!out.is_open()) throw std::runtime_error("cannot open output file");
+            concurrent_sshash_builder k2u_builder(idx.m_k2u, permuted_unitigs_filename,
+                                                  sshash_config);
 
             auto const& u2c = meta_index.get_u2c();
             bits::darray1 d;  // for select_1 on u2c
@@ -280,9 +330,6 @@ struct index<ColorSets>::meta_differential_builder {
             const uint64_t num_unitigs = u2c.num_bits();
             bits::bit_vector::builder u2c_builder(num_unitigs + 1, 0);
 
-            auto const& dict = meta_index.get_k2u();
-            const uint64_t k = dict.k();
-
             uint64_t pos = 0;
             for (uint64_t new_color_id = 0; new_color_id != num_color_sets; ++new_color_id) {
                 uint64_t old_color_id = permutation[new_color_id];
@@ -301,38 +348,16 @@ struct index<ColorSets>::meta_differential_builder {
                 u2c_builder.set(pos - 1, 1);
 
                 for (uint64_t i = old_unitig_id_begin; i != old_unitig_id_end; ++i) {
-                    auto it = dict.at_contig_id(i);
-                    out << ">\n";
-                    auto [_, kmer] = it.next();
-                    out << kmer;
-                    while (it.has_next()) {
-                        auto [_, kmer] = it.next();
-                        out << kmer[k - 1];  // overlaps!
-                    }
-                    out << '\n';
+                    k2u_builder.append(dict, i);
                 }
             }
 
             assert(pos == num_unitigs);
-            out.close();
             u2c_builder.build(idx.m_u2c);
             idx.m_u2c_rank1_index.build(idx.m_u2c);
 
-            /* build a new sshash::dictionary on the permuted unitigs */
-            sshash::build_configuration sshash_config;
-            sshash_config.k = dict.k();
-            sshash_config.m = dict.m();
-            assert(dict.canonical() == true);
-            sshash_config.canonical = dict.canonical();
-            sshash_config.verbose = m_build_config.verbose;
-            sshash_config.tmp_dirname = m_build_config.tmp_dirname;
-            sshash_config.num_threads = util::largest_power_of_2(m_build_config.num_threads);
-            sshash_config.print();
-            idx.m_k2u.build(permuted_unitigs_filename, sshash_config);
+            k2u_builder.wait();
             assert(idx.get_k2u().size() == dict.size());
-            try {  // remove unitig file
-                std::remove(permuted_unitigs_filename.c_str());
-            } catch (std::exception const& e) { std::cerr << e.what() << std::endl; }
 
             timer.stop();
             std::cout << "** building u2c and k2u took " << timer.elapsed() << " seconds / "
@@ -0,0 +1,224 @@
+#pragma once
+
+namespace fulgor {
+
+/*
+    Permute the references of a Fulgor index as for a meta-colored index (see permuter), so that
+    similar references get consecutive colors, and re-encode its color sets with the permuted
+    colors: with the same thresholds for hybrid color sets (see the tool reorder), or with
+    roaring containers, where the color sets become long runs. The k-mer dictionary and the
+    color set ids are those of the input index.
+*/
+template <typename ColorSets>
+struct index<ColorSets>::reorder_builder {
+    reorder_builder() {}
+
+    reorder_builder(build_configuration const& build_config) : m_build_config(build_config) {}
+
+    void build(index& idx) {
+        if (idx.m_k2u.size() != 0) throw std::runtime_error("index already built");
+
+        essentials::logger("step 1. loading index to be reordered...");
+        essentials::load(base_index, m_build_config.index_filename_to_partition.c_str());
+        essentials::logger("DONE");
+
+        const uint64_t num_threads = m_build_config.num_threads;
+        const uint64_t num_colors = base_index.num_colors();
+        const uint64_t num_color_sets = base_index.num_color_sets();
+
+        essentials::timer<std::chrono::high_resolution_clock, std::chrono::seconds> timer;
+
+        permuter p(m_build_config);
+        p.permute(base_index);
+        std::swap(permutation, p.permutation());
+
+        /* the thresholds of hybrid color sets are sizes: they do not depend on the order */
+        auto init_builder = [&](typename ColorSets::builder& builder) {
+            builder.init(num_colors);
+            if constexpr (ColorSets::type == index_t::HYBRID) {
+                auto const& color_sets = base_index.get_color_sets();
+                builder.set_thresholds(color_sets.sparse_set_threshold_size(),
+                                       color_sets.very_dense_set_threshold_size());
+            }
+        };
+
+        const std::string stage = ColorSets::type == index_t::ROARING ? "roaring.color_sets"
+                                                                       : "reorder.color_sets";
+        checkpoint cp(m_build_config, ColorSets::type);
+        if (cp.completed(stage)) {
+            essentials::logger("step 4. loading permuted color sets");
+            cp.load(stage, idx.m_color_sets);
+        } else {
+            essentials::logger("step 4. building permuted color sets");
+            timer.start();
+
+            /* every chunk is encoded by its own builder: the builders are appended in order */
+            task_scheduler scheduler(num_threads);
+            uint64_t total_size = 0;
+            for (uint64_t color_set_id = 0; color_set_id != num_color_sets; ++color_set_id) {
+                total_size += base_index.color_set(color_set_id).size();
+            }
+            scheduler.add(
+                0, num_color_sets, scheduler.chunk_weight(total_size),
+                [&](uint64_t color_set_id) { return base_index.color_set(color_set_id).size(); },
+                [](uint64_t) { return true; });
+
+            std::vector<typename ColorSets::builder> chunk_builders(scheduler.num_chunks());
+            scheduler.run([&](uint64_t /* thread_id */, uint64_t chunk_id) {
+                auto const& chunk = scheduler.chunks()[chunk_id];
+                auto& builder = chunk_builders[chunk_id];
+                init_builder(builder);
+                std::vector<uint32_t> permuted_set;
+                permuted_set.reserve(num_colors);
+                for (uint64_t color_set_id = chunk.begin; color_set_id != chunk.end;
+                     ++color_set_id) {
+                    permuted_set.clear();
+                    auto it = base_index.color_set(color_set_id);
+                    const uint64_t set_size = it.size();
+                    for (uint64_t i = 0; i != set_size; ++i, ++it) {
+                        permuted_set.push_back(permutation[*it]);
+                    }
+                    std::sort(permuted_set.begin(), permuted_set.end());
+                    builder.encode_color_set(permuted_set.data(), permuted_set.size());
+                }
+            });
+
+            typename ColorSets::builder color_sets_builder;
+            init_builder(color_sets_builder);
+            for (auto& builder : chunk_builders) {
+                color_sets_builder.append(builder);
+                builder = {};  // release memory
+            }
+            color_sets_builder.build(idx.m_color_sets);
+
+            timer.stop();
+            std::cout << "** building permuted color sets took " << timer.elapsed()
+                      << " seconds / " << timer.elapsed() / 60 << " minutes" << std::endl;
+            timer.reset();
+            std::cout << "color sets: " << idx.m_color_sets.num_bits() / 8 << " bytes ("
+                      << base_index.get_color_sets().num_bits() / 8
+                      << " bytes in the input index)" << std::endl;
+
+            cp.save(stage, idx.m_color_sets);
+        }
+
+        {
+            essentials::logger("step 5. copy u2c + rank1_index and k2u");
+            timer.start();
+            idx.m_u2c = base_index.get_u2c();
+            idx.m_u2c_rank1_index = base_index.get_u2c_rank1_index();
+            idx.m_u2c_map = base_index.get_u2c_map();
+            idx.m_k2u = base_index.get_k2u();
+            timer.stop();
+            std::cout << "** copying u2c and k2u took " << timer.elapsed() << " seconds / "
+                      << timer.elapsed() / 60 << " minutes" << std::endl;
+            timer.reset();
+        }
+
+        {
+            essentials::logger("step 6. building filenames");
+            timer.start();
+            idx.m_filenames.build(p.filenames());
+            timer.stop();
+            std::cout << "** building filenames took " << timer.elapsed() << " seconds / "
+                      << timer.elapsed() / 60 << " minutes" << std::endl;
+            timer.reset();
+        }
+    }
+
+    void check(index const& idx) {
+        const uint64_t num_color_sets = idx.num_color_sets();
+        const uint64_t num_colors = idx.num_colors();
+        essentials::timer<std::chrono::high_resolution_clock, std::chrono::seconds> timer;
+        essentials::logger("checking correctness...");
+        timer.start();
+
+        task_scheduler scheduler(m_build_config.num_threads);
+        uint64_t load = 0;
+        for (uint64_t color_set_id = 0; color_set_id != num_color_sets; ++color_set_id) {
+            load += idx.color_set(color_set_id).size();
+        }
+        scheduler.add(
+            0, num_color_sets, scheduler.chunk_weight(load),
+            [&](uint64_t color_set_id) { return idx.color_set(color_set_id).size(); },
+            [](uint64_t) { return true; });
+
+        std::atomic<uint64_t> num_checked_color_sets(0);
+        scheduler.run([&](uint64_t /* thread_id */, uint64_t chunk_id) {
+            auto const& chunk = scheduler.chunks()[chunk_id];
+            std::vector<uint32_t> permuted_set;
+            permuted_set.reserve(num_colors);
+            for (uint64_t color_set_id = chunk.begin; color_set_id != chunk.end; ++color_set_id) {
+                auto it_exp = base_index.color_set(color_set_id);
+                auto it_got = idx.color_set(color_set_id);
+                const uint64_t exp_size = it_exp.size();
+                const uint64_t got_size = it_got.size();
+                if (exp_size != got_size) {
+                    std::cout << "\033[1;31m"
+                              << "got colors set of size " << got_size << " but expected "
+                              << exp_size << " (color_set: " << color_set_id << ")\033[0m"
+                              << std::endl;
+                    return;
+                }
+
+                permuted_set.clear();
+                for (uint64_t i = 0; i != exp_size; ++i, ++it_exp) {
+                    permuted_set.push_back(permutation[*it_exp]);
+                }
+                std::sort(permuted_set.begin(), permuted_set.end());
+
+                for (uint64_t i = 0; i != got_size; ++i, ++it_got) {
+                    if (permuted_set[i] != *it_got) {
+                        std::cout << "\033[1;31m"
+                                  << "got ref " << *it_got << " but expected " << permuted_set[i]
+                                  << "(color_set: " << color_set_id << ")"
+                                  << "\033[0m" << std::endl;
+                        return;
+                    }
+                }
+
+                /* the access by container must give the same colors */
+                if constexpr (ColorSets::type == index_t::ROARING) {
+                    std::vector<roaring::interval> intervals;
+                    auto it = idx.color_set(color_set_id);
+                    for (; it.container_key() != it.num_keys(); it.next_container()) {
+                        it.container_intervals(intervals);
+                    }
+                    std::vector<uint32_t> colors;
+                    for (auto const& x : intervals) {
+                        for (uint32_t c = x.begin; c != x.end; ++c) colors.push_back(c);
+                    }
+                    if (colors != permuted_set) {
+                        std::cout << "\033[1;31m"
+                                  << "got wrong containers (color_set: " << color_set_id
+                                  << ")\033[0m" << std::endl;
+                        return;
+                    }
+                }
+
+                if (++num_checked_color_sets % 1000 == 0) {
+                    std::cout << "\rChecked " << num_checked_color_sets << "/" << num_color_sets
+                              << " color sets" << std::flush;
+                }
+            }
+        });
+
+        std::cout << "\rChecked " << num_checked_color_sets << "/" << num_color_sets
+                  << " color sets" << std::endl;
+
+        timer.stop();
+        std::cout << "** checking correctness took " << timer.elapsed() << " seconds / "
+                  << timer.elapsed() / 60 << " minutes" << std::endl;
+        essentials::logger("DONE!");
+    }
+
+    /* the new color of every color of the input index */
+    std::vector<uint32_t> const& get_permutation() const { return permutation; }
+
+private:
+    build_configuration m_build_config;
+    hfur_index_t base_index;
+    std::vector<uint32_t> permutation;
+};
+
+}  // namespace fulgor
@@ -0,0 +1,390 @@
+#pragma once
+
+#include <unordered_map>
+
+#include "include/index.hpp"
+#include "include/task_scheduler.hpp"
+#include "include/builders/builder.hpp"
+
+namespace fulgor {
+
+/*
+    Build the index of a subset of the colors of another index, without going
+    back to the references: the colors of the subset are renumbered in increasing
+    order, every color set is projected onto them and the projections are
+    deduplicated.
+
+    If no projection is empty, the dictionary and the unitig runs of the other
+    index are reused as they are, and only m_u2c_map changes. Otherwise, the
+    unitigs whose projection is empty are dropped and SSHash is rebuilt from the
+    remaining ones, optionally gluing the unitigs that are no longer maximal.
+*/
+template <typename ColorSets>
+struct index<ColorSets>::subset_builder {
+    subset_builder() {}
+
+    subset_builder(build_configuration const& build_config) : m_build_config(build_config) {}
+
+    /*
+        Colors must be sorted and distinct. With merge_unitigs, the unitigs that are
+        no longer separated by a branching k-mer or a color change are glued together.
+    */
+    template <typename Index>
+    void build(index& idx, Index const& other, std::vector<uint32_t> const& colors,
+               const bool merge_unitigs = false) {
+        if (idx.m_k2u.size() != 0) throw std::runtime_error("index already built");
+        if (colors.empty()) throw std::runtime_error("the subset of colors is empty");
+        if (!std::is_sorted(colors.begin(), colors.end()) or
+            std::adjacent_find(colors.begin(), colors.end()) != colors.end()) {
+            throw std::runtime_error("the subset of colors must be sorted and distinct");
+        }
+        if (colors.back() >= other.num_colors()) throw std::runtime_error("color out of bounds");
+
+        essentials::timer<std::chrono::high_resolution_clock, std::chrono::seconds> timer;
+
+        std::vector<uint32_t> new_color(other.num_colors(), none);
+        for (uint64_t i = 0; i != colors.size(); ++i) new_color[colors[i]] = i;
+
+        /* the id of the projection of every color set of other, or none if it is empty */
+        std::vector<uint32_t> new_color_set_id(other.num_color_sets(), none);
+        uint64_t num_color_sets = 0;
+        bool any_empty = false;
+
+        {
+            essentials::logger("step 1. projecting the color sets...");
+            timer.start();
+
+            const uint64_t num_colors = colors.size();
+            typename ColorSets::builder main_builder(num_colors);
+            {
+                constexpr uint64_t MAX_BUFFER_SIZE = 1 << 28;
+                const uint64_t buffer_size = std::max(
+                    std::min(m_build_config.ram_limit_in_bytes(2 * m_build_config.num_threads) / 8,
+                             MAX_BUFFER_SIZE),
+                    2 * (num_colors + 1));
+                ordered_color_sets_encoder encoder(main_builder, num_colors,
+                                                   m_build_config.num_threads, buffer_size);
+                std::unordered_map<__uint128_t, uint32_t, util::hasher_uint128_t> ids;
+                std::vector<uint32_t> color_set;
+                color_set.reserve(num_colors);
+                for (uint64_t color_set_id = 0; color_set_id != other.num_color_sets();
+                     ++color_set_id) {
+                    color_set.clear();
+                    auto it = other.color_set(color_set_id);
+                    const uint64_t other_num_colors = it.num_colors();
+                    for (uint64_t color = it.value(); color < other_num_colors;
+                         it.next(), color = it.value()) {
+                        if (new_color[color] != none) color_set.push_back(new_color[color]);
+                    }
+                    if (color_set.empty()) {
+                        any_empty = true;
+                        continue;
+                    }
+                    auto hash = util::hash128(reinterpret_cast<char const*>(color_set.data()),
+                                              color_set.size() * sizeof(uint32_t));
+                    auto [jt, inserted] = ids.insert({hash, num_color_sets});
+                    if (inserted) {
+                        encoder.insert(color_set.data(), color_set.size());
+                        num_color_sets += 1;
+                    }
+                    new_color_set_id[color_set_id] = jt->second;
+                }
+                encoder.finish();
+            }
+            main_builder.build(idx.m_color_sets);
+
+            timer.stop();
+            std::cout << "** projecting the color sets took " << timer.elapsed() << " seconds / "
+                      << timer.elapsed() / 60 << " minutes" << std::endl;
+            timer.reset();
+        }
+        std::cout << "num_color_sets " << num_color_sets << " (was " << other.num_color_sets()
+                  << ")" << std::endl;
+
+        if (!any_empty and !merge_unitigs) {
+            idx.permute_color_set_ids(other, new_color_set_id);
+        } else {
+            std::vector<uint64_t> links;
+            if (merge_unitigs) {
+                essentials::logger("step 2. finding the unitigs that can be glued...");
+                timer.start();
+                links = find_links(other, new_color_set_id);
+                timer.stop();
+                std::cout << "** finding the unitigs to glue took " << timer.elapsed()
+                          << " seconds / " << timer.elapsed() / 60 << " minutes" << std::endl;
+                timer.reset();
+            } else {
+                links.resize(2 * other.num_unitigs(), none_link);
+            }
+
+            essentials::logger("step 3. building SSHash on the unitigs with colors left...");
+            timer.start();
+
+            sshash::build_configuration sshash_config;
+            sshash_config.k = other.get_k2u().k();
+            sshash_config.m = other.get_k2u().m();
+            sshash_config.canonical = true;
+            sshash_config.verbose = m_build_config.verbose;
+            sshash_config.tmp_dirname = m_build_config.tmp_dirname;
+            sshash_config.num_threads = util::largest_power_of_2(m_build_config.num_threads);
+            sshash_config.print();
+            concurrent_sshash_builder k2u_builder(
+                idx.m_k2u, m_build_config.tmp_dirname + "/subset_unitigs.fa", sshash_config);
+
+            const uint64_t k = other.k();
+            std::vector<uint32_t> run_color_set_ids;
+            bits::bit_vector::builder u2c_builder;
+            uint64_t num_unitigs = 0;
+            uint32_t prev_color_set_id = none;
+            std::vector<bool> visited(other.num_unitigs(), false);
+            std::string unitig, contig;
+            for (uint64_t unitig_id = 0; unitig_id != other.num_unitigs(); ++unitig_id) {
+                const uint32_t color_set_id = new_color_set_id[other.u2c(unitig_id)];
+                if (color_set_id == none or visited[unitig_id]) continue;
+
+                /* walk back to the first unitig of the path (or around the cycle) */
+                uint64_t head = unitig_id << 1;  // unitig id and orientation (1 if reversed)
+                for (uint64_t l = predecessor(links, head); l != none_link;
+                     l = predecessor(links, head)) {
+                    if ((l >> 1) == unitig_id) break;
+                    head = l;
+                }
+
+                /* glue the unitigs of the path into a single contig */
+                contig.clear();
+                for (uint64_t l = head; l != none_link and !visited[l >> 1];
+                     l = successor(links, l)) {
+                    visited[l >> 1] = true;
+                    spell(other.get_k2u(), l >> 1, unitig);
+                    if (l & 1) reverse_complement(unitig);
+                    contig.append(unitig, contig.empty() ? 0 : k - 1);
+                }
+
+                if (color_set_id != prev_color_set_id) {
+                    if (num_unitigs > 0) u2c_builder.set(num_unitigs - 1, 1);
+                    run_color_set_ids.push_back(color_set_id);
+                    prev_color_set_id = color_set_id;
+                }
+                u2c_builder.push_back(0);
+                k2u_builder.append(contig.data(), contig.size());
+                num_unitigs += 1;
+            }
+            assert(num_unitigs > 0);
+            u2c_builder.set(num_unitigs - 1, 1);
+            u2c_builder.build(idx.m_u2c);
+            idx.m_u2c_rank1_index.build(idx.m_u2c);
+
+            const uint64_t num_runs = run_color_set_ids.size();
+            assert(idx.m_u2c_rank1_index.num_ones() == num_runs);
+            const uint64_t width = std::max<uint64_t>(std::ceil(std::log2(num_color_sets)), 1);
+            bits::compact_vector::builder map_builder(num_runs, width);
+            for (uint64_t i = 0; i != num_runs; ++i) map_builder.set(i, run_color_set_ids[i]);
+            map_builder.build(idx.m_u2c_map);
+
+            k2u_builder.wait();
+            assert(idx.m_k2u.num_contigs() == num_unitigs);
+            std::cout << "num_unitigs " << num_unitigs << " (was " << other.num_unitigs() << ")"
+                      << std::endl;
+
+            timer.stop();
+            std::cout << "** building SSHash took " << timer.elapsed() << " seconds / "
+                      << timer.elapsed() / 60 << " minutes" << std::endl;
+            timer.reset();
+        }
+
+        {
+            std::vector<std::string> filenames;
+            filenames.reserve(colors.size());
+            for (auto color : colors) filenames.emplace_back(other.filename(color));
+            idx.m_filenames.build(filenames);
+        }
+    }
+
+    /* check that every k-mer of other has the projection of its colors, if not empty */
+    template <typename Index>
+    bool check(index const& idx, Index const& other, std::vector<uint32_t> const& colors) const {
+        essentials::logger("checking correctness...");
+        std::vector<uint32_t> new_color(other.num_colors(), none);
+        for (uint64_t i = 0; i != colors.size(); ++i) new_color[colors[i]] = i;
+        std::vector<uint32_t> expected, got;
+        for (uint64_t unitig_id = 0; unitig_id != other.num_unitigs(); ++unitig_id) {
+            expected.clear();
+            auto it = other.color_set(other.u2c(unitig_id));
+            const uint64_t other_num_colors = it.num_colors();
+            for (uint64_t color = it.value(); color < other_num_colors;
+                 it.next(), color = it.value()) {
+                if (new_color[color] != none) expected.push_back(new_color[color]);
+            }
+            auto kmer_it = other.get_k2u().at_contig_id(unitig_id);
+            while (kmer_it.has_next()) {
+                auto [_, kmer] = kmer_it.next();
+                auto answer = idx.m_k2u.lookup_advanced(kmer.c_str());
+                const bool found = answer.kmer_id != sshash::constants::invalid_uint64;
+                if (found != !expected.empty()) {
+                    std::cout << "\033[1;31m"
+                              << "k-mer " << kmer << (found ? " found" : " not found")
+                              << "\033[0m" << std::endl;
+                    return false;
+                }
+                if (!found) continue;
+                got.clear();
+                auto jt = idx.color_set(idx.u2c(answer.contig_id));
+                const uint64_t size = jt.size();
+                for (uint64_t i = 0; i != size; ++i, ++jt) got.push_back(*jt);
+                if (got != expected) {
+                    std::cout << "\033[1;31m"
+                              << "wrong color set for k-mer " << kmer << "\033[0m" << std::endl;
+                    return false;
+                }
+            }
+        }
+        essentials::logger("CHECK DONE!");
+        return true;
+    }
+
+private:
+    build_configuration m_build_config;
+
+    static constexpr uint32_t none = uint32_t(-1);
+    static constexpr uint64_t none_link = uint64_t(-1);
+
+    /*
+        An oriented unitig is encoded as (unitig_id << 1) | reversed.
+        links[2 * u] is the oriented unitig that can be glued after the last k-mer of u,
+        links[2 * u + 1] the one that can be glued after the last k-mer of the reverse
+        complement of u (i.e., before u), or none_link.
+    */
+    static uint64_t successor(std::vector<uint64_t> const& links, const uint64_t l) {
+        return links[l];
+    }
+    static uint64_t predecessor(std::vector<uint64_t> const& links, const uint64_t l) {
+        const uint64_t p = links[l ^ 1];
+        return p == none_link ? none_link : p ^ 1;
+    }
+
+    template <typename Index>
+    std::vector<uint64_t> find_links(Index const& other,
+                                     std::vector<uint32_t> const& new_color_set_id) const {
+        auto const& dict = other.get_k2u();
+        auto color_set_id_of = [&](char const* kmer) {
+            auto answer = dict.lookup_advanced(kmer);
+            if (answer.kmer_id == sshash::constants::invalid_uint64) return none;
+            return new_color_set_id[other.u2c(answer.contig_id)];
+        };
+
+        /*
+            The unitig that follows the k-mer x, at the end of unitig u, can be glued to u
+            if it has the same color set, the (k-1)-suffix of x has a single successor y left
+            and y has a single predecessor left (x).
+        */
+        auto follow = [&](std::string const& x, const uint64_t unitig_id,
+                          const uint32_t color_set_id, std::string& kmer) {
+            const uint64_t k = x.size();
+            kmer.assign(x, 1, k - 1);
+            std::string rc = kmer;
+            reverse_complement(rc);
+            if (rc == kmer) return none_link;  // the two strands meet: do not glue
+            kmer.push_back('A');
+            uint64_t num_successors = 0;
+            char next = 0;
+            for (char c : {'A', 'C', 'G', 'T'}) {
+                kmer.back() = c;
+                if (color_set_id_of(kmer.c_str()) != none) {
+                    num_successors += 1;
+                    next = c;
+                }
+            }
+            if (num_successors != 1) return none_link;
+            kmer.back() = next;
+            auto answer = dict.lookup_advanced(kmer.c_str());
+            const uint64_t v = answer.contig_id;
+            if (v == unitig_id or new_color_set_id[other.u2c(v)] != color_set_id) {
+                return none_link;
+            }
+            const std::string y = kmer;
+            kmer.pop_back();
+            kmer.insert(kmer.begin(), 'A');
+            uint64_t num_predecessors = 0;
+            for (char c : {'A', 'C', 'G', 'T'}) {
+                kmer.front() = c;
+                if (color_set_id_of(kmer.c_str()) != none) num_predecessors += 1;
+            }
+            if (num_predecessors != 1) return none_link;
+            /* y is the first k-mer of v, or the reverse complement of its last one */
+            auto it = dict.at_contig_id(v);
+            auto [_, first] = it.next();
+            return (v << 1) | (first == y ? 0 : 1);
+        };
+
+        /*
+            The unitigs are scheduled in chunks of about the same work: spelling a kept unitig
+            takes time proportional to its k-mers, following its two ends a few lookups.
+        */
+        constexpr uint64_t follow_weight = 16;
+        const std::vector<uint32_t> sizes = unitig_sizes(dict);
+        const uint64_t num_unitigs = sizes.size();
+        auto weight = [&](uint64_t u) -> uint64_t {
+            return new_color_set_id[other.u2c(u)] == none ? 0 : sizes[u] + follow_weight;
+        };
+        uint64_t total_weight = 0;
+        for (uint64_t u = 0; u != num_unitigs; ++u) total_weight += weight(u);
+        task_scheduler scheduler(m_build_config.num_threads);
+        scheduler.add(0, num_unitigs, scheduler.chunk_weight(total_weight), weight,
+                      [](uint64_t) { return true; });
+
+        std::vector<uint64_t> links(2 * num_unitigs, none_link);
+        scheduler.run([&](uint64_t, uint64_t chunk_id) {
+            auto const& chunk = scheduler.chunks()[chunk_id];
+            std::string unitig, x, kmer;
+            for (uint64_t u = chunk.begin; u != chunk.end; ++u) {
+                const uint32_t color_set_id = new_color_set_id[other.u2c(u)];
+                if (color_set_id == none) continue;
+                spell(dict, u, unitig);
+                const uint64_t k = dict.k();
+                x.assign(unitig, unitig.size() - k, k);
+                links[2 * u] = follow(x, u, color_set_id, kmer);
+                x.assign(unitig, 0, k);
+                reverse_complement(x);
+                links[2 * u + 1] = follow(x, u, color_set_id, kmer);
+            }
+        });
+
+        uint64_t num_links = 0;
+        for (auto l : links) num_links += l != none_link;
+        std::cout << "found " << num_links / 2 << " pairs of unitigs to glue" << std::endl;
+        return links;
+    }
+
+    /* the string of the unitig with the given id */
+    static void spell(sshash_type const& dict, const uint64_t unitig_id, std::string& unitig) {
+        auto it = dict.at_contig_id(unitig_id);
+        auto [_, kmer] = it.next();
+        unitig.assign(kmer);
+        while (it.has_next()) {
+            auto [_, kmer] = it.next();
+            unitig.push_back(kmer.back());
+        }
+    }
+
+    static void reverse_complement(std::string& s) {
+        std::reverse(s.begin(), s.end());
+        for (auto& c : s) {
+            switch (c) {
+                case 'A':
+                    c = 'T';
+                    break;
+                case 'C':
+                    c = 'G';
+                    break;
+                case 'G':
+                    c = 'C';
+                    break;
+                case 'T':
+                    c = 'A';
+                    break;
+            }
+        }
+    }
+};
+
+}  // namespace fulgor
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <zlib.h>
+
+#include "include/util.hpp"
+
+namespace fulgor {
+
+/*
+    Manifest of the completed stages of an index construction.
+
+    The outputs of every stage are saved in the temporary directory and
+    recorded in the manifest, <tmp_dirname>/<basename>.checkpoint, with the
+    size and CRC-32 of each file. With build_configuration::resume, a stage
+    whose files are intact is loaded instead of being recomputed.
+
+    Stages are recorded in the order they complete: committing a stage again
+    discards the stages recorded after it, since they were computed from its
+    previous outputs.
+
+    Each stage also records a fingerprint of the type of the color sets being
+    built, of their input and of the options they depend on (e.g., k,
+    --clustering, --roaring): a stage whose fingerprint does not match is
+    discarded, together with the stages recorded after it.
+*/
+struct checkpoint {
+    checkpoint(build_configuration const& build_config, index_t type = index_t::HYBRID)
+        : m_resume(build_config.resume) {
+        std::string name = util::filename(build_config.file_base_name);
+        if (name.empty()) {
+            name = util::filename(build_config.index_filename_to_partition);
+            name = name.substr(0, name.find_last_of('.'));
+        }
+        m_basename = build_config.tmp_dirname + "/" + name;
+        /*
+            The index built by "build" from the references depends on their list, and on k
+            and m. The others are built from an existing index (also the one of "reorder",
+            which has no list of references): it is identified by its size and last write
+            time, since computing its CRC-32 would take as long as reading it.
+        */
+        std::stringstream fingerprint;
+        fingerprint << "type=" << type << ",tune_for=" << build_config.tune_for;
+        if (type == index_t::HYBRID and !build_config.filenames_list.empty()) {
+            fingerprint << ",k=" << build_config.k << ",m=" << build_config.m
+                        << ",filenames_list=" << crc32_of(build_config.filenames_list);
+        } else {
+            auto const& input_filename = build_config.index_filename_to_partition;
+            fingerprint << ",clustering=" << build_config.clustering
+                        << ",roaring=" << build_config.roaring_colored
+                        << ",split_clusters=" << build_config.split_clusters
+                        << ",rebuild_k2u=" << build_config.rebuild_k2u;
+            if (std::filesystem::exists(input_filename)) {
+                fingerprint << ",input_size=" << std::filesystem::file_size(input_filename)
+                            << ",input_time=" << std::filesystem::last_write_time(input_filename)
+                                                     .time_since_epoch()
+                                                     .count();
+            }
+        }
+        m_fingerprint = fingerprint.str();
+    }
+
+    /* the file where the outputs of a stage are saved */
+    std::string filename(std::string const& stage) const {
+        return m_basename + "." + stage + ".bin";
+    }
+
+    std::string manifest_filename() const { return m_basename + ".checkpoint"; }
+
+    /* true if resuming and the outputs of the stage are intact */
+    bool completed(std::string const& stage) const {
+        if (!m_resume) return false;
+        auto stages = read_manifest();
+        auto it = find(stages, stage);
+        if (it == stages.end()) return false;
+        if (it->fingerprint != m_fingerprint) {
+            std::cout << "checkpoint: stage '" << stage
+                      << "' was computed with other options or input (" << it->fingerprint
+                      << "), it will be recomputed" << std::endl;
+            discard(stages, it);
+            write_manifest(stages);
+            return false;
+        }
+        for (auto const& f : it->files) {
+            if (!std::filesystem::exists(f.filename) or
+                std::filesystem::file_size(f.filename) != f.size or
+                crc32_of(f.filename) != f.crc32) {
+                std::cout << "checkpoint: '" << f.filename << "' is missing or corrupted, "
+                          << "stage '" << stage << "' will be recomputed" << std::endl;
+                return false;
+            }
+        }
+        std::cout << "checkpoint: stage '" << stage << "' already completed" << std::endl;
+        return true;
+    }
+
+    /* record that the stage completed, producing the given files */
+    void commit(std::string const& stage, std::vector<std::string> const& filenames) const {
+        auto stages = read_manifest();
+        auto it = find(stages, stage);
+        if (it != stages.end()) it = stages.erase(it);  // its outputs were just overwritten
+        discard(stages, it);
+        stage_info s;
+        s.name = stage;
+        s.fingerprint = m_fingerprint;
+        for (auto const& filename : filenames) {
+            s.files.push_back(
+                {filename, uint64_t(std::filesystem::file_size(filename)), crc32_of(filename)});
+        }
+        stages.push_back(s);
+        write_manifest(stages);
+    }
+
+    /* save the data structures of a stage and commit it */
+    template <typename... T>
+    void save(std::string const& stage, T const&... data) const {
+        const std::string output_filename = filename(stage);
+        {
+            essentials::saver saver(output_filename.c_str());
+            (saver.visit(data), ...);
+        }
+        commit(stage, {output_filename});
+    }
+
+    /* load the data structures of a completed stage, in the order they were saved */
+    template <typename... T>
+    void load(std::string const& stage, T&... data) const {
+        const std::string input_filename = filename(stage);
+        essentials::loader loader(input_filename.c_str());
+        (loader.visit(data), ...);
+    }
+
+    /* remove the manifest and the files saved by save() */
+    void clear() const {
+        for (auto const& s : read_manifest()) std::remove(filename(s.name).c_str());
+        std::remove(manifest_filename().c_str());
+    }
+
+private:
+    struct file_info {
+        std::string filename;
+        uint64_t size;
+        uint32_t crc32;
+    };
+
+    struct stage_info {
+        std::string name;
+        std::string fingerprint;
+        std::vector<file_info> files;
+    };
+
+    bool m_resume;
+    std::string m_basename;
+    std::string m_fingerprint;
+
+    /* remove the stages from it onwards, and their saved files */
+    void discard(std::vector<stage_info>& stages, std::vector<stage_info>::iterator it) const {
+        for (auto jt = it; jt != stages.end(); ++jt) std::remove(filename(jt->name).c_str());
+        stages.erase(it, stages.end());
+    }
+
+    static std::vector<stage_info>::iterator find(std::vector<stage_info>& stages,
+                                                  std::string const& stage) {
+        return std::find_if(stages.begin(), stages.end(),
+                            [&](stage_info const& s) { return s.name == stage; });
+    }
+
+    static uint32_t crc32_of(std::string const& filename) {
+        std::ifstream in(filename, std::ios::binary);
+        if (!in.is_open()) throw std::runtime_error("cannot open file '" + filename + "'");
+        std::vector<char> buffer(1 << 20);
+        uLong crc = crc32(0L, Z_NULL, 0);
+        while (in) {
+            in.read(buffer.data(), buffer.size());
+            crc = crc32(crc, reinterpret_cast<Bytef const*>(buffer.data()), in.gcount());
+        }
+        return crc;
+    }
+
+    /*
+        One line per stage, "<stage> <fingerprint> <num_files>", followed by a
+        line per file, "<filename> <size> <crc32>".
+    */
+    std::vector<stage_info> read_manifest() const {
+        std::vector<stage_info> stages;
+        std::ifstream in(manifest_filename());
+        if (!in.is_open()) return stages;
+        stage_info s;
+        uint64_t num_files = 0;
+        while (in >> std::quoted(s.name) >> std::quoted(s.fingerprint) >> num_files) {
+            s.files.resize(num_files);
+            for (auto& f : s.files) in >> std::quoted(f.filename) >> f.size >> f.crc32;
+            if (!in) break;  // truncated manifest: ignore the last stage
+            stages.push_back(s);
+        }
+        return stages;
+    }
+
+    void write_manifest(std::vector<stage_info> const& stages) const {
+        /* write a new manifest and then replace the old one, so that it is never truncated */
+        const std::string tmp_filename = manifest_filename() + ".tmp";
+        {
+            std::ofstream out(tmp_filename);
+            if (!out.is_open()) throw std::runtime_error("cannot open file '" + tmp_filename + "'");
+            for (auto const& s : stages) {
+                out << std::quoted(s.name) << ' ' << std::quoted(s.fingerprint) << ' '
+                    << s.files.size() << '\n';
+                for (auto const& f : s.files) {
+                    out << std::quoted(f.filename) << ' ' << f.size << ' ' << f.crc32 << '\n';
+                }
+            }
+            out.flush();
+            if (!out) throw std::runtime_error("error in writing file '" + tmp_filename + "'");
+        }
+        if (std::rename(tmp_filename.c_str(), manifest_filename().c_str()) != 0) {
+            throw std::runtime_error("cannot write checkpoint manifest");
+        }
+    }
+};
+
+}  // namespace fulgor
@@ -167,6 +167,213 @@ struct differential {
         std::vector<uint32_t> m_curr_representative;
     };
 
+    /*
+        Choose the representative of a group of color sets by the bits that builder takes to
+        encode the group, instead of by majority vote. The candidates are the sets of the colors
+        that are in at least a fraction t of the color sets, for t = 1/8, 2/8, ..., 1, and the
+        empty set: the majority vote is t = 1/2, so the chosen representative is never worse.
+    */
+    struct representative_optimizer {
+        representative_optimizer(uint64_t num_colors) : m_distribution(num_colors, 0) {}
+
+        /* the number of bits written by bits::util::write_delta(x) */
+        static uint64_t delta_bits(const uint64_t x) {
+            const uint64_t b = msb(x + 1);
+            return b + 2 * msb(b + 1) + 1;
+        }
+
+        /*
+            Compute the best representative of the color sets get(0), ..., get(num_sets - 1)
+            and return the bits of the group (the representative and the differential color
+            sets). If diff_sizes is not null, it receives the sizes of the differential sets.
+        */
+        template <typename GetIterator>
+        uint64_t optimize(const uint64_t num_sets, GetIterator const& get,
+                          std::vector<uint32_t>& representative,
+                          std::vector<uint64_t>* diff_sizes = nullptr) {
+            std::vector<uint64_t> thresholds;
+            for (uint64_t i = 1; i <= 8; ++i) thresholds.push_back((i * num_sets + 7) / 8);
+            thresholds.push_back(num_sets + 1);  // empty representative
+            const uint64_t majority = (num_sets + 1) / 2;
+            std::sort(thresholds.begin(), thresholds.end());
+            thresholds.erase(std::unique(thresholds.begin(), thresholds.end()), thresholds.end());
+
+            evaluate(num_sets, get, thresholds);
+            uint64_t best = std::find(thresholds.begin(), thresholds.end(), majority) -
+                            thresholds.begin();
+            assert(best < thresholds.size());
+            for (uint64_t j = 0; j != thresholds.size(); ++j) {
+                if (m_bits[j] < m_bits[best]) best = j;
+            }
+
+            representative.clear();
+            for (auto color : m_candidates) {
+                if (m_distribution[color] >= thresholds[best]) representative.push_back(color);
+            }
+            if (diff_sizes) {
+                diff_sizes->assign(m_diff_sizes.begin() + best * num_sets,
+                                   m_diff_sizes.begin() + (best + 1) * num_sets);
+            }
+            reset(num_sets, get);
+            return m_bits[best];
+        }
+
+        /* the bits of the group when the representative is chosen by majority vote */
+        template <typename GetIterator>
+        uint64_t majority_bits(const uint64_t num_sets, GetIterator const& get) {
+            evaluate(num_sets, get, {(num_sets + 1) / 2});
+            reset(num_sets, get);
+            return m_bits.front();
+        }
+
+        /*
+            Split the group in two if two representatives take fewer bits than one: the color
+            set farthest from the representative attracts those that are closer to it. Return
+            true if the group is split and set side[i] to the half of the i-th color set.
+        */
+        template <typename GetIterator>
+        bool split(const uint64_t num_sets, GetIterator const& get, std::vector<uint8_t>& side) {
+            std::vector<uint32_t> representative;
+            std::vector<uint64_t> diff_sizes;
+            const uint64_t bits = optimize(num_sets, get, representative, &diff_sizes);
+            const uint64_t seed =
+                std::max_element(diff_sizes.begin(), diff_sizes.end()) - diff_sizes.begin();
+            if (diff_sizes[seed] == 0) return false;
+
+            std::vector<uint32_t> seed_set;
+            auto it = get(seed);
+            const uint64_t seed_size = it.size();
+            for (uint64_t i = 0; i != seed_size; ++i, ++it) seed_set.push_back(*it);
+
+            side.assign(num_sets, 0);
+            std::vector<uint64_t> halves[2];
+            for (uint64_t i = 0; i != num_sets; ++i) {
+                auto it = get(i);
+                const uint64_t size = it.size();
+                uint64_t distance = 0;
+                uint64_t pos = 0;
+                for (uint64_t j = 0; j != size; ++j, ++it) {
+                    const uint32_t color = *it;
+                    for (; pos != seed_set.size() and seed_set[pos] < color; ++pos) {
+                        ++distance;
+                    }
+                    if (pos != seed_set.size() and seed_set[pos] == color) {
+                        ++pos;
+                    } else {
+                        ++distance;
+                    }
+                }
+                distance += seed_set.size() - pos;
+                side[i] = distance < diff_sizes[i];
+                halves[side[i]].push_back(i);
+            }
+            if (halves[0].empty() or halves[1].empty()) return false;
+
+            uint64_t split_bits = 0;
+            for (auto const& half : halves) {
+                split_bits += optimize(
+                    half.size(), [&](uint64_t i) { return get(half[i]); }, representative);
+            }
+            return split_bits < bits;
+        }
+
+    private:
+        std::vector<uint32_t> m_distribution;
+        std::vector<uint32_t> m_candidates;  // the colors in some candidate representative
+        std::vector<uint64_t> m_bits;        // of the group, for every candidate
+        std::vector<uint64_t> m_diff_sizes;  // num_sets per candidate
+
+        static uint64_t msb(const uint64_t x) {
+            assert(x > 0);
+            return 63 - __builtin_clzll(x);
+        }
+
+        /* bits of the group for the representatives of the colors in >= thresholds[j] sets */
+        template <typename GetIterator>
+        void evaluate(const uint64_t num_sets, GetIterator const& get,
+                      std::vector<uint64_t> const& thresholds) {
+            const uint64_t num_candidates = thresholds.size();
+            const uint64_t min_threshold =
+                *std::min_element(thresholds.begin(), thresholds.end());
+
+            for (uint64_t i = 0; i != num_sets; ++i) {
+                auto it = get(i);
+                const uint64_t size = it.size();
+                for (uint64_t j = 0; j != size; ++j, ++it) m_distribution[*it] += 1;
+            }
+            m_candidates.clear();
+            for (uint64_t color = 0; color != m_distribution.size(); ++color) {
+                if (m_distribution[color] >= min_threshold) m_candidates.push_back(color);
+            }
+
+            /* the sorted lists are coded as: size, first value, then gaps minus 1 */
+            std::vector<uint64_t> list_bits(num_candidates), list_size(num_candidates);
+            std::vector<uint32_t> prev(num_candidates);
+            auto add = [&](const uint64_t j, const uint32_t color) {
+                list_bits[j] += delta_bits(list_size[j] == 0 ? color : color - prev[j] - 1);
+                list_size[j] += 1;
+                prev[j] = color;
+            };
+            auto clear = [&]() {
+                std::fill(list_bits.begin(), list_bits.end(), 0);
+                std::fill(list_size.begin(), list_size.end(), 0);
+            };
+
+            clear();
+            for (auto color : m_candidates) {
+                for (uint64_t j = 0; j != num_candidates; ++j) {
+                    if (m_distribution[color] >= thresholds[j]) add(j, color);
+                }
+            }
+            m_bits.resize(num_candidates);
+            for (uint64_t j = 0; j != num_candidates; ++j) {
+                m_bits[j] = list_bits[j] + delta_bits(list_size[j]);
+            }
+
+            /* the differential sets are the symmetric differences from the representatives */
+            m_diff_sizes.resize(num_candidates * num_sets);
+            for (uint64_t i = 0; i != num_sets; ++i) {
+                clear();
+                auto it = get(i);
+                const uint64_t size = it.size();
+                uint64_t j = 0;    // in it
+                uint64_t pos = 0;  // in m_candidates
+                while (j != size or pos != m_candidates.size()) {
+                    uint32_t color = 0;
+                    bool in_set = false;
+                    if (pos == m_candidates.size() or (j != size and *it < m_candidates[pos])) {
+                        color = *it;
+                        in_set = true;
+                    } else {
+                        color = m_candidates[pos];
+                        ++pos;
+                        in_set = j != size and *it == color;
+                    }
+                    if (in_set) {
+                        ++j;
+                        ++it;
+                    }
+                    for (uint64_t c = 0; c != num_candidates; ++c) {
+                        if (in_set != (m_distribution[color] >= thresholds[c])) add(c, color);
+                    }
+                }
+                for (uint64_t c = 0; c != num_candidates; ++c) {
+                    m_bits[c] += list_bits[c] + delta_bits(list_size[c]) + delta_bits(size);
+                    m_diff_sizes[c * num_sets + i] = list_size[c];
+                }
+            }
+        }
+
+        template <typename GetIterator>
+        void reset(const uint64_t num_sets, GetIterator const& get) {
+            for (uint64_t i = 0; i != num_sets; ++i) {
+                auto it = get(i);
+                const uint64_t size = it.size();
+                for (uint64_t j = 0; j != size; ++j, ++it) m_distribution[*it] = 0;
+            }
+        }
+    };
+
     struct forward_iterator {
         forward_iterator() {}
 
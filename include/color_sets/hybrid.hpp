@@ -5,6 +5,12 @@ namespace fulgor {
 struct hybrid {
     static const index_t type = index_t::HYBRID;
 
+    /* the thresholds used unless tuned, as fractions of the number of colors */
+    static constexpr double default_sparse_set_threshold = 0.25;
+    static constexpr double default_very_dense_set_threshold = 0.75;
+
+    struct thresholds_tuner;
+
     struct builder {
         builder() : m_num_color_sets(0) {}
         builder(uint64_t num_colors) { init(num_colors); }
@@ -17,8 +23,8 @@ struct hybrid {
                 if set contains > very_dense_set_threshold_size ints, code it as a complementary set
                 with gaps+delta; otherwise: code it as a bitmap of m_num_colors bits.
              */
-            m_sparse_set_threshold_size = 0.25 * m_num_colors;
-            m_very_dense_set_threshold_size = 0.75 * m_num_colors;
+            m_sparse_set_threshold_size = default_sparse_set_threshold * m_num_colors;
+            m_very_dense_set_threshold_size = default_very_dense_set_threshold * m_num_colors;
 
             // std::cout << "m_num_colors " << m_num_colors << std::endl;
             // std::cout << "m_sparse_set_threshold_size " << m_sparse_set_threshold_size <<
@@ -32,6 +38,19 @@ struct hybrid {
             m_num_total_integers = 0;
         }
 
+        /* replace the default thresholds (see thresholds_tuner) before encoding */
+        void set_thresholds(const uint32_t sparse_set_threshold_size,
+                            const uint32_t very_dense_set_threshold_size) {
+            assert(m_num_color_sets == 0);
+            assert(sparse_set_threshold_size <= very_dense_set_threshold_size);
+            m_sparse_set_threshold_size = sparse_set_threshold_size;
+            m_very_dense_set_threshold_size = very_dense_set_threshold_size;
+        }
+
+        uint32_t sparse_set_threshold_size() const { return m_sparse_set_threshold_size; }
+        uint32_t very_dense_set_threshold_size() const { return m_very_dense_set_threshold_size; }
+        uint64_t num_bits() const { return m_bvb.num_bits(); }
+
         void reserve_num_bits(uint64_t num_bits) { m_bvb.reserve(num_bits); }
 
         void encode_color_set(uint32_t const* color_set, const uint64_t size)  //
@@ -96,6 +115,8 @@ struct hybrid {
 
         void append(hybrid::builder& hb) {
             if (hb.m_num_color_sets == 0) return;
+            assert(hb.m_sparse_set_threshold_size == m_sparse_set_threshold_size);
+            assert(hb.m_very_dense_set_threshold_size == m_very_dense_set_threshold_size);
             m_bvb.append(hb.m_bvb);
             assert(m_offsets.size() > 0);
             uint64_t delta = m_offsets.back();
@@ -109,16 +130,9 @@ struct hybrid {
         }
 
         void build(hybrid& h) {
-            h.m_num_colors = m_num_colors;
-            h.m_sparse_set_threshold_size = m_sparse_set_threshold_size;
-            h.m_very_dense_set_threshold_size = m_very_dense_set_threshold_size;
-
             std::cout << "processed " << m_num_color_sets << " color sets" << std::endl;
             std::cout << "m_num_total_integers " << m_num_total_integers << std::endl;
-            assert(m_num_color_sets == m_offsets.size() - 1);
-
-            h.m_offsets.encode(m_offsets.begin(), m_offsets.size(), m_offsets.back());
-            m_bvb.build(h.m_color_sets);
+            build_color_sets(h);
 
             std::cout << "  total bits for ints = " << 8 * h.m_color_sets.num_bytes() << std::endl;
             std::cout << "  total bits per offsets = " << 8 * h.m_offsets.num_bytes() << std::endl;
@@ -132,12 +146,26 @@ struct hybrid {
         }
 
         void clear() {
+            const uint32_t sparse_set_threshold_size = m_sparse_set_threshold_size;
+            const uint32_t very_dense_set_threshold_size = m_very_dense_set_threshold_size;
             m_offsets.clear();
             m_bvb.clear();
             init(m_num_colors);
+            set_thresholds(sparse_set_threshold_size, very_dense_set_threshold_size);
         }
 
     private:
+        friend struct thresholds_tuner;
+
+        void build_color_sets(hybrid& h) {
+            h.m_num_colors = m_num_colors;
+            h.m_sparse_set_threshold_size = m_sparse_set_threshold_size;
+            h.m_very_dense_set_threshold_size = m_very_dense_set_threshold_size;
+            assert(m_num_color_sets == m_offsets.size() - 1);
+            h.m_offsets.encode(m_offsets.begin(), m_offsets.size(), m_offsets.back());
+            m_bvb.build(h.m_color_sets);
+        }
+
         uint32_t m_num_colors;
         uint32_t m_sparse_set_threshold_size;
         uint32_t m_very_dense_set_threshold_size;
@@ -148,6 +176,158 @@ struct hybrid {
         std::vector<uint64_t> m_offsets;
     };
 
+    /*
+        Choose the thresholds of a builder for a sample of its color sets. The candidates are
+        the multiples of num_colors / num_buckets: the sampled color sets are bucketed by size
+        and each bucket is encoded in the three ways, to measure its bits and the time taken to
+        decode it (a full scan, then a pass of next_geq as done by intersections). The chosen
+        thresholds minimize the bits (SIZE) or the time and then the bits (SPEED).
+    */
+    struct thresholds_tuner {
+        static constexpr uint64_t num_buckets = 20;
+        static constexpr uint64_t max_sample_size = uint64_t(1) << 16;  // color sets
+        static constexpr uint64_t max_sample_bits = uint64_t(1) << 30;  // in each encoding
+
+        struct thresholds {
+            uint32_t sparse_set_threshold_size;
+            uint32_t very_dense_set_threshold_size;
+            uint64_t num_bits, default_num_bits;  // of the sample
+            double nanosec, default_nanosec;      // to decode the sample
+        };
+
+        thresholds_tuner(const uint64_t num_colors)
+            : m_num_colors(num_colors)
+            , m_max_num_sets(std::clamp<uint64_t>(max_sample_bits / (num_colors + 64), 1,
+                                                  max_sample_size))
+            , m_num_sets(0) {}
+
+        bool full() const { return m_num_sets == m_max_num_sets; }
+        uint64_t max_num_sets() const { return m_max_num_sets; }
+        uint64_t num_sets() const { return m_num_sets; }
+
+        void add(uint32_t const* color_set, const uint64_t size) {
+            if (size == 0 or full()) return;
+            assert(size <= m_num_colors);
+            m_sample.push_back(size);
+            m_sample.insert(m_sample.end(), color_set, color_set + size);
+            m_num_sets += 1;
+        }
+
+        thresholds tune(const tuning_t tune_for) const {
+            assert(tune_for != tuning_t::NO_TUNING);
+            constexpr uint64_t num_encodings = 3;  // in the order of encoding_t
+            constexpr uint64_t num_runs = 3;
+
+            std::vector<std::vector<uint64_t>> buckets(num_buckets + 1);  // positions in m_sample
+            for (uint64_t pos = 0; pos != m_sample.size(); pos += m_sample[pos] + 1) {
+                buckets[m_sample[pos] * num_buckets / m_num_colors].push_back(pos);
+            }
+
+            uint64_t bits[num_buckets + 1][num_encodings] = {};
+            double nanosec[num_buckets + 1][num_encodings] = {};
+            const uint64_t step = std::max<uint64_t>(m_num_colors / 16, 1);
+            uint64_t sink = 0;
+            for (uint64_t e = 0; e != num_encodings; ++e) {
+                builder b(m_num_colors);
+                b.set_thresholds(e == encoding_t::delta_gaps ? m_num_colors + 1 : 0,
+                                 e == encoding_t::complement_delta_gaps ? 0 : m_num_colors + 1);
+                for (uint64_t bucket = 0; bucket != num_buckets + 1; ++bucket) {
+                    for (uint64_t pos : buckets[bucket]) {
+                        const uint64_t num_bits = b.num_bits();
+                        b.encode_color_set(m_sample.data() + pos + 1, m_sample[pos]);
+                        bits[bucket][e] += b.num_bits() - num_bits;
+                    }
+                }
+                hybrid h;
+                b.build_color_sets(h);
+
+                uint64_t color_set_id = 0;
+                for (uint64_t bucket = 0; bucket != num_buckets + 1; ++bucket) {
+                    const uint64_t first_id = color_set_id;
+                    const uint64_t last_id = first_id + buckets[bucket].size();
+                    essentials::timer<std::chrono::high_resolution_clock, std::chrono::nanoseconds>
+                        timer;
+                    for (uint64_t run = 0; run != num_runs; ++run) {
+                        timer.start();
+                        for (uint64_t id = first_id; id != last_id; ++id) {
+                            auto it = h.color_set(id);
+                            const uint64_t size = it.size();
+                            for (uint64_t i = 0; i != size; ++i, ++it) sink += *it;
+                            it = h.color_set(id);
+                            for (uint64_t lb = step; lb < m_num_colors; lb += step) {
+                                it.next_geq(lb);
+                                sink += *it;
+                            }
+                        }
+                        timer.stop();
+                    }
+                    nanosec[bucket][e] = timer.elapsed() / num_runs;
+                    color_set_id = last_id;
+                }
+            }
+            volatile uint64_t result = sink;  // so that decoding is not optimized away
+            (void)result;
+
+            /* a bucket is below the threshold k if its sets are smaller than threshold_size(k) */
+            auto threshold_size = [&](uint64_t k) -> uint32_t {
+                if (k > num_buckets) return m_num_colors + 1;
+                return (k * m_num_colors + num_buckets - 1) / num_buckets;
+            };
+            auto cost = [&](uint64_t sparse_k, uint64_t very_dense_k) {
+                std::pair<uint64_t, double> c{0, 0.0};
+                for (uint64_t bucket = 0; bucket != num_buckets + 1; ++bucket) {
+                    const uint64_t e = bucket < sparse_k       ? encoding_t::delta_gaps
+                                       : bucket < very_dense_k ? encoding_t::bitmap
+                                                               : encoding_t::complement_delta_gaps;
+                    c.first += bits[bucket][e];
+                    c.second += nanosec[bucket][e];
+                }
+                return c;
+            };
+            auto better = [&](std::pair<uint64_t, double> const& a,
+                              std::pair<uint64_t, double> const& b) {
+                if (tune_for == tuning_t::SIZE) {
+                    return a.first < b.first or (a.first == b.first and a.second < b.second);
+                }
+                return a.second < b.second or (a.second == b.second and a.first < b.first);
+            };
+
+            const uint64_t default_sparse_k =
+                std::lround(default_sparse_set_threshold * num_buckets);
+            const uint64_t default_very_dense_k =
+                std::lround(default_very_dense_set_threshold * num_buckets);
+            auto default_cost = cost(default_sparse_k, default_very_dense_k);
+            uint64_t best_sparse_k = default_sparse_k;
+            uint64_t best_very_dense_k = default_very_dense_k;
+            auto best_cost = default_cost;
+            for (uint64_t sparse_k = 0; sparse_k <= num_buckets + 1; ++sparse_k) {
+                for (uint64_t very_dense_k = sparse_k; very_dense_k <= num_buckets + 1;
+                     ++very_dense_k) {
+                    auto c = cost(sparse_k, very_dense_k);
+                    if (better(c, best_cost)) {
+                        best_cost = c;
+                        best_sparse_k = sparse_k;
+                        best_very_dense_k = very_dense_k;
+                    }
+                }
+            }
+
+            thresholds t;
+            t.sparse_set_threshold_size = threshold_size(best_sparse_k);
+            t.very_dense_set_threshold_size = threshold_size(best_very_dense_k);
+            t.num_bits = best_cost.first;
+            t.default_num_bits = default_cost.first;
+            t.nanosec = best_cost.second;
+            t.default_nanosec = default_cost.second;
+            return t;
+        }
+
+    private:
+        uint64_t m_num_colors;
+        uint64_t m_max_num_sets, m_num_sets;
+        std::vector<uint32_t> m_sample;  // [size, colors]*
+    };
+
     struct forward_iterator {
         forward_iterator() {}
 
@@ -314,6 +494,8 @@ struct hybrid {
 
     uint32_t num_colors() const { return m_num_colors; }
     uint64_t num_color_sets() const { return m_offsets.size() - 1; }
+    uint32_t sparse_set_threshold_size() const { return m_sparse_set_threshold_size; }
+    uint32_t very_dense_set_threshold_size() const { return m_very_dense_set_threshold_size; }
 
     uint64_t num_bits() const {
         return (sizeof(m_num_colors) + sizeof(m_sparse_set_threshold_size) +
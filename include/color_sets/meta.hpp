@@ -17,6 +17,8 @@ struct meta {
     };
 
     struct builder {
+        typedef typename ColorSets::builder partial_color_sets_builder;
+
         builder() : m_offset(0) { m_meta_color_sets_offsets.push_back(0); }
 
         void init_meta_color_sets_builder(
@@ -45,6 +47,14 @@ struct meta {
             m_color_sets_builders[partition_id].init(num_colors_in_partition);
         }
 
+        /* replace the default thresholds of the partial color sets of the partition */
+        void set_thresholds(uint64_t partition_id, uint32_t sparse_set_threshold_size,
+                            uint32_t very_dense_set_threshold_size) {
+            assert(partition_id < m_color_sets_builders.size());
+            m_color_sets_builders[partition_id].set_thresholds(sparse_set_threshold_size,
+                                                               very_dense_set_threshold_size);
+        }
+
         void reserve_num_bits(uint64_t partition_id, uint64_t num_bits) {
             assert(partition_id < m_color_sets_builders.size());
             m_color_sets_builders[partition_id].reserve_num_bits(num_bits);
@@ -56,6 +66,12 @@ struct meta {
             m_color_sets_builders[partition_id].encode_color_set(color_set, size);
         }
 
+        /* append the partial color sets encoded by b after those of the partition */
+        void append_color_sets(uint64_t partition_id, partial_color_sets_builder& b) {
+            assert(partition_id < m_color_sets_builders.size());
+            m_color_sets_builders[partition_id].append(b);
+        }
+
         void encode_metacolor_set(uint32_t const* metacolor_set, const uint64_t size) {
             assert(size < (1ULL << m_meta_color_sets_builder.width()));
             m_meta_color_sets_builder.push_back(size);
@@ -0,0 +1,446 @@
+#pragma once
+
+namespace fulgor {
+
+/*
+    Color sets split into blocks of 2^16 colors, as Roaring bitmaps do: every non-empty block is
+    coded by the smallest of three containers, i.e., the sorted colors of the block (ARRAY),
+    a bitmap of the block (BITMAP) or the runs of consecutive colors of the block (RUN).
+    The colors of a block are coded with the bits needed for the block length, so that arrays
+    can be searched by position.
+
+    When the references are permuted so that similar genomes are adjacent (see permute), most
+    color sets are a few long runs: they take a few bits and are intersected run by run,
+    without decoding their colors one by one (see roaring_intersect and merge_roaring).
+*/
+struct roaring {
+    static const index_t type = index_t::ROARING;
+
+    static constexpr uint64_t block_bits = 16;
+    static constexpr uint64_t block_size = uint64_t(1) << block_bits;
+
+    enum container_t { ARRAY = 0, BITMAP = 1, RUN = 2 };
+
+    struct interval {
+        uint32_t begin, end;  // [..)
+    };
+
+    /* the number of colors in the block with the given key */
+    static uint64_t block_length(const uint64_t key, const uint64_t num_colors) {
+        assert((key << block_bits) < num_colors);
+        return std::min(block_size, num_colors - (key << block_bits));
+    }
+
+    /* the number of bits to code a color of a block of the given length */
+    static uint64_t color_width(const uint64_t length) {
+        return length <= 1 ? 1 : bits::util::msbll(length - 1) + 1;
+    }
+
+    struct builder {
+        builder() : m_num_colors(0), m_num_color_sets(0), m_num_total_integers(0) {}
+        builder(uint64_t num_colors) { init(num_colors); }
+
+        void init(uint64_t num_colors) {
+            m_num_colors = num_colors;
+            m_offsets.push_back(0);
+            m_num_color_sets = 0;
+            m_num_total_integers = 0;
+        }
+
+        void reserve_num_bits(uint64_t num_bits) { m_bvb.reserve(num_bits); }
+        uint64_t num_bits() const { return m_bvb.num_bits(); }
+
+        /*
+            The size of the color set and its number of containers, then every container:
+            its key (as a gap from the previous one), its type and its payload.
+        */
+        void encode_color_set(uint32_t const* color_set, const uint64_t size)  //
+        {
+            bits::util::write_delta(m_bvb, size);
+            uint64_t num_containers = 0;
+            for (uint64_t i = 0; i != size; ++i) {
+                if (i == 0 or (color_set[i] >> block_bits) != (color_set[i - 1] >> block_bits)) {
+                    ++num_containers;
+                }
+            }
+            bits::util::write_delta(m_bvb, num_containers);
+
+            uint64_t next_key = 0;
+            for (uint64_t begin = 0; begin != size;) {
+                const uint64_t key = color_set[begin] >> block_bits;
+                uint64_t end = begin + 1;
+                uint64_t num_runs = 1;
+                while (end != size and (color_set[end] >> block_bits) == key) {
+                    assert(color_set[end] > color_set[end - 1]);
+                    num_runs += color_set[end] != color_set[end - 1] + 1;
+                    ++end;
+                }
+                assert(key >= next_key);
+                bits::util::write_delta(m_bvb, key - next_key);
+                encode_container(key, color_set + begin, end - begin, num_runs);
+                next_key = key + 1;
+                begin = end;
+            }
+
+            m_offsets.push_back(m_bvb.num_bits());
+            m_num_total_integers += size;
+            m_num_color_sets += 1;
+            if (m_num_color_sets % 500000 == 0) {
+                std::cout << "  processed " << m_num_color_sets << " color sets" << std::endl;
+            }
+        }
+
+        void append(roaring::builder& rb) {
+            if (rb.m_num_color_sets == 0) return;
+            m_bvb.append(rb.m_bvb);
+            assert(m_offsets.size() > 0);
+            uint64_t delta = m_offsets.back();
+            m_offsets.reserve(m_offsets.size() + rb.m_offsets.size());
+            for (uint64_t i = 1; i != rb.m_offsets.size(); ++i) {
+                m_offsets.push_back(rb.m_offsets[i] + delta);
+            }
+            m_num_color_sets += rb.m_num_color_sets;
+            m_num_total_integers += rb.m_num_total_integers;
+            assert(m_num_color_sets == m_offsets.size() - 1);
+        }
+
+        void build(roaring& r) {
+            r.m_num_colors = m_num_colors;
+
+            std::cout << "processed " << m_num_color_sets << " color sets" << std::endl;
+            std::cout << "m_num_total_integers " << m_num_total_integers << std::endl;
+            assert(m_num_color_sets == m_offsets.size() - 1);
+
+            r.m_offsets.encode(m_offsets.begin(), m_offsets.size(), m_offsets.back());
+            m_bvb.build(r.m_color_sets);
+
+            std::cout << "  total bits for ints = " << 8 * r.m_color_sets.num_bytes() << std::endl;
+            std::cout << "  total bits per offsets = " << 8 * r.m_offsets.num_bytes() << std::endl;
+            std::cout << "  color sets: "
+                      << (8.0 * r.m_color_sets.num_bytes()) / m_num_total_integers << " bits/int"
+                      << std::endl;
+        }
+
+        void clear() {
+            m_offsets.clear();
+            m_bvb.clear();
+            init(m_num_colors);
+        }
+
+    private:
+        uint32_t m_num_colors;
+        uint64_t m_num_color_sets;
+        uint64_t m_num_total_integers;
+
+        bits::bit_vector::builder m_bvb;
+        std::vector<uint64_t> m_offsets;
+
+        void encode_container(const uint64_t key, uint32_t const* colors, const uint64_t size,
+                              const uint64_t num_runs) {
+            const uint64_t base = key << block_bits;
+            const uint64_t length = block_length(key, m_num_colors);
+            const uint64_t width = color_width(length);
+            const uint64_t array_bits = size * width;
+            const uint64_t run_bits = 2 * num_runs * width;
+
+            if (run_bits <= std::min(array_bits, length)) {
+                m_bvb.append_bits(container_t::RUN, 2);
+                bits::util::write_delta(m_bvb, num_runs - 1);
+                for (uint64_t i = 0; i != size;) {
+                    uint64_t j = i + 1;
+                    while (j != size and colors[j] == colors[j - 1] + 1) ++j;
+                    m_bvb.append_bits(colors[i] - base, width);
+                    m_bvb.append_bits(j - i - 1, width);
+                    i = j;
+                }
+            } else if (array_bits <= length) {
+                m_bvb.append_bits(container_t::ARRAY, 2);
+                bits::util::write_delta(m_bvb, size - 1);
+                for (uint64_t i = 0; i != size; ++i) m_bvb.append_bits(colors[i] - base, width);
+            } else {
+                /* the last color, instead of the size, tells where the bitmap ends */
+                m_bvb.append_bits(container_t::BITMAP, 2);
+                bits::util::write_delta(m_bvb, colors[size - 1] - base);
+                bits::bit_vector::builder bvb;
+                bvb.resize(length);
+                for (uint64_t i = 0; i != size; ++i) bvb.set(colors[i] - base);
+                m_bvb.append(bvb);
+            }
+        }
+    };
+
+    struct forward_iterator {
+        forward_iterator() {}
+
+        forward_iterator(roaring const* ptr, uint64_t begin)
+            : m_ptr(ptr), m_begin(begin), m_num_colors(ptr->m_num_colors) {
+            rewind();
+        }
+
+        void rewind() {
+            m_it = (m_ptr->m_color_sets).get_iterator_at(m_begin);
+            m_size = bits::util::read_delta(m_it);
+            m_num_containers = bits::util::read_delta(m_it);
+            m_container_id = 0;
+            read_container(0);
+        }
+
+        uint64_t value() const { return m_curr_val; }
+        uint64_t operator*() const { return value(); }
+
+        void next() {
+            if (m_container_id == m_num_containers) return;  // saturated
+            if (m_type == container_t::ARRAY) {
+                if (++m_pos == m_size_in_container) return next_container();
+                m_curr_val = m_base + m_it.take(m_width);
+            } else if (m_type == container_t::BITMAP) {
+                if (m_curr_val == m_last_val) return next_container();
+                m_curr_val = m_base + (m_it.next() - m_payload);
+            } else {
+                assert(m_type == container_t::RUN);
+                if (++m_curr_val != m_run_end) return;
+                if (++m_pos == m_size_in_container) return next_container();
+                read_run();
+            }
+        }
+        void operator++() { next(); }
+
+        /* update the state of the iterator to the element
+           which is greater-than or equal-to lower_bound */
+        void next_geq(const uint64_t lower_bound) {
+            assert(lower_bound <= num_colors());
+            if (value() >= lower_bound) return;
+            next_geq_container(lower_bound >> block_bits);
+            if (value() >= lower_bound) return;
+
+            /* lower_bound is in the block of the current container */
+            assert(m_key == (lower_bound >> block_bits));
+            const uint64_t local = lower_bound - m_base;
+            if (m_type == container_t::ARRAY) {
+                uint64_t lo = m_pos + 1, hi = m_size_in_container;
+                while (lo < hi) {
+                    const uint64_t mid = (lo + hi) / 2;
+                    if (color_at(mid) < local) {
+                        lo = mid + 1;
+                    } else {
+                        hi = mid;
+                    }
+                }
+                if (lo == m_size_in_container) return next_container();
+                m_pos = lo;
+                m_it.skip_to(m_payload + m_pos * m_width);
+                m_curr_val = m_base + m_it.take(m_width);
+            } else if (m_type == container_t::BITMAP) {
+                if (lower_bound > m_last_val) return next_container();
+                m_it.skip_to(m_payload + local);
+                m_curr_val = m_base + (m_it.next() - m_payload);
+            } else {
+                assert(m_type == container_t::RUN);
+                while (m_run_end <= lower_bound) {
+                    if (++m_pos == m_size_in_container) return next_container();
+                    read_run();
+                }
+                m_curr_val = std::max<uint64_t>(m_curr_val, lower_bound);
+            }
+            assert(value() >= lower_bound);
+        }
+
+        uint32_t size() const { return m_size; }
+        uint32_t num_colors() const { return m_num_colors; }
+
+        /*
+            Access by container: the key of the current container (num_keys() after the last
+            one) and the intervals of colors of the whole container, regardless of the
+            position of the iterator within it.
+        */
+        uint32_t num_keys() const { return (m_num_colors + block_size - 1) >> block_bits; }
+        uint32_t container_key() const { return m_key; }
+        int container_type() const { return m_type; }
+        uint64_t container_num_bits() const { return m_container_end - m_payload; }
+
+        void next_container() {
+            if (m_container_id == m_num_containers) return;  // saturated
+            m_it.skip_to(m_container_end);
+            m_container_id += 1;
+            read_container(m_key + 1);
+        }
+
+        void next_geq_container(const uint32_t key) {
+            while (m_key < key) next_container();
+        }
+
+        /* append the intervals of the current container to out */
+        void container_intervals(std::vector<interval>& out) const {
+            assert(m_container_id < m_num_containers);
+            auto it = (m_ptr->m_color_sets).get_iterator_at(m_payload);
+            if (m_type == container_t::ARRAY) {
+                for (uint64_t i = 0; i != m_size_in_container; ++i) {
+                    push(out, m_base + it.take(m_width));
+                }
+            } else if (m_type == container_t::BITMAP) {
+                uint64_t val = 0;
+                do {
+                    val = m_base + (it.next() - m_payload);
+                    push(out, val);
+                } while (val != m_last_val);
+            } else {
+                assert(m_type == container_t::RUN);
+                for (uint64_t i = 0; i != m_size_in_container; ++i) {
+                    const uint32_t begin = m_base + it.take(m_width);
+                    const uint32_t length = it.take(m_width) + 1;
+                    out.push_back({begin, begin + length});
+                }
+            }
+        }
+
+        /* append to out the intersection of the current container with the intervals in */
+        void intersect_container(std::vector<interval> const& in,
+                                 std::vector<interval>& out) const {
+            assert(m_container_id < m_num_containers);
+            auto it = (m_ptr->m_color_sets).get_iterator_at(m_payload);
+            uint64_t j = 0;
+            if (m_type == container_t::ARRAY) {
+                for (uint64_t i = 0; i != m_size_in_container and j != in.size(); ++i) {
+                    const uint32_t val = m_base + it.take(m_width);
+                    while (j != in.size() and in[j].end <= val) ++j;
+                    if (j != in.size() and in[j].begin <= val) push(out, val);
+                }
+            } else if (m_type == container_t::BITMAP) {
+                for (auto const& x : in) {
+                    const uint64_t begin = std::max<uint64_t>(x.begin, m_base);
+                    const uint64_t end = std::min<uint64_t>(x.end, m_last_val + 1);
+                    if (begin >= end) continue;
+                    it.skip_to(m_payload + (begin - m_base));
+                    while (true) {  // there is a color in [begin, m_last_val]
+                        const uint64_t val = m_base + (it.next() - m_payload);
+                        if (val >= end) break;
+                        push(out, val);
+                        if (val == m_last_val) break;
+                    }
+                }
+            } else {
+                assert(m_type == container_t::RUN);
+                for (uint64_t i = 0; i != m_size_in_container and j != in.size(); ++i) {
+                    const uint32_t begin = m_base + it.take(m_width);
+                    const uint32_t end = begin + it.take(m_width) + 1;
+                    while (j != in.size() and in[j].end <= begin) ++j;
+                    for (; j != in.size() and in[j].begin < end; ++j) {
+                        out.push_back({std::max(begin, in[j].begin), std::min(end, in[j].end)});
+                        if (in[j].end > end) break;  // also overlaps the next run
+                    }
+                }
+            }
+        }
+
+    private:
+        roaring const* m_ptr;
+        uint64_t m_begin;
+        uint32_t m_num_colors;
+        uint32_t m_size;
+
+        bits::bit_vector::iterator m_it;
+        uint32_t m_num_containers, m_container_id;
+
+        /* the current container */
+        uint32_t m_key, m_base;
+        int m_type;
+        uint64_t m_width;
+        uint64_t m_payload, m_container_end;  // bit positions
+        uint32_t m_size_in_container;         // number of colors (ARRAY) or runs (RUN)
+        uint32_t m_pos;                       // of the current color (ARRAY) or run (RUN)
+        uint32_t m_last_val;                  // BITMAP only
+        uint32_t m_run_end;                   // RUN only
+
+        uint32_t m_curr_val;
+
+        static void push(std::vector<interval>& out, const uint32_t val) {
+            if (!out.empty() and out.back().end == val) {
+                out.back().end += 1;
+            } else {
+                out.push_back({val, val + 1});
+            }
+        }
+
+        uint64_t color_at(const uint64_t i) const {
+            return (m_ptr->m_color_sets).get_iterator_at(m_payload + i * m_width).take(m_width);
+        }
+
+        void read_container(const uint32_t next_key) {
+            if (m_container_id == m_num_containers) {  // saturate
+                m_key = num_keys();
+                m_curr_val = m_num_colors;
+                return;
+            }
+            m_key = next_key + bits::util::read_delta(m_it);
+            m_base = m_key << block_bits;
+            const uint64_t length = block_length(m_key, m_num_colors);
+            m_width = color_width(length);
+            m_type = m_it.take(2);
+            m_pos = 0;
+            if (m_type == container_t::ARRAY) {
+                m_size_in_container = bits::util::read_delta(m_it) + 1;
+                m_payload = m_it.position();
+                m_container_end = m_payload + m_size_in_container * m_width;
+                m_curr_val = m_base + m_it.take(m_width);
+            } else if (m_type == container_t::BITMAP) {
+                m_last_val = m_base + bits::util::read_delta(m_it);
+                m_payload = m_it.position();
+                m_container_end = m_payload + length;
+                m_it.skip_to(m_payload);  // next() does not follow the bits read by take()
+                m_curr_val = m_base + (m_it.next() - m_payload);
+            } else {
+                assert(m_type == container_t::RUN);
+                m_size_in_container = bits::util::read_delta(m_it) + 1;
+                m_payload = m_it.position();
+                m_container_end = m_payload + 2 * m_size_in_container * m_width;
+                read_run();
+            }
+        }
+
+        void read_run() {
+            m_curr_val = m_base + m_it.take(m_width);
+            m_run_end = m_curr_val + m_it.take(m_width) + 1;
+        }
+    };
+
+    typedef forward_iterator iterator_type;
+
+    forward_iterator color_set(uint64_t color_set_id) const {
+        assert(color_set_id < num_color_sets());
+        uint64_t begin = m_offsets.access(color_set_id);
+        return forward_iterator(this, begin);
+    }
+
+    uint32_t num_colors() const { return m_num_colors; }
+    uint64_t num_color_sets() const { return m_offsets.size() - 1; }
+
+    uint64_t num_bits() const {
+        return (sizeof(m_num_colors) + m_offsets.num_bytes() + m_color_sets.num_bytes()) * 8;
+    }
+
+    void print_stats() const;
+
+    template <typename Visitor>
+    void visit(Visitor& visitor) {
+        visit_impl(visitor, *this);
+    }
+
+    template <typename Visitor>
+    void visit(Visitor& visitor) const {
+        visit_impl(visitor, *this);
+    }
+
+private:
+    template <typename Visitor, typename T>
+    static void visit_impl(Visitor& visitor, T&& t) {
+        visitor.visit(t.m_num_colors);
+        visitor.visit(t.m_offsets);
+        visitor.visit(t.m_color_sets);
+    }
+
+    uint32_t m_num_colors;
+    bits::elias_fano<false, false> m_offsets;
+    bits::bit_vector m_color_sets;
+};
+
+}  // namespace fulgor
@@ -21,6 +21,9 @@ struct index {
     struct meta_builder;
     struct differential_builder;
     struct meta_differential_builder;
+    struct merge_builder;
+    struct subset_builder;
+    struct reorder_builder;
 
     index()
         : m_vnum(constants::current_version_number::major,  //
@@ -34,7 +37,10 @@ struct index {
     }
 
     /* from unitig_id to color_set_id */
-    uint64_t u2c(uint64_t unitig_id) const { return m_u2c_rank1_index.rank1(m_u2c, unitig_id); }
+    uint64_t u2c(uint64_t unitig_id) const {
+        uint64_t i = m_u2c_rank1_index.rank1(m_u2c, unitig_id);
+        return m_u2c_map.size() == 0 ? i : m_u2c_map[i];
+    }
 
     void fetch_color_set_ids(std::string const& sequence,
                              std::vector<uint32_t>& color_set_ids) const;
@@ -52,6 +58,24 @@ struct index {
                       bits::bit_vector::builder& positive_kmers_in_sequence,  //
                       std::vector<count_type>& counts) const;                 //
 
+    /*
+        Colors removed with the tool "remove" are still encoded in the color sets
+        until the index is compacted: queries skip them.
+    */
+    void set_removed_colors(std::vector<uint32_t> const& removed_colors) {
+        m_removed_colors.clear();
+        if (removed_colors.empty()) return;
+        m_removed_colors.resize(num_colors(), false);
+        for (auto color : removed_colors) {
+            if (color >= num_colors()) throw std::runtime_error("removed color out of bounds");
+            m_removed_colors[color] = true;
+        }
+    }
+    bool has_removed_colors() const { return !m_removed_colors.empty(); }
+    bool is_removed(uint64_t color) const {
+        return !m_removed_colors.empty() and m_removed_colors[color];
+    }
+
     std::string_view filename(uint64_t color) const {
         assert(color < num_colors());
         return m_filenames[color];
@@ -70,6 +94,7 @@ struct index {
     sshash_type const& get_k2u() const { return m_k2u; }
     bits::bit_vector const& get_u2c() const { return m_u2c; }
     bits::rank9 const& get_u2c_rank1_index() const { return m_u2c_rank1_index; }
+    bits::compact_vector const& get_u2c_map() const { return m_u2c_map; }
     ColorSets const& get_color_sets() const { return m_color_sets; }
     filenames const& get_filenames() const { return m_filenames; }
 
@@ -85,11 +110,56 @@ struct index {
 
     uint64_t num_bits() const {
         return m_k2u.num_bits() +
-               (sizeof(m_vnum) + m_u2c.num_bytes() + m_u2c_rank1_index.num_bytes()) * 8 +
+               (sizeof(m_vnum) + m_u2c.num_bytes() + m_u2c_rank1_index.num_bytes() +
+                m_u2c_map.num_bytes()) *
+                   8 +
                m_color_sets.num_bits() + m_filenames.num_bits();
     }
 
 private:
+    /* true if all the colors of the color set were removed */
+    bool only_removed_colors(uint64_t color_set_id) const {
+        auto it = m_color_sets.color_set(color_set_id);
+        const uint64_t num_colors = it.num_colors();
+        for (uint64_t color = it.value(); color < num_colors; it.next(), color = it.value()) {
+            if (!m_removed_colors[color]) return false;
+        }
+        return true;
+    }
+
+    /* erase the removed colors from a query result */
+    void erase_removed_colors(std::vector<uint32_t>& colors) const {
+        colors.erase(std::remove_if(colors.begin(), colors.end(),
+                                    [&](uint32_t color) { return m_removed_colors[color]; }),
+                     colors.end());
+    }
+
+    /*
+        Reuse the dictionary and the unitig runs of another index with the same color sets,
+        in a different order: the color set with id c in other has id new_color_set_id[c] here.
+    */
+    template <typename Index>
+    void permute_color_set_ids(Index const& other, std::vector<uint32_t> const& new_color_set_id) {
+        m_k2u = other.get_k2u();
+        m_u2c = other.get_u2c();
+        m_u2c_rank1_index = other.get_u2c_rank1_index();
+        auto const& other_map = other.get_u2c_map();
+        const uint64_t num_runs = m_u2c_rank1_index.num_ones();
+        assert(new_color_set_id.size() == other.num_color_sets());
+        /* wide enough for the new ids, which can be more than the runs */
+        const uint64_t max_color_set_id =
+            new_color_set_id.empty()
+                ? 0
+                : *std::max_element(new_color_set_id.begin(), new_color_set_id.end());
+        const uint64_t width = std::max<uint64_t>(std::ceil(std::log2(max_color_set_id + 1)), 1);
+        bits::compact_vector::builder map_builder(num_runs, width);
+        for (uint64_t i = 0; i != num_runs; ++i) {
+            const uint64_t color_set_id = other_map.size() == 0 ? i : other_map[i];
+            map_builder.set(i, new_color_set_id[color_set_id]);
+        }
+        map_builder.build(m_u2c_map);
+    }
+
     template <typename Visitor, typename T>
     static void visit_impl(Visitor& visitor, T&& t) {
         visitor.visit(t.m_vnum);
@@ -97,6 +167,7 @@ private:
         visitor.visit(t.m_k2u);
         visitor.visit(t.m_u2c);
         visitor.visit(t.m_u2c_rank1_index);
+        if (t.m_vnum.x >= 5) visitor.visit(t.m_u2c_map);  // not in indexes of version 4
         visitor.visit(t.m_color_sets);
         visitor.visit(t.m_filenames);
     }
@@ -105,8 +176,16 @@ private:
     sshash_type m_k2u;
     bits::bit_vector m_u2c;
     bits::rank9 m_u2c_rank1_index;
+    /*
+        The color set id of the i-th run of unitigs in u2c is m_u2c_map[i],
+        or i if m_u2c_map is empty. This lets the color sets be permuted
+        (e.g., by the differential builders) without re-laying out the unitigs.
+    */
+    bits::compact_vector m_u2c_map;
     ColorSets m_color_sets;
     filenames m_filenames;
+
+    std::vector<bool> m_removed_colors;  // not serialized: see set_removed_colors
 };
 
 }  // namespace fulgor
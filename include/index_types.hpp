@@ -3,6 +3,8 @@
 #include "index.hpp"
 
 #include "builders/builder.hpp"
+#include "builders/merge_builder.hpp"
+#include "builders/subset_builder.hpp"
 #include "color_sets/hybrid.hpp"
 
 namespace fulgor {
@@ -18,8 +20,18 @@ typedef index<meta<hybrid>> meta_hybrid_colors_index_type;
 typedef meta_hybrid_colors_index_type mfur_index_t;  // in use
 }  // namespace fulgor
 
-#include "builders/differential_builder.hpp"
+#include "color_sets/roaring.hpp"
+#include "builders/reorder_builder.hpp"
+
+namespace fulgor {
+typedef index<roaring> roaring_colors_index_type;
+typedef roaring_colors_index_type rfur_index_t;  // in use
+typedef index<meta<roaring>> meta_roaring_colors_index_type;
+typedef meta_roaring_colors_index_type mrfur_index_t;  // in use
+}  // namespace fulgor
+
 #include "color_sets/differential.hpp"
+#include "builders/differential_builder.hpp"
 
 namespace fulgor {
 typedef index<differential> differential_colors_index_type;
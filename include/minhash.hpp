@@ -0,0 +1,306 @@
+#pragma once
+
+#include "include/build_util.hpp"
+
+namespace fulgor {
+
+/*
+    One-permutation MinHash sketches: every element of a set is hashed once, the 6 most
+    significant bits of the hash select one of the 64 bins and a bin keeps the minimum of the
+    32 least significant bits hashed to it. A sketch takes 256 bytes (a quarter of the HLL
+    sketches used by k-means) and the fraction of equal bins estimates the Jaccard similarity.
+*/
+struct minhash_sketches {
+    static constexpr uint64_t num_bins = 64;
+    static constexpr uint32_t empty_bin = uint32_t(-1);
+
+    minhash_sketches(const uint64_t num_sketches = 0)
+        : m_bins(num_sketches * num_bins, empty_bin) {}
+
+    uint64_t size() const { return m_bins.size() / num_bins; }
+    uint32_t* operator[](const uint64_t i) { return m_bins.data() + i * num_bins; }
+    uint32_t const* operator[](const uint64_t i) const { return m_bins.data() + i * num_bins; }
+
+    /* the 64-bit finalizer of splitmix64 */
+    static uint64_t hash(uint64_t x) {
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    static uint64_t bin(const uint64_t hash) {
+        static_assert(num_bins == 64);
+        return hash >> 58;
+    }
+
+    static void add(uint32_t* sketch, const uint64_t hash) {
+        sketch[bin(hash)] = std::min<uint32_t>(sketch[bin(hash)], hash);
+    }
+
+    /* the fraction of equal bins among those that are not empty in both sketches */
+    static double similarity(uint32_t const* a, uint32_t const* b) {
+        uint64_t num_equal = 0;
+        uint64_t num_not_empty = 0;
+        for (uint64_t i = 0; i != num_bins; ++i) {
+            if (a[i] == empty_bin and b[i] == empty_bin) continue;
+            num_not_empty += 1;
+            num_equal += a[i] == b[i];
+        }
+        return num_not_empty == 0 ? 1.0 : double(num_equal) / num_not_empty;
+    }
+
+private:
+    std::vector<uint32_t> m_bins;
+};
+
+/*
+    Sketch the set of unitigs of every reference, as build_reference_sketches does with HLL:
+    all threads update the same sketches, taking the minimum of the bins atomically.
+*/
+template <typename Index>
+minhash_sketches build_reference_minhash_sketches(Index const& index, const uint64_t num_threads) {
+    assert(num_threads > 0);
+    const uint64_t num_colors = index.num_colors();
+    minhash_sketches sketches(num_colors);
+    unitig_runs_scheduler<Index> scheduler(index, num_threads);
+    scheduler.run([&](uint64_t /* thread_id */, auto it, uint64_t first_unitig_id,
+                      uint64_t last_unitig_id) {
+        const uint64_t size = it.size();
+        for (uint64_t i = 0; i != size; ++i, ++it) {
+            uint32_t ref_id = *it;
+            assert(ref_id < num_colors);
+            uint32_t* sketch = sketches[ref_id];
+            for (uint64_t unitig_id = first_unitig_id; unitig_id <= last_unitig_id; ++unitig_id) {
+                const uint64_t hash = minhash_sketches::hash(unitig_id);
+                atomic_update_min(sketch[minhash_sketches::bin(hash)], uint32_t(hash));
+            }
+        }
+    });
+    return sketches;
+}
+
+/*
+    Sketch the colors of the color sets whose size is in (left * num_colors, right * num_colors],
+    as build_colors_sketches_sliced does with HLL. The ids of the sketched color sets are
+    appended to color_set_ids.
+*/
+template <typename Index>
+minhash_sketches build_colors_minhash_sketches_sliced(Index const& index,
+                                                      const uint64_t num_threads,  //
+                                                      double left, double right,   //
+                                                      std::vector<uint64_t>& color_set_ids) {
+    const uint64_t num_colors = index.num_colors();
+    const uint64_t num_color_sets = index.num_color_sets();
+    const double min_size = left * num_colors;
+    const double max_size = right * num_colors;
+
+    std::vector<uint64_t> filtered_color_set_ids;
+    uint64_t load = 0;
+    for (uint64_t color_set_id = 0; color_set_id != num_color_sets; ++color_set_id) {
+        uint64_t size = index.color_set(color_set_id).size();
+        if (size > min_size and size <= max_size) {
+            filtered_color_set_ids.push_back(color_set_id);
+            load += size;
+        }
+    }
+
+    minhash_sketches sketches(filtered_color_set_ids.size());
+    task_scheduler scheduler(num_threads);
+    scheduler.add(
+        0, filtered_color_set_ids.size(), scheduler.chunk_weight(load),
+        [&](uint64_t i) { return index.color_set(filtered_color_set_ids[i]).size(); },
+        [](uint64_t) { return true; });
+    scheduler.run([&](uint64_t /* thread_id */, uint64_t chunk_id) {
+        auto const& chunk = scheduler.chunks()[chunk_id];
+        for (uint64_t i = chunk.begin; i != chunk.end; ++i) {
+            auto it = index.color_set(filtered_color_set_ids[i]);
+            const uint64_t size = it.size();
+            for (uint64_t j = 0; j != size; ++j, ++it) {
+                minhash_sketches::add(sketches[i], minhash_sketches::hash(*it));
+            }
+        }
+    });
+
+    color_set_ids.insert(color_set_ids.end(), filtered_color_set_ids.begin(),
+                         filtered_color_set_ids.end());
+    return sketches;
+}
+
+struct lsh_clustering_parameters {
+    lsh_clustering_parameters()
+        : num_bands(16)
+        , max_bucket_comparisons(8)
+        , min_similarity(0.5)
+        , min_cluster_size(1)
+        , max_cluster_size(-1)
+        , num_threads(1) {}
+
+    uint64_t num_bands;  // of minhash_sketches::num_bins / num_bands bins each
+    uint64_t max_bucket_comparisons;  // every point is compared with the first ones of its bucket
+    double min_similarity;
+    uint64_t min_cluster_size;
+    uint64_t max_cluster_size;
+    uint64_t num_threads;
+};
+
+/*
+    Cluster the sketches with locality-sensitive hashing: the bins are split into bands and two
+    sketches are candidates to be in the same cluster if they are equal in a band. The candidates
+    of similarity at least min_similarity are then joined in order of decreasing similarity
+    (single-linkage agglomeration), without growing clusters beyond max_cluster_size.
+
+    As k-means with clustering_parameters::set_min_cluster_size, clusters smaller than
+    min_cluster_size are not kept: such a cluster is then joined to its most similar candidate,
+    whatever the similarity, and the ones left are packed into residual clusters (of which only
+    the last can still be smaller than min_cluster_size).
+
+    The bands are bucketed in parallel; the agglomeration is a sequential pass over the sorted
+    candidates, since every join depends on the sizes left by the previous ones.
+    Return the clusters in the same form as kmeans::kmeans_divisive.
+*/
+kmeans::cluster_data cluster_minhash_sketches(minhash_sketches const& sketches,
+                                              lsh_clustering_parameters const& params) {
+    constexpr uint64_t num_bins = minhash_sketches::num_bins;
+    assert(params.num_bands > 0 and num_bins % params.num_bands == 0);
+    const uint64_t num_rows = num_bins / params.num_bands;
+    const uint64_t num_points = sketches.size();
+
+    struct candidate {
+        float similarity;
+        uint32_t a, b;
+        bool operator<(candidate const& other) const {
+            if (similarity != other.similarity) return similarity > other.similarity;
+            if (a != other.a) return a < other.a;
+            return b < other.b;
+        }
+    };
+
+    /*
+        Every band is bucketed by a thread. A point is compared with the first points of its
+        bucket, rather than with its neighbour in hash order only: a dissimilar point in between
+        would break the link between two similar ones.
+    */
+    std::vector<std::vector<candidate>> band_candidates(params.num_bands);
+    task_scheduler scheduler(params.num_threads);
+    scheduler.add(
+        0, params.num_bands, 1, [](uint64_t) { return 1; }, [](uint64_t) { return true; });
+    scheduler.run([&](uint64_t /* thread_id */, uint64_t chunk_id) {
+        auto const& chunk = scheduler.chunks()[chunk_id];
+        for (uint64_t band = chunk.begin; band != chunk.end; ++band) {
+            std::vector<std::pair<uint64_t, uint32_t>> buckets;  // (band hash, point)
+            buckets.reserve(num_points);
+            for (uint64_t i = 0; i != num_points; ++i) {
+                uint32_t const* rows = sketches[i] + band * num_rows;
+                /* skip the bands that are empty: they tell nothing about the point */
+                if (std::all_of(rows, rows + num_rows, [](uint32_t bin) {
+                        return bin == minhash_sketches::empty_bin;
+                    })) {
+                    continue;
+                }
+                uint64_t h = static_cast<uint64_t>(util::hash128(
+                    reinterpret_cast<char const*>(rows), num_rows * sizeof(uint32_t), band));
+                buckets.emplace_back(h, i);
+            }
+            std::sort(buckets.begin(), buckets.end());
+            auto& candidates = band_candidates[band];
+            for (uint64_t bucket_begin = 0, j = 1; j < buckets.size(); ++j) {
+                if (buckets[j].first != buckets[bucket_begin].first) {
+                    bucket_begin = j;
+                    continue;
+                }
+                const uint64_t end = std::min(j, bucket_begin + params.max_bucket_comparisons);
+                for (uint64_t i = bucket_begin; i != end; ++i) {
+                    /* points are in increasing order within a bucket, so that a < b */
+                    const uint32_t a = buckets[i].second;
+                    const uint32_t b = buckets[j].second;
+                    const double similarity =
+                        minhash_sketches::similarity(sketches[a], sketches[b]);
+                    /* the others are kept to join the clusters smaller than min_cluster_size */
+                    if (similarity >= params.min_similarity or params.min_cluster_size > 1) {
+                        candidates.push_back({static_cast<float>(similarity), a, b});
+                    }
+                }
+            }
+        }
+    });
+
+    std::vector<candidate> candidates;
+    for (auto& c : band_candidates) {
+        candidates.insert(candidates.end(), c.begin(), c.end());
+        std::vector<candidate>().swap(c);
+    }
+    std::sort(candidates.begin(), candidates.end());
+    /* the same pair can be a candidate in several bands */
+    candidates.erase(std::unique(candidates.begin(), candidates.end(),
+                                 [](candidate const& x, candidate const& y) {
+                                     return x.a == y.a and x.b == y.b;
+                                 }),
+                     candidates.end());
+
+    /* union-find with union by size */
+    std::vector<uint32_t> parent(num_points);
+    std::vector<uint64_t> cluster_size(num_points, 1);
+    for (uint64_t i = 0; i != num_points; ++i) parent[i] = i;
+    auto find = [&](uint32_t x) {
+        while (parent[x] != x) {
+            parent[x] = parent[parent[x]];
+            x = parent[x];
+        }
+        return x;
+    };
+    auto join = [&](candidate const& c, const bool only_small) {
+        uint32_t a = find(c.a);
+        uint32_t b = find(c.b);
+        if (a == b or cluster_size[a] + cluster_size[b] > params.max_cluster_size) return;
+        if (only_small and cluster_size[a] >= params.min_cluster_size and
+            cluster_size[b] >= params.min_cluster_size) {
+            return;
+        }
+        if (cluster_size[a] < cluster_size[b]) std::swap(a, b);
+        parent[b] = a;
+        cluster_size[a] += cluster_size[b];
+    };
+    for (auto const& c : candidates) {
+        if (c.similarity < params.min_similarity) break;
+        join(c, false);
+    }
+    /* the first candidate of a small cluster, in order of decreasing similarity, is its most
+       similar one */
+    if (params.min_cluster_size > 1) {
+        for (auto const& c : candidates) join(c, true);
+    }
+
+    /* number the clusters in order of their first point */
+    kmeans::cluster_data clustering_data;
+    clustering_data.clusters.resize(num_points);
+    std::vector<uint32_t> cluster_id(num_points, uint32_t(-1));
+    uint32_t num_clusters = 0;
+    for (uint64_t i = 0; i != num_points; ++i) {
+        uint32_t root = find(i);
+        if (cluster_size[root] < params.min_cluster_size) continue;
+        if (cluster_id[root] == uint32_t(-1)) cluster_id[root] = num_clusters++;
+        clustering_data.clusters[i] = cluster_id[root];
+    }
+
+    /* the clusters still smaller than min_cluster_size are packed whole, in the same order,
+       into residual clusters of at most max_cluster_size points */
+    uint64_t residual_size = 0;
+    for (uint64_t i = 0; i != num_points; ++i) {
+        uint32_t root = find(i);
+        if (cluster_size[root] >= params.min_cluster_size) continue;
+        if (cluster_id[root] == uint32_t(-1)) {
+            if (residual_size == 0 or
+                residual_size + cluster_size[root] > params.max_cluster_size) {
+                ++num_clusters;
+                residual_size = 0;
+            }
+            cluster_id[root] = num_clusters - 1;
+            residual_size += cluster_size[root];
+        }
+        clustering_data.clusters[i] = cluster_id[root];
+    }
+    clustering_data.num_clusters = num_clusters;
+    return clustering_data;
+}
+
+}  // namespace fulgor
@@ -0,0 +1,573 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <stdexcept>
+#include <fstream>
+#include <cstring>
+#include <zlib.h>
+
+namespace fulgor {
+
+struct fastx_record {
+    std::string name;
+    std::string seq;
+};
+
+struct fastx_read_group {
+    struct chunk_offset {
+        uint64_t frag_idx;  // id of the first read of the group
+    };
+
+    fastx_read_group() : m_size(0), m_first_read_id(0) {}
+
+    std::vector<fastx_record>::iterator begin() { return m_records.begin(); }
+    std::vector<fastx_record>::iterator end() { return m_records.begin() + m_size; }
+    uint64_t size() const { return m_size; }
+    chunk_offset chunk_frag_offset() const { return {m_first_read_id}; }
+
+private:
+    friend struct parallel_fastx_parser;
+    /* only the first m_size records are valid: the others keep their memory for reuse */
+    std::vector<fastx_record> m_records;
+    uint64_t m_size;
+    uint64_t m_first_read_id;
+};
+
+/*
+    Reads the text of a BGZF file (e.g., written by bgzip).
+    BGZF files are made of independent blocks of at most 64 KiB, that are read in batches
+    and inflated in parallel by num_threads threads (by the calling thread, if num_threads is 0).
+*/
+struct bgzf_reader {
+    static constexpr uint64_t num_blocks_per_batch = 64;
+
+    bgzf_reader(std::string const& filename, const uint64_t num_threads)
+        : m_in(filename, std::ios::binary)
+        , m_max_in_flight(2 * num_threads)
+        , m_eof(false)
+        , m_no_more_tasks(false) {
+        if (!m_in.is_open()) throw std::runtime_error("error in opening file '" + filename + "'");
+        m_threads.reserve(num_threads);
+        for (uint64_t t = 0; t != num_threads; ++t) {
+            m_threads.emplace_back([this]() {
+                raw_inflater inflater;
+                while (true) {
+                    batch* b = nullptr;
+                    {
+                        std::unique_lock lock(m_mut);
+                        m_tasks_cv.wait(lock,
+                                        [&]() { return !m_tasks.empty() or m_no_more_tasks; });
+                        if (m_tasks.empty()) break;
+                        b = m_tasks.front();
+                        m_tasks.pop_front();
+                    }
+                    inflater.inflate_batch(*b);
+                    std::lock_guard lock(m_mut);
+                    b->done = true;
+                    m_done_cv.notify_all();
+                }
+            });
+        }
+    }
+
+    ~bgzf_reader() {
+        {
+            std::lock_guard lock(m_mut);
+            m_no_more_tasks = true;
+        }
+        m_tasks_cv.notify_all();
+        for (auto& t : m_threads) t.join();
+    }
+
+    /* append the text of the next batch of blocks: return false at the end of file */
+    bool read(std::string& text) {
+        if (m_threads.empty()) {
+            batch b;
+            if (!read_batch(b)) return false;
+            m_inflater.inflate_batch(b);
+            if (!b.ok) throw std::runtime_error("error in inflating BGZF block");
+            text.append(b.text);
+            return true;
+        }
+
+        /* keep enough batches in flight to keep all threads busy,
+           and return them in file order as soon as they are inflated */
+        while (!m_eof and m_in_flight.size() != m_max_in_flight) {
+            auto b = std::make_unique<batch>();
+            if (!read_batch(*b)) break;
+            std::lock_guard lock(m_mut);
+            m_tasks.push_back(b.get());
+            m_in_flight.push_back(std::move(b));
+            m_tasks_cv.notify_one();
+        }
+        if (m_in_flight.empty()) return false;
+        {
+            std::unique_lock lock(m_mut);
+            m_done_cv.wait(lock, [&]() { return m_in_flight.front()->done; });
+        }
+        auto& b = *m_in_flight.front();
+        if (!b.ok) throw std::runtime_error("error in inflating BGZF block");
+        text.append(b.text);
+        m_in_flight.pop_front();
+        return true;
+    }
+
+private:
+    struct batch {
+        batch() : done(false), ok(false) {}
+        std::string compressed;           // whole BGZF blocks, one after the other
+        std::vector<uint64_t> endpoints;  // blocks are [endpoints[i], endpoints[i + 1])
+        std::string text;
+        bool done, ok;
+    };
+
+    struct raw_inflater {
+        raw_inflater() {
+            m_strm.zalloc = Z_NULL;
+            m_strm.zfree = Z_NULL;
+            m_strm.opaque = Z_NULL;
+            m_strm.next_in = Z_NULL;
+            m_strm.avail_in = 0;
+            m_init = inflateInit2(&m_strm, -15) == Z_OK;  // raw deflate
+        }
+
+        ~raw_inflater() {
+            if (m_init) inflateEnd(&m_strm);
+        }
+
+        void inflate_batch(batch& b) {
+            if (!m_init) return;
+            auto const* data = reinterpret_cast<unsigned char const*>(b.compressed.data());
+            uint64_t text_size = 0;
+            for (uint64_t i = 1; i != b.endpoints.size(); ++i) {
+                text_size += isize(data, b.endpoints[i]);
+            }
+            b.text.resize(text_size);
+            uint64_t pos = 0;
+            for (uint64_t i = 1; i != b.endpoints.size(); ++i) {
+                const uint64_t begin = b.endpoints[i - 1];
+                const uint64_t end = b.endpoints[i];
+                const uint64_t xlen = data[begin + 10] | (data[begin + 11] << 8);
+                const uint64_t cdata_begin = begin + 12 + xlen;
+                const uint64_t size = isize(data, end);
+                if (size == 0) continue;  // e.g., the empty block marking the end of file
+                if (inflateReset(&m_strm) != Z_OK) return;
+                m_strm.next_in = const_cast<unsigned char*>(data + cdata_begin);
+                m_strm.avail_in = end - 8 - cdata_begin;
+                m_strm.next_out = reinterpret_cast<unsigned char*>(b.text.data() + pos);
+                m_strm.avail_out = size;
+                if (inflate(&m_strm, Z_FINISH) != Z_STREAM_END or m_strm.avail_out != 0) return;
+                pos += size;
+            }
+            b.ok = true;
+        }
+
+    private:
+        z_stream m_strm;
+        bool m_init;
+
+        /* uncompressed size of the block ending at end */
+        static uint64_t isize(unsigned char const* data, const uint64_t end) {
+            return uint64_t(data[end - 4]) | (uint64_t(data[end - 3]) << 8) |
+                   (uint64_t(data[end - 2]) << 16) | (uint64_t(data[end - 1]) << 24);
+        }
+    };
+
+    std::ifstream m_in;
+    const uint64_t m_max_in_flight;
+    bool m_eof;
+    raw_inflater m_inflater;  // used when there are no threads
+    std::deque<std::unique_ptr<batch>> m_in_flight;
+
+    std::vector<std::thread> m_threads;
+    std::mutex m_mut;
+    std::condition_variable m_tasks_cv, m_done_cv;
+    std::deque<batch*> m_tasks;
+    bool m_no_more_tasks;
+
+    /* read the next num_blocks_per_batch blocks: return false if there are none */
+    bool read_batch(batch& b) {
+        b.endpoints.push_back(0);
+        while (!m_eof and b.endpoints.size() <= num_blocks_per_batch) {
+            if (!read_block(b)) m_eof = true;
+        }
+        return b.endpoints.size() != 1;
+    }
+
+    /* append the next BGZF block to the batch: return false at the end of file */
+    bool read_block(batch& b) {
+        constexpr uint64_t header_size = 12;
+        unsigned char header[header_size];
+        if (!m_in.read(reinterpret_cast<char*>(header), header_size)) {
+            if (m_in.gcount() == 0) return false;
+            throw std::runtime_error("truncated BGZF block");
+        }
+        if (header[0] != 31 or header[1] != 139 or header[2] != 8 or !(header[3] & 4)) {
+            throw std::runtime_error("file is not in BGZF format");
+        }
+        const uint64_t xlen = header[10] | (header[11] << 8);
+        std::string extra(xlen, 0);
+        if (!m_in.read(extra.data(), xlen)) throw std::runtime_error("truncated BGZF block");
+        uint64_t block_size = 0;
+        for (uint64_t i = 0; i + 4 <= xlen;) {  // find the BC subfield
+            const uint64_t len = uint8_t(extra[i + 2]) | (uint8_t(extra[i + 3]) << 8);
+            if (extra[i] == 'B' and extra[i + 1] == 'C' and len == 2 and i + 6 <= xlen) {
+                block_size = (uint8_t(extra[i + 4]) | (uint8_t(extra[i + 5]) << 8)) + 1;
+                break;
+            }
+            i += 4 + len;
+        }
+        constexpr uint64_t trailer_size = 8;  // CRC32 and uncompressed size
+        if (block_size < header_size + xlen + trailer_size) {
+            throw std::runtime_error("file is not in BGZF format");
+        }
+        const uint64_t begin = b.compressed.size();
+        b.compressed.append(reinterpret_cast<char const*>(header), header_size);
+        b.compressed.append(extra);
+        b.compressed.resize(begin + block_size);
+        const uint64_t rest = block_size - header_size - xlen;
+        if (!m_in.read(b.compressed.data() + begin + header_size + xlen, rest)) {
+            throw std::runtime_error("truncated BGZF block");
+        }
+        b.endpoints.push_back(begin + block_size);
+        return true;
+    }
+};
+
+/*
+    A replacement for fastx_parser::FastxParser (same interface) that
+    reads a single large input file faster.
+
+    A producer thread reads the input and splits the text into chunks of records,
+    that are consumed by the worker threads through refill().
+    BGZF inputs are inflated in parallel by num_decompression_threads threads
+    (see bgzf_reader; if 0, the producer thread inflates the blocks itself).
+    Plain gzip cannot be split without inflating it first, so it is inflated
+    by the producer thread (this only moves parsing off the decompression thread).
+
+    With inline_parsing, there is no producer thread: a worker that finds no chunk ready
+    in refill() reads and parses the next block of text itself, so that no core is
+    dedicated to the input (e.g., to run with a single thread).
+    FASTQ records must span four lines.
+*/
+struct parallel_fastx_parser {
+    static constexpr uint64_t num_records_per_chunk = 1000;
+    static constexpr uint64_t text_block_size = 1 << 22;  // bytes read at once (plain and gzip)
+
+    parallel_fastx_parser(std::vector<std::string> const& filenames, const uint64_t num_consumers,
+                          const uint64_t num_decompression_threads,
+                          const bool inline_parsing = false)
+        : m_filenames(filenames)
+        , m_num_decompression_threads(inline_parsing ? 0 : num_decompression_threads)
+        , m_max_ready_chunks(2 * std::max<uint64_t>(num_consumers, 1))
+        , m_inline_parsing(inline_parsing)
+        , m_done(false)
+        , m_stop(false)
+        , m_format(format_t::UNKNOWN)
+        , m_num_records(0)
+        , m_file_id(0)
+        , m_gzip_file(nullptr) {}
+
+    ~parallel_fastx_parser() {
+        if (m_producer.joinable()) stop_producer();
+        close_file();
+    }
+
+    /* true if the file starts with a BGZF block */
+    static bool is_bgzf(std::string const& filename) {
+        std::ifstream in(filename, std::ios::binary);
+        unsigned char header[16];
+        if (!in.read(reinterpret_cast<char*>(header), sizeof(header))) return false;
+        return header[0] == 31 and header[1] == 139 and header[2] == 8 and (header[3] & 4) and
+               header[12] == 'B' and header[13] == 'C' and header[14] == 2 and header[15] == 0;
+    }
+
+    bool start() {
+        if (m_inline_parsing or m_producer.joinable()) return false;
+        m_producer = std::thread([this]() { produce(); });
+        return true;
+    }
+
+    bool stop() {
+        if (m_inline_parsing) {
+            m_stop = true;  // all the workers have returned from refill()
+        } else {
+            if (!m_producer.joinable()) return false;
+            stop_producer();
+        }
+        if (m_exception) std::rethrow_exception(m_exception);
+        return true;
+    }
+
+    fastx_read_group getReadGroup() { return fastx_read_group(); }
+
+    bool refill(fastx_read_group& rg) {
+        if (m_inline_parsing) return refill_inline(rg);
+        std::unique_lock lock(m_chunks_mut);
+        recycle(rg);
+        m_chunks_cv.wait(lock, [&]() { return !m_ready.empty() or m_done; });
+        return pop_ready(rg);
+    }
+
+private:
+    enum class format_t : uint8_t { UNKNOWN, FASTA, FASTQ };
+
+    std::vector<std::string> m_filenames;
+    const uint64_t m_num_decompression_threads;
+    const uint64_t m_max_ready_chunks;
+    const bool m_inline_parsing;
+
+    std::thread m_producer;
+    std::exception_ptr m_exception;
+
+    /* chunks ready to be consumed, and records that can be reused */
+    std::mutex m_chunks_mut;
+    std::condition_variable m_chunks_cv, m_space_cv;
+    std::deque<fastx_read_group> m_ready;
+    std::vector<std::vector<fastx_record>> m_free_records;
+    bool m_done;
+    std::atomic<bool> m_stop;  // set while holding m_chunks_mut
+
+    /* state of the producer (with inline parsing, of the worker holding m_producer_mut) */
+    std::mutex m_producer_mut;
+    format_t m_format;
+    std::string m_text;  // text not parsed yet
+    uint64_t m_num_records;
+    fastx_read_group m_chunk;
+    uint64_t m_file_id;  // next file to open
+    gzFile m_gzip_file;
+    std::unique_ptr<bgzf_reader> m_bgzf_file;
+    std::string m_block;
+
+    void stop_producer() {
+        {
+            std::lock_guard lock(m_chunks_mut);
+            m_stop = true;
+        }
+        m_space_cv.notify_all();
+        m_producer.join();
+    }
+
+    bool stopped() const { return m_stop; }
+
+    void recycle(fastx_read_group& rg) {
+        if (!rg.m_records.empty()) m_free_records.push_back(std::move(rg.m_records));
+        rg.m_records.clear();
+        rg.m_size = 0;
+    }
+
+    /* must hold m_chunks_mut */
+    bool pop_ready(fastx_read_group& rg) {
+        if (m_ready.empty()) return false;
+        rg = std::move(m_ready.front());
+        m_ready.pop_front();
+        m_space_cv.notify_one();
+        return true;
+    }
+
+    void produce() {
+        try {
+            while (!stopped() and read_more()) {}
+        } catch (...) { m_exception = std::current_exception(); }
+        std::lock_guard lock(m_chunks_mut);
+        m_done = true;
+        m_chunks_cv.notify_all();
+    }
+
+    bool refill_inline(fastx_read_group& rg) {
+        {
+            std::lock_guard lock(m_chunks_mut);
+            recycle(rg);
+            if (pop_ready(rg)) return true;
+        }
+        std::lock_guard producer_lock(m_producer_mut);
+        while (true) {
+            {
+                std::lock_guard lock(m_chunks_mut);
+                if (pop_ready(rg)) return true;
+                if (m_done) return false;
+            }
+            bool more = false;
+            try {
+                more = read_more();
+            } catch (...) {
+                std::lock_guard lock(m_chunks_mut);
+                m_exception = std::current_exception();
+                m_done = true;
+                return false;
+            }
+            if (!more) {
+                std::lock_guard lock(m_chunks_mut);
+                m_done = true;
+            }
+        }
+    }
+
+    /* read and parse the next block of text: return false when all files have been read */
+    bool read_more() {
+        if (m_gzip_file == nullptr and !m_bgzf_file) {
+            if (m_file_id == m_filenames.size()) {
+                if (m_chunk.m_size != 0) push_chunk();
+                return false;
+            }
+            open_file(m_filenames[m_file_id++]);
+        }
+        const bool more = m_bgzf_file ? m_bgzf_file->read(m_text) : read_gzip();
+        if (more) {
+            parse(false);
+        } else {
+            close_file();
+            m_text.push_back('\n');  // in case the file does not end with a newline
+            parse(true);
+        }
+        return true;
+    }
+
+    void open_file(std::string const& filename) {
+        if (is_bgzf(filename)) {
+            m_bgzf_file = std::make_unique<bgzf_reader>(filename, m_num_decompression_threads);
+            return;
+        }
+        /* plain text or gzip: zlib reads both */
+        m_gzip_file = gzopen(filename.c_str(), "rb");
+        if (m_gzip_file == nullptr) {
+            throw std::runtime_error("error in opening file '" + filename + "'");
+        }
+        gzbuffer(m_gzip_file, 1 << 20);
+        m_block.resize(text_block_size);
+    }
+
+    void close_file() {
+        if (m_gzip_file != nullptr) gzclose(m_gzip_file);
+        m_gzip_file = nullptr;
+        m_bgzf_file.reset();
+    }
+
+    bool read_gzip() {
+        int num_bytes = gzread(m_gzip_file, m_block.data(), m_block.size());
+        if (num_bytes < 0) {
+            throw std::runtime_error("error in reading file '" + m_filenames[m_file_id - 1] + "'");
+        }
+        m_text.append(m_block.data(), num_bytes);
+        return num_bytes != 0;
+    }
+
+    /* parse all the complete records in m_text (all records, if last is true) */
+    void parse(const bool last) {
+        char const* text = m_text.data();
+        const uint64_t size = m_text.size();
+        uint64_t pos = 0;
+
+        while (pos != size and (text[pos] == '\n' or text[pos] == '\r')) ++pos;
+        if (pos == size) {
+            m_text.clear();
+            return;
+        }
+
+        if (m_format == format_t::UNKNOWN) {
+            if (text[pos] == '@') {
+                m_format = format_t::FASTQ;
+            } else if (text[pos] == '>') {
+                m_format = format_t::FASTA;
+            } else {
+                throw std::runtime_error("input is neither in FASTA nor in FASTQ format");
+            }
+        }
+
+        auto line_end = [&](uint64_t from) -> uint64_t {  // position of the next '\n' or size
+            auto const* ptr = static_cast<char const*>(std::memchr(text + from, '\n', size - from));
+            return ptr == nullptr ? size : ptr - text;
+        };
+        auto strip = [&](uint64_t begin, uint64_t end) -> uint64_t {  // length without '\r'
+            return (end > begin and text[end - 1] == '\r') ? end - begin - 1 : end - begin;
+        };
+
+        while (pos != size and !stopped()) {
+            if (text[pos] == '\n' or text[pos] == '\r') {  // skip empty lines
+                ++pos;
+                continue;
+            }
+            const char marker = m_format == format_t::FASTQ ? '@' : '>';
+            if (text[pos] != marker) throw std::runtime_error("malformed FASTA/FASTQ record");
+            const uint64_t header_end = line_end(pos);
+            if (header_end == size) break;
+
+            uint64_t record_end = 0;  // position right after the record
+            if (m_format == format_t::FASTQ) {
+                const uint64_t seq_end = line_end(header_end + 1);
+                if (seq_end == size) break;
+                const uint64_t plus_end = line_end(seq_end + 1);
+                if (plus_end == size) break;
+                const uint64_t qual_end = line_end(plus_end + 1);
+                if (qual_end == size) break;
+                record_end = qual_end + 1;
+                auto& record = next_record();
+                record.seq.assign(text + header_end + 1, strip(header_end + 1, seq_end));
+                set_name(record, text + pos + 1, strip(pos + 1, header_end));
+            } else {
+                uint64_t end = header_end;
+                while (end != size and end + 1 != size and text[end + 1] != '>') {
+                    end = line_end(end + 1);
+                }
+                if (end == size or (end + 1 == size and !last)) break;
+                record_end = end + 1;
+                auto& record = next_record();
+                record.seq.clear();
+                for (uint64_t begin = header_end + 1; begin < end;) {
+                    const uint64_t e = line_end(begin);
+                    record.seq.append(text + begin, strip(begin, e));
+                    begin = e + 1;
+                }
+                set_name(record, text + pos + 1, strip(pos + 1, header_end));
+            }
+            pos = record_end;
+            if (m_chunk.m_size == num_records_per_chunk) push_chunk();
+        }
+
+        m_text.erase(0, pos);
+    }
+
+    static void set_name(fastx_record& record, char const* header, const uint64_t length) {
+        uint64_t name_length = 0;
+        while (name_length != length and header[name_length] != ' ' and
+               header[name_length] != '\t') {
+            ++name_length;
+        }
+        record.name.assign(header, name_length);
+    }
+
+    fastx_record& next_record() {
+        if (m_chunk.m_size == 0) m_chunk.m_first_read_id = m_num_records;
+        ++m_num_records;
+        if (m_chunk.m_size == m_chunk.m_records.size()) m_chunk.m_records.emplace_back();
+        return m_chunk.m_records[m_chunk.m_size++];
+    }
+
+    void push_chunk() {
+        std::unique_lock lock(m_chunks_mut);
+        if (!m_inline_parsing) {  // a worker parsing inline must not wait for other workers
+            m_space_cv.wait(lock, [&]() { return m_ready.size() < m_max_ready_chunks or m_stop; });
+        }
+        if (m_stop) {
+            m_chunk.m_size = 0;
+            return;
+        }
+        m_ready.push_back(std::move(m_chunk));
+        m_chunks_cv.notify_one();
+        m_chunk = fastx_read_group();
+        if (!m_free_records.empty()) {
+            m_chunk.m_records = std::move(m_free_records.back());
+            m_free_records.pop_back();
+        }
+    }
+};
+
+}  // namespace fulgor
@@ -0,0 +1,331 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <zlib.h>
+
+#include "external/sshash/external/pthash/external/bits/include/bit_vector.hpp"
+#include "external/sshash/external/pthash/external/bits/include/integer_codes.hpp"
+
+namespace fulgor {
+
+enum class psa_output_format : uint8_t { BINARY, COMPRESSED };
+
+/*
+    The compressed format codes a set of colors as hybrid color sets do with their default
+    thresholds, as fractions of the number of colors. They are part of the format: unlike those
+    of an index, they are never tuned.
+*/
+constexpr double psa_sparse_set_threshold = 0.25;
+constexpr double psa_very_dense_set_threshold = 0.75;
+
+struct psa_record {
+    uint32_t query_id;
+    std::vector<uint32_t> colors;
+};
+
+/*
+    Streaming reader for the binary and compressed output formats of pseudoalign.
+
+    The file is processed in blocks.
+    For the compressed format, a block is what a worker flushed: the number of bits
+    followed by the delta-coded records (see psa_compressed_formatter).
+    The binary format has no framing, so a block is a run of consecutive records
+    of roughly binary_block_size bytes.
+
+    Files compressed with gzip (e.g., by pseudoalign --gzip-output) are read transparently.
+*/
+struct psa_reader {
+    static constexpr uint64_t binary_block_size = 1 << 16;
+
+    struct block {
+        uint64_t offset;    // position of the block in the (uncompressed) file
+        uint64_t num_bits;  // compressed format only
+        std::string bytes;
+    };
+
+    struct block_info {
+        uint64_t offset;
+        uint64_t num_records;
+        uint32_t min_query_id;
+        uint32_t max_query_id;
+    };
+
+    psa_reader(std::string const& filename, const psa_output_format format)
+        : m_format(format)
+        , m_num_colors(0)
+        , m_sparse_set_threshold_size(0)
+        , m_very_dense_set_threshold_size(0)
+        , m_data_begin(0)
+        , m_pos_in_block(0) {
+        m_file = gzopen(filename.c_str(), "rb");
+        if (m_file == nullptr) throw std::runtime_error("error in opening file");
+        gzbuffer(m_file, 1 << 20);
+        if (m_format == psa_output_format::COMPRESSED) {
+            uint64_t num_colors = 0;
+            if (!read(&num_colors, sizeof(uint64_t))) {
+                throw std::runtime_error("file is not in compressed format");
+            }
+            m_num_colors = num_colors;
+            m_sparse_set_threshold_size = psa_sparse_set_threshold * m_num_colors;
+            m_very_dense_set_threshold_size = psa_very_dense_set_threshold * m_num_colors;
+        }
+        m_data_begin = gztell(m_file);
+    }
+
+    ~psa_reader() { gzclose(m_file); }
+
+    psa_reader(psa_reader const&) = delete;
+    psa_reader& operator=(psa_reader const&) = delete;
+
+    psa_output_format format() const { return m_format; }
+    uint32_t num_colors() const { return m_num_colors; }
+
+    /* restart from the first block */
+    void rewind() {
+        seek(m_data_begin);
+        m_records.clear();
+        m_pos_in_block = 0;
+    }
+
+    /* read the next block, without decoding it */
+    bool next_block(block& b) {
+        b.offset = gztell(m_file);
+        b.num_bits = 0;
+        b.bytes.clear();
+        if (m_format == psa_output_format::COMPRESSED) {
+            if (!read(&b.num_bits, sizeof(uint64_t))) return false;
+            b.bytes.resize((b.num_bits + 63) / 64 * sizeof(uint64_t));
+            if (!read(b.bytes.data(), b.bytes.size())) {
+                throw std::runtime_error("truncated block at offset " + std::to_string(b.offset));
+            }
+            return true;
+        }
+        uint32_t header[2];  // query_id, size
+        while (b.bytes.size() < binary_block_size and read(header, sizeof(header))) {
+            uint64_t size = b.bytes.size();
+            b.bytes.resize(size + sizeof(header) + header[1] * sizeof(uint32_t));
+            std::memcpy(b.bytes.data() + size, header, sizeof(header));
+            if (!read(b.bytes.data() + size + sizeof(header), header[1] * sizeof(uint32_t))) {
+                throw std::runtime_error("truncated record for query " +
+                                         std::to_string(header[0]));
+            }
+        }
+        return !b.bytes.empty();
+    }
+
+    /* decode all the records of a block: thread-safe */
+    void decode(block const& b, std::vector<psa_record>& records) const {
+        records.clear();
+        if (m_format == psa_output_format::COMPRESSED) {
+            decode_compressed(b, records);
+        } else {
+            decode_binary(b, records);
+        }
+    }
+
+    /* iterate through the records, one at a time */
+    bool next(psa_record& record) {
+        while (m_pos_in_block == m_records.size()) {
+            if (!next_block(m_block)) return false;
+            decode(m_block, m_records);
+            m_pos_in_block = 0;
+        }
+        record = std::move(m_records[m_pos_in_block++]);
+        return true;
+    }
+
+    /*
+        Decode the blocks using num_threads threads and call
+        f(std::vector<psa_record> const& records) for every block,
+        from the calling thread and in file order.
+    */
+    template <typename Callback>
+    void for_each_block(const uint64_t num_threads, Callback f) {
+        assert(num_threads > 0);
+        const uint64_t batch_size = 4 * num_threads;
+        std::vector<block> blocks(batch_size);
+        std::vector<std::vector<psa_record>> records(batch_size);
+        std::vector<std::thread> threads;
+        while (true) {
+            uint64_t num_blocks = 0;
+            while (num_blocks != batch_size and next_block(blocks[num_blocks])) ++num_blocks;
+            if (num_blocks == 0) break;
+            const uint64_t n = std::min(num_threads, num_blocks);
+            for (uint64_t t = 0; t != n; ++t) {
+                threads.emplace_back([&, t]() {
+                    for (uint64_t i = t; i < num_blocks; i += n) decode(blocks[i], records[i]);
+                });
+            }
+            for (auto& t : threads) t.join();
+            threads.clear();
+            for (uint64_t i = 0; i != num_blocks; ++i) f(records[i]);
+            if (num_blocks != batch_size) break;
+        }
+    }
+
+    /*
+        Scan the whole file and build the block index, i.e.,
+        the range of query ids found in each block.
+    */
+    void build_index(const uint64_t num_threads) {
+        rewind();
+        m_index.clear();
+        std::vector<block> blocks;
+        block b;
+        while (next_block(b)) {
+            m_index.push_back({b.offset, 0, uint32_t(-1), 0});
+            blocks.push_back(std::move(b));
+            if (blocks.size() == 64 * num_threads) index_blocks(blocks, num_threads);
+        }
+        index_blocks(blocks, num_threads);
+        rewind();
+    }
+
+    std::vector<block_info> const& index() const { return m_index; }
+
+    /* random access by query id: requires build_index() */
+    bool find(const uint32_t query_id, std::vector<uint32_t>& colors) {
+        block b;
+        std::vector<psa_record> records;
+        for (auto const& info : m_index) {
+            if (query_id < info.min_query_id or query_id > info.max_query_id) continue;
+            seek(info.offset);
+            next_block(b);
+            decode(b, records);
+            for (auto& record : records) {
+                if (record.query_id == query_id) {
+                    colors.swap(record.colors);
+                    rewind();
+                    return true;
+                }
+            }
+        }
+        rewind();
+        return false;
+    }
+
+private:
+    gzFile m_file;
+    psa_output_format m_format;
+    uint32_t m_num_colors, m_sparse_set_threshold_size, m_very_dense_set_threshold_size;
+    uint64_t m_data_begin;
+
+    block m_block;
+    std::vector<psa_record> m_records;
+    uint64_t m_pos_in_block;
+
+    std::vector<block_info> m_index;
+
+    bool read(void* dst, const uint64_t num_bytes) {
+        char* ptr = static_cast<char*>(dst);
+        uint64_t num_read = 0;
+        while (num_read != num_bytes) {
+            const unsigned len = std::min<uint64_t>(num_bytes - num_read, 1ULL << 30);
+            int ret = gzread(m_file, ptr + num_read, len);
+            if (ret < 0) throw std::runtime_error("error in reading file");
+            if (ret == 0) break;
+            num_read += ret;
+        }
+        return num_read == num_bytes;
+    }
+
+    void seek(const uint64_t offset) {
+        if (gzseek(m_file, offset, SEEK_SET) < 0) throw std::runtime_error("error in seeking file");
+    }
+
+    void index_blocks(std::vector<block>& blocks, const uint64_t num_threads) {
+        const uint64_t first = m_index.size() - blocks.size();
+        const uint64_t n = std::min<uint64_t>(num_threads, blocks.size());
+        std::vector<std::thread> threads;
+        for (uint64_t t = 0; t != n; ++t) {
+            threads.emplace_back([&, t]() {
+                std::vector<psa_record> records;
+                for (uint64_t i = t; i < blocks.size(); i += n) {
+                    decode(blocks[i], records);
+                    auto& info = m_index[first + i];
+                    info.num_records = records.size();
+                    for (auto const& record : records) {
+                        info.min_query_id = std::min(info.min_query_id, record.query_id);
+                        info.max_query_id = std::max(info.max_query_id, record.query_id);
+                    }
+                }
+            });
+        }
+        for (auto& t : threads) t.join();
+        blocks.clear();
+    }
+
+    void decode_binary(block const& b, std::vector<psa_record>& records) const {
+        uint64_t pos = 0;
+        uint32_t header[2];  // query_id, size
+        while (pos != b.bytes.size()) {
+            std::memcpy(header, b.bytes.data() + pos, sizeof(header));
+            pos += sizeof(header);
+            psa_record record;
+            record.query_id = header[0];
+            record.colors.resize(header[1]);
+            std::memcpy(record.colors.data(), b.bytes.data() + pos, header[1] * sizeof(uint32_t));
+            pos += header[1] * sizeof(uint32_t);
+            records.push_back(std::move(record));
+        }
+    }
+
+    void decode_compressed(block const& b, std::vector<psa_record>& records) const {
+        if (b.num_bits == 0) return;
+        bits::bit_vector::builder bvb;
+        bvb.resize(b.num_bits);
+        std::memcpy(bvb.data().data(), b.bytes.data(), b.bytes.size());
+        bits::bit_vector bv;
+        bvb.build(bv);
+
+        auto it = bv.get_iterator_at(0);
+        while (it.position() < b.num_bits) {
+            psa_record record;
+            record.query_id = bits::util::read_delta(it);
+            const uint32_t size = bits::util::read_delta(it);
+            record.colors.reserve(size);
+            if (size == 0) {
+            } else if (size < m_sparse_set_threshold_size) {
+                uint32_t prev_val = bits::util::read_delta(it);
+                record.colors.push_back(prev_val);
+                for (uint64_t i = 1; i != size; ++i) {
+                    uint32_t val = bits::util::read_delta(it) + (prev_val + 1);
+                    record.colors.push_back(val);
+                    prev_val = val;
+                }
+            } else if (size < m_very_dense_set_threshold_size) {
+                const uint64_t bitmap_begin = it.position();
+                it.skip_to(bitmap_begin);  // as hybrid: next() does not follow take()
+                for (uint64_t i = 0; i != size; ++i) {
+                    uint64_t pos = it.next();
+                    assert(pos >= bitmap_begin and pos < bitmap_begin + m_num_colors);
+                    record.colors.push_back(pos - bitmap_begin);
+                }
+                it.skip_to(bitmap_begin + m_num_colors);
+            } else {
+                /* the complementary set is encoded */
+                const uint32_t comp_set_size = m_num_colors - size;
+                uint32_t val = 0;
+                uint32_t comp_val = -1;
+                for (uint64_t i = 0; i <= comp_set_size; ++i) {
+                    uint32_t next_comp_val = m_num_colors;
+                    if (i != comp_set_size) {
+                        next_comp_val = bits::util::read_delta(it) + (comp_val + 1);
+                    }
+                    while (val < next_comp_val) record.colors.push_back(val++);
+                    comp_val = next_comp_val;
+                    ++val;  // skip comp_val
+                }
+                assert(record.colors.size() == size);
+            }
+            records.push_back(std::move(record));
+        }
+    }
+};
+
+}  // namespace fulgor
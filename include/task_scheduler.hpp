@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace fulgor {
+
+/*
+    Dynamic scheduling of weighted ranges on a pool of threads. The ranges are split into
+    chunks of about the same weight, many more than the threads: a thread that finishes a
+    chunk takes the next one not taken yet, so that all threads stay busy until the end
+    even when the weight is concentrated in a few ranges (e.g., the dense color sets).
+*/
+struct task_scheduler {
+    struct chunk {
+        uint64_t group;       // the range the chunk belongs to
+        uint64_t begin, end;  // [..)
+    };
+
+    task_scheduler(const uint64_t num_threads) : m_num_threads(num_threads) {
+        assert(num_threads > 0);
+    }
+
+    /* the weight of a chunk to have about chunks_per_thread chunks per thread */
+    uint64_t chunk_weight(const uint64_t total_weight,
+                          const uint64_t chunks_per_thread = 16) const {
+        return std::max<uint64_t>(total_weight / (m_num_threads * chunks_per_thread), 1);
+    }
+
+    /*
+        Split the range [0, n) of the given group into chunks of about chunk_weight,
+        that begin only at the positions i where can_begin(i) is true.
+    */
+    template <typename Weight, typename CanBegin>
+    void add(const uint64_t group, const uint64_t n, const uint64_t chunk_weight,
+             Weight const& weight, CanBegin const& can_begin) {
+        uint64_t begin = 0;
+        uint64_t curr_weight = 0;
+        for (uint64_t i = 0; i != n; ++i) {
+            if (curr_weight >= chunk_weight and can_begin(i)) {
+                m_chunks.push_back({group, begin, i});
+                begin = i;
+                curr_weight = 0;
+            }
+            curr_weight += weight(i);
+        }
+        if (begin != n) m_chunks.push_back({group, begin, n});
+    }
+
+    std::vector<chunk> const& chunks() const { return m_chunks; }
+    uint64_t num_chunks() const { return m_chunks.size(); }
+
+    /*
+        Call f(thread_id, chunk_id) for every chunk: every thread takes its chunks in
+        increasing order of chunk_id.
+    */
+    template <typename Func>
+    void run(Func const& f) const {
+        std::atomic<uint64_t> next_chunk = 0;
+        std::exception_ptr exception;
+        std::mutex exception_mutex;
+        auto exe = [&](const uint64_t thread_id) {
+            try {
+                for (uint64_t i = next_chunk++; i < m_chunks.size(); i = next_chunk++) {
+                    f(thread_id, i);
+                }
+            } catch (...) {
+                std::lock_guard lock(exception_mutex);
+                if (!exception) exception = std::current_exception();
+                next_chunk = m_chunks.size();  // stop the other threads
+            }
+        };
+        const uint64_t num_threads = std::min<uint64_t>(m_num_threads, m_chunks.size());
+        std::vector<std::thread> threads;
+        threads.reserve(num_threads);
+        for (uint64_t i = 0; i != num_threads; ++i) threads.emplace_back(exe, i);
+        for (auto& t : threads) t.join();
+        if (exception) std::rethrow_exception(exception);
+    }
+
+private:
+    uint64_t m_num_threads;
+    std::vector<chunk> m_chunks;
+};
+
+/*
+    The number of k-mers of every unitig of the dictionary, to weight the unitigs in a
+    task_scheduler: the k-mers of a unitig have consecutive ids, after those of the
+    previous unitig, so only the first k-mer of every unitig is decoded.
+*/
+template <typename Dictionary>
+std::vector<uint32_t> unitig_sizes(Dictionary const& dict) {
+    const uint64_t num_unitigs = dict.num_contigs();
+    std::vector<uint32_t> sizes(num_unitigs);
+    uint64_t next_kmer_id = dict.size();
+    for (uint64_t unitig_id = num_unitigs; unitig_id-- != 0;) {
+        auto it = dict.at_contig_id(unitig_id);
+        const uint64_t kmer_id = it.next().first;
+        sizes[unitig_id] = next_kmer_id - kmer_id;
+        next_kmer_id = kmer_id;
+    }
+    return sizes;
+}
+
+}  // namespace fulgor
@@ -15,8 +15,10 @@
 
 namespace fulgor {
 
-enum index_t { HYBRID, DIFF, META, META_DIFF };
+enum index_t { HYBRID, DIFF, META, META_DIFF, ROARING };
 enum encoding_t { delta_gaps, bitmap, complement_delta_gaps, symmetric_difference };
+enum clustering_t { KMEANS, MINHASH };  // how the permuters cluster references and color sets
+enum tuning_t { NO_TUNING, SIZE, SPEED };  // what the thresholds of hybrid color sets minimize
 
 namespace constants {
 
@@ -27,13 +29,18 @@ static const std::string hfur_filename_extension("fur");
 static const std::string mfur_filename_extension("mfur");
 static const std::string dfur_filename_extension("dfur");
 static const std::string mdfur_filename_extension("mdfur");
+static const std::string rfur_filename_extension("rfur");
+static const std::string mrfur_filename_extension("mrfur");
 
 namespace current_version_number {
-constexpr uint8_t major = 4;
-constexpr uint8_t minor = 2;
+constexpr uint8_t major = 5;
+constexpr uint8_t minor = 0;
 constexpr uint8_t patch = 0;
 }  // namespace current_version_number
 
+/* indexes of version 4 only lack the color set id map (see index::u2c) */
+constexpr uint8_t oldest_readable_major_version = 4;
+
 }  // namespace constants
 
 struct build_configuration {
@@ -49,9 +56,20 @@ struct build_configuration {
         , check(false)
         //
         , meta_colored(false)
-        , diff_colored(false)  //
+        , diff_colored(false)
+        , roaring_colored(false)
+        , rebuild_k2u(false)
+        , resume(false)
+        , split_clusters(false)
+        , clustering(clustering_t::KMEANS)
+        , tune_for(tuning_t::NO_TUNING)  //
     {}
 
+    /* the RAM limit in bytes, split evenly among num_parts buffers */
+    uint64_t ram_limit_in_bytes(const uint64_t num_parts = 1) const {
+        return uint64_t(ram_limit_in_GiB) * essentials::GiB / std::max<uint64_t>(num_parts, 1);
+    }
+
     uint32_t k;            // kmer length
     uint32_t m;            // minimizer length
     uint32_t num_threads;  // for building and checking correctness
@@ -69,6 +87,12 @@ struct build_configuration {
 
     bool meta_colored;
     bool diff_colored;
+    bool roaring_colored;  // encode the color sets with roaring containers (see roaring)
+    bool rebuild_k2u;  // re-lay out the unitigs when the color sets are permuted
+    bool resume;       // reuse the stages completed by a previous run (see checkpoint)
+    bool split_clusters;  // give more representatives to heterogeneous clusters of color sets
+    clustering_t clustering;
+    tuning_t tune_for;
 };
 
 struct kmer_conservation_triple {
@@ -88,8 +112,67 @@ void print_cmd(int argc, char** argv) {
 
 std::string filename(std::string const& path) { return path.substr(path.find_last_of("/\\") + 1); }
 
+/* the colors removed from an index with the tool "remove", one per line */
+std::string removed_colors_filename(std::string const& index_filename) {
+    return index_filename + ".removed";
+}
+
+/* return the sorted removed colors of an index (none if the file does not exist) */
+std::vector<uint32_t> read_removed_colors(std::string const& index_filename) {
+    std::vector<uint32_t> colors;
+    std::ifstream in(removed_colors_filename(index_filename));
+    if (!in.is_open()) return colors;
+    uint32_t color = 0;
+    while (in >> color) colors.push_back(color);
+    std::sort(colors.begin(), colors.end());
+    colors.erase(std::unique(colors.begin(), colors.end()), colors.end());
+    return colors;
+}
+
+/* an index without removed colors has no such file: a stale one is deleted */
+void write_removed_colors(std::string const& index_filename, std::vector<uint32_t> const& colors) {
+    const std::string output_filename = removed_colors_filename(index_filename);
+    if (colors.empty()) {
+        std::remove(output_filename.c_str());
+        return;
+    }
+    /* write a new file and then replace the old one, so that it is never truncated */
+    const std::string tmp_filename = output_filename + ".tmp";
+    {
+        std::ofstream out(tmp_filename);
+        if (!out.is_open()) throw std::runtime_error("cannot open file '" + tmp_filename + "'");
+        for (auto color : colors) out << color << '\n';
+        out.flush();
+        if (!out) throw std::runtime_error("error in writing file '" + tmp_filename + "'");
+    }
+    if (std::rename(tmp_filename.c_str(), output_filename.c_str()) != 0) {
+        throw std::runtime_error("cannot write file '" + output_filename + "'");
+    }
+}
+
+/*
+    Carry the colors removed from an index over to an index built from it, where color c is
+    new_color[c], or is not present if new_color[c] is uint32_t(-1) (an empty new_color keeps
+    the colors as they are).
+*/
+void carry_removed_colors(std::string const& input_filename, std::string const& output_filename,
+                          std::vector<uint32_t> const& new_color = {}) {
+    std::vector<uint32_t> colors;
+    for (auto color : read_removed_colors(input_filename)) {
+        if (new_color.empty()) {
+            colors.push_back(color);
+            continue;
+        }
+        if (color >= new_color.size()) throw std::runtime_error("removed color out of bounds");
+        if (new_color[color] != uint32_t(-1)) colors.push_back(new_color[color]);
+    }
+    std::sort(colors.begin(), colors.end());
+    write_removed_colors(output_filename, colors);
+}
+
 void check_version_number(essentials::version_number const& vnum) {
-    if (vnum.x != constants::current_version_number::major) {
+    if (vnum.x < constants::oldest_readable_major_version or
+        vnum.x > constants::current_version_number::major) {
         throw std::runtime_error("MAJOR index version mismatch: Fulgor index needs rebuilding");
     }
 }
@@ -0,0 +1,555 @@
+#include <cstring>
+#include <map>
+#include <numeric>
+#include <random>
+#include <unordered_map>
+
+#include "include/index.hpp"
+
+namespace fulgor {
+
+/*
+    Estimate, for a .fur index, the size of its color sets and the time of a full-intersection
+    pseudoalignment with every type of index, without building them. Every type is built on
+    samples of the color sets, in memory:
+
+    - the size of the color sets is measured on a sample of the color sets and scaled by the
+      ratio between the hybrid color sets of the index and those of the sample;
+    - the time is measured on synthetic reads: a read hits a random unitig, then up to
+      num_color_sets_per_read - 1 random unitigs whose color sets share a color with the first,
+      so that reads pseudoalign (as reads sampled from the references do).
+
+    The references are permuted (and partitioned, for meta color sets) as the permuter does with
+    the clustering of build_configuration::clustering, the one the recommended index is built
+    with, on sketches of the sampled color sets instead of all the unitigs;
+    color sets (and partial color sets) are clustered as the differential permuter does. Since a
+    sample holds fewer similar color sets than the index, the meta and differential types are
+    estimated conservatively.
+
+    The intersections are those of src/ps_full_intersection.cpp, which must be included first.
+*/
+struct advisor {
+    static constexpr uint64_t default_sample_size = uint64_t(1) << 14;  // color sets
+    static constexpr uint64_t default_num_reads = 1000;
+    static constexpr uint64_t num_color_sets_per_read = 8;
+    static constexpr uint64_t max_sample_integers = uint64_t(1) << 26;  // in each sample
+    static constexpr uint64_t num_runs = 3;
+
+    struct estimate {
+        std::string name, extension;
+        uint64_t color_sets_bits;  // estimated for the whole index
+        uint64_t index_bits;       // estimated for the whole index
+        double nanosec_per_read;
+    };
+
+    advisor(hfur_index_t const& index, build_configuration const& build_config,
+            const uint64_t sample_size = default_sample_size,
+            const uint64_t num_reads = default_num_reads, const uint64_t seed = 0)
+        : m_index(index)
+        , m_build_config(build_config)
+        , m_sample_size(std::max<uint64_t>(sample_size, 1))
+        , m_num_reads(std::max<uint64_t>(num_reads, 1))
+        , m_seed(seed) {}
+
+    /* in the order: fur, rfur, mfur, mrfur, dfur, mdfur */
+    std::vector<estimate> run() {
+        essentials::timer<std::chrono::high_resolution_clock, std::chrono::seconds> timer;
+
+        essentials::logger("step 1. sampling color sets and reads");
+        timer.start();
+        sample_color_sets();
+        sample_reads();
+        timer.stop();
+        std::cout << "sampled " << m_sample.size() << " color sets and " << m_reads.size()
+                  << " reads (hitting " << m_read_color_sets.size() << " color sets)"
+                  << std::endl;
+        std::cout << "** sampling took " << timer.elapsed() << " seconds / "
+                  << timer.elapsed() / 60 << " minutes" << std::endl;
+        timer.reset();
+
+        essentials::logger("step 2. permuting and partitioning the references");
+        timer.start();
+        partition_references();
+        timer.stop();
+        std::cout << "num_partitions = " << m_partition_size.size() - 1 << std::endl;
+        std::cout << "** permuting took " << timer.elapsed() << " seconds / "
+                  << timer.elapsed() / 60 << " minutes" << std::endl;
+        timer.reset();
+
+        essentials::logger("step 3. encoding the sampled color sets");
+        timer.start();
+        encodings sample;
+        encode(m_sample, sample);
+        timer.stop();
+        std::cout << "** encoding took " << timer.elapsed() << " seconds / "
+                  << timer.elapsed() / 60 << " minutes" << std::endl;
+        timer.reset();
+
+        essentials::logger("step 4. benchmarking the reads");
+        timer.start();
+        encodings reads;
+        encode(m_read_color_sets, reads);
+        std::vector<estimate> estimates = {
+            {"hybrid", constants::hfur_filename_extension, sample.h.num_bits(), 0,
+             nanosec_per_read(reads.h)},
+            {"roaring", constants::rfur_filename_extension, sample.r.num_bits(), 0,
+             nanosec_per_read(reads.r)},
+            {"meta", constants::mfur_filename_extension, sample.mh.num_bits(), 0,
+             nanosec_per_read(reads.mh)},
+            {"meta-roaring", constants::mrfur_filename_extension, sample.mr.num_bits(), 0,
+             nanosec_per_read(reads.mr)},
+            {"differential", constants::dfur_filename_extension, sample.d.num_bits(), 0,
+             nanosec_per_read(reads.d, &reads.d_ids)},
+            {"meta-differential", constants::mdfur_filename_extension, sample.md.num_bits(), 0,
+             nanosec_per_read(reads.md, &reads.md_ids)},
+        };
+        timer.stop();
+        std::cout << "** benchmarking took " << timer.elapsed() << " seconds / "
+                  << timer.elapsed() / 60 << " minutes" << std::endl;
+
+        /* scale the sample to the index */
+        const uint64_t color_sets_bits = m_index.get_color_sets().num_bits();
+        const uint64_t other_bits = m_index.num_bits() - color_sets_bits;
+        const double scale = static_cast<double>(color_sets_bits) / sample.h.num_bits();
+        for (auto& e : estimates) {
+            e.color_sets_bits = std::llround(e.color_sets_bits * scale);
+            e.index_bits = other_bits + e.color_sets_bits;
+        }
+        return estimates;
+    }
+
+private:
+    typedef std::vector<std::vector<uint32_t>> color_sets_t;  // sorted colors
+
+    hfur_index_t const& m_index;
+    build_configuration m_build_config;
+    uint64_t m_sample_size, m_num_reads, m_seed;
+
+    color_sets_t m_sample, m_read_color_sets;
+    std::vector<std::vector<uint32_t>> m_reads;  // positions in m_read_color_sets
+
+    std::vector<uint32_t> m_permutation;     // new color of every color
+    std::vector<uint32_t> m_partition_size;  // prefix sums, as permuter::partition_size()
+
+    struct encodings {
+        hybrid h;
+        roaring r;
+        meta<hybrid> mh;
+        meta<roaring> mr;
+        differential d;
+        meta_differential md;
+        std::vector<uint32_t> d_ids, md_ids;  // the id of every color set in d and md
+    };
+
+    /* the partial color sets of every partition, coded once each */
+    struct partial_color_sets {
+        std::vector<color_sets_t> partials;  // colors relative to the partition
+        std::vector<std::vector<std::pair<uint32_t, uint32_t>>> meta_color_sets;  // (p, id)
+    };
+
+    /* the builders of color sets report their statistics on std::cout */
+    struct mute_stdout {
+        mute_stdout() : m_buf(std::cout.rdbuf(nullptr)) {}
+        ~mute_stdout() { std::cout.rdbuf(m_buf); }
+
+    private:
+        std::streambuf* m_buf;
+    };
+
+    std::vector<uint32_t> decode(const uint64_t color_set_id) const {
+        auto it = m_index.color_set(color_set_id);
+        const uint64_t size = it.size();
+        std::vector<uint32_t> color_set(size);
+        for (uint64_t i = 0; i != size; ++i, ++it) color_set[i] = *it;
+        return color_set;
+    }
+
+    /* every step-th color set, with the step grown to fit in max_sample_integers */
+    void sample_color_sets() {
+        const uint64_t num_color_sets = m_index.num_color_sets();
+        uint64_t step = std::max<uint64_t>(1, num_color_sets / m_sample_size);
+        uint64_t num_integers = 0;
+        for (uint64_t id = 0; id < num_color_sets; id += step) {
+            num_integers += m_index.color_set(id).size();
+        }
+        if (num_integers > max_sample_integers) {
+            step = std::ceil(static_cast<double>(step) * num_integers / max_sample_integers);
+        }
+        for (uint64_t id = 0; id < num_color_sets; id += step) {
+            auto color_set = decode(id);
+            if (!color_set.empty()) m_sample.push_back(std::move(color_set));
+        }
+    }
+
+    void sample_reads() {
+        const uint64_t num_unitigs = m_index.num_unitigs();
+        std::mt19937_64 rng(m_seed);
+        std::unordered_map<uint64_t, uint32_t> positions;  // of the color sets in the reads
+        uint64_t num_integers = 0;
+
+        auto add = [&](std::vector<uint32_t>& read, const uint64_t color_set_id) {
+            auto [it, inserted] = positions.emplace(color_set_id, m_read_color_sets.size());
+            if (inserted) {
+                m_read_color_sets.push_back(decode(color_set_id));
+                num_integers += m_read_color_sets.back().size();
+            }
+            read.push_back(it->second);
+        };
+
+        const uint64_t max_attempts = 16 * num_color_sets_per_read;
+        while (m_reads.size() != m_num_reads and num_integers < max_sample_integers) {
+            const uint64_t color_set_id = m_index.u2c(rng() % num_unitigs);
+            auto it = m_index.color_set(color_set_id);
+            const uint64_t size = it.size();
+            if (size == 0) continue;
+            for (uint64_t i = rng() % size; i != 0; --i) ++it;
+            const uint64_t color = *it;
+
+            std::vector<uint32_t> read;
+            add(read, color_set_id);
+            for (uint64_t attempt = 0;
+                 attempt != max_attempts and read.size() != num_color_sets_per_read; ++attempt) {
+                const uint64_t other_id = m_index.u2c(rng() % num_unitigs);
+                auto other_it = m_index.color_set(other_id);
+                other_it.next_geq(color);
+                if (*other_it == color) add(read, other_id);
+            }
+            m_reads.push_back(std::move(read));
+        }
+    }
+
+    /*
+        Cluster the sets (of sampled color set ids for references, of colors for color sets)
+        with the clustering of m_build_config and the same parameters as the permuters.
+        The cluster sizes only bound the LSH clustering, as k-means does not split clusters
+        smaller than min_cluster_size.
+    */
+    kmeans::cluster_data cluster(color_sets_t const& sets, const uint64_t min_cluster_size,
+                                 const uint64_t max_cluster_size) const {
+        if (m_build_config.clustering == clustering_t::MINHASH) {
+            minhash_sketches sketches(sets.size());
+            for (uint64_t i = 0; i != sets.size(); ++i) {
+                for (auto x : sets[i]) {
+                    minhash_sketches::add(sketches[i], minhash_sketches::hash(x));
+                }
+            }
+            lsh_clustering_parameters params;
+            params.num_threads = m_build_config.num_threads;
+            params.min_cluster_size = std::max<uint64_t>(min_cluster_size, 1);
+            params.max_cluster_size = max_cluster_size;
+            return cluster_minhash_sketches(sketches, params);
+        }
+
+        constexpr uint64_t p = 10;  // use 2^p bytes per HLL sketch
+        std::vector<kmeans::point> points(sets.size(), kmeans::point(1ULL << p));
+        for (uint64_t i = 0; i != sets.size(); ++i) {
+            sketch::hll_t sketch(p);
+            for (auto x : sets[i]) sketch.addh(x);
+            std::memcpy(points[i].data(), sketch.data(), 1ULL << p);
+        }
+        kmeans::clustering_parameters params;
+        constexpr float min_delta = 0.0001;
+        constexpr float max_iteration = 10;
+        constexpr uint64_t seed = 0;
+        params.set_min_delta(min_delta);
+        params.set_max_iteration(max_iteration);
+        params.set_min_cluster_size(min_cluster_size);
+        params.set_random_seed(seed);
+        params.set_num_threads(m_build_config.num_threads);
+        return kmeans::kmeans_divisive(points.begin(), points.end(), params);
+    }
+
+    /* as permuter::cluster_kmeans or permuter::cluster_minhash, on the sampled color sets
+       instead of the unitigs */
+    void partition_references() {
+        static constexpr uint64_t min_cluster_size = 50;  // as permuter
+        const uint64_t num_colors = m_index.num_colors();
+        color_sets_t references(num_colors);  // the sampled color sets of every reference
+        for (uint64_t i = 0; i != m_sample.size(); ++i) {
+            for (auto color : m_sample[i]) references[color].push_back(i);
+        }
+        const uint64_t max_cluster_size = std::max<uint64_t>(
+            2 * min_cluster_size, 4 * std::sqrt(static_cast<double>(num_colors)));
+        auto clustering_data = cluster(references, min_cluster_size, max_cluster_size);
+
+        m_partition_size.assign(clustering_data.num_clusters + 1, 0);
+        for (auto c : clustering_data.clusters) m_partition_size[c] += 1;
+        uint64_t val = 0;
+        for (auto& size : m_partition_size) {
+            uint64_t tmp = size;
+            size = val;
+            val += tmp;
+        }
+        auto counts = m_partition_size;  // copy
+        m_permutation.resize(num_colors);
+        for (uint64_t i = 0; i != num_colors; ++i) {
+            m_permutation[i] = counts[clustering_data.clusters[i]]++;
+        }
+    }
+
+    color_sets_t permute(color_sets_t const& color_sets) const {
+        color_sets_t permuted(color_sets.size());
+        for (uint64_t i = 0; i != color_sets.size(); ++i) {
+            auto& color_set = permuted[i];
+            color_set.reserve(color_sets[i].size());
+            for (auto color : color_sets[i]) color_set.push_back(m_permutation[color]);
+            std::sort(color_set.begin(), color_set.end());
+        }
+        return permuted;
+    }
+
+    partial_color_sets split(color_sets_t const& permuted) const {
+        const uint64_t num_partitions = m_partition_size.size() - 1;
+        partial_color_sets p;
+        p.partials.resize(num_partitions);
+        p.meta_color_sets.resize(permuted.size());
+        std::vector<std::map<std::vector<uint32_t>, uint32_t>> ids(num_partitions);
+        std::vector<uint32_t> partial;
+        for (uint64_t i = 0; i != permuted.size(); ++i) {
+            auto const& color_set = permuted[i];
+            for (uint64_t j = 0; j != color_set.size();) {
+                const uint32_t partition_id =
+                    std::upper_bound(m_partition_size.begin(), m_partition_size.end(),
+                                     color_set[j]) -
+                    m_partition_size.begin() - 1;
+                const uint32_t min_color = m_partition_size[partition_id];
+                const uint32_t max_color = m_partition_size[partition_id + 1];
+                partial.clear();
+                for (; j != color_set.size() and color_set[j] < max_color; ++j) {
+                    partial.push_back(color_set[j] - min_color);
+                }
+                auto [it, inserted] =
+                    ids[partition_id].emplace(partial, p.partials[partition_id].size());
+                if (inserted) p.partials[partition_id].push_back(partial);
+                p.meta_color_sets[i].emplace_back(partition_id, it->second);
+            }
+        }
+        return p;
+    }
+
+    void encode(color_sets_t const& color_sets, encodings& e) const {
+        mute_stdout mute;
+        const uint64_t num_colors = m_index.num_colors();
+
+        hybrid::builder hb(num_colors);
+        auto const& h = m_index.get_color_sets();
+        hb.set_thresholds(h.sparse_set_threshold_size(), h.very_dense_set_threshold_size());
+        for (auto const& color_set : color_sets) {
+            hb.encode_color_set(color_set.data(), color_set.size());
+        }
+        hb.build(e.h);
+
+        auto permuted = permute(color_sets);
+        roaring::builder rb(num_colors);
+        for (auto const& color_set : permuted) {
+            rb.encode_color_set(color_set.data(), color_set.size());
+        }
+        rb.build(e.r);
+
+        auto p = split(permuted);
+        encode_meta(p, e.mh);
+        encode_meta(p, e.mr);
+        encode_differential(color_sets, num_colors, e.d, e.d_ids);
+        encode_meta_differential(p, e.md, e.md_ids);
+    }
+
+    template <typename ColorSets>
+    void encode_meta(partial_color_sets const& p, meta<ColorSets>& m) const {
+        const uint64_t num_partitions = m_partition_size.size() - 1;
+        typename meta<ColorSets>::builder b;
+        b.init_color_sets_builder(m_index.num_colors(), num_partitions);
+        std::vector<uint32_t> num_sets_in_partitions(num_partitions);
+        std::vector<uint32_t> num_sets_before(num_partitions);
+        uint64_t num_partial_color_sets = 0;
+        for (uint64_t partition_id = 0; partition_id != num_partitions; ++partition_id) {
+            b.init_partition(partition_id,
+                             m_partition_size[partition_id + 1] - m_partition_size[partition_id]);
+            for (auto const& partial : p.partials[partition_id]) {
+                b.encode_color_set(partition_id, partial.data(), partial.size());
+            }
+            num_sets_in_partitions[partition_id] = p.partials[partition_id].size();
+            num_sets_before[partition_id] = num_partial_color_sets;
+            num_partial_color_sets += p.partials[partition_id].size();
+        }
+
+        uint64_t num_integers = 0;
+        for (auto const& meta_color_set : p.meta_color_sets) {
+            num_integers += meta_color_set.size() + 1;
+        }
+        /* one more, so that the width fits the sizes of the meta color sets of small samples */
+        b.init_meta_color_sets_builder(num_integers, num_partial_color_sets + 1, m_partition_size,
+                                       num_sets_in_partitions);
+        std::vector<uint32_t> meta_color_set;
+        for (auto const& pairs : p.meta_color_sets) {
+            meta_color_set.clear();
+            for (auto [partition_id, id] : pairs) {
+                meta_color_set.push_back(num_sets_before[partition_id] + id);
+            }
+            b.encode_metacolor_set(meta_color_set.data(), meta_color_set.size());
+        }
+        b.build(m);
+    }
+
+    /*
+        As the differential permuter with --clustering minhash: the color sets are clustered in
+        slices of sizes and every cluster is coded with the representative that takes the
+        fewest bits. ids[i] is set to the id of the i-th color set in d.
+    */
+    void encode_differential(color_sets_t const& color_sets, const uint64_t num_colors,
+                             differential& d, std::vector<uint32_t>& ids) const {
+        hybrid h;
+        hybrid::builder hb(num_colors);
+        for (auto const& color_set : color_sets) {
+            hb.encode_color_set(color_set.data(), color_set.size());
+        }
+        hb.build(h);
+
+        const std::vector<float> slices = {0, 0.25, 0.5, 0.75, 1};
+        std::vector<std::pair<uint64_t, uint32_t>> permutation;  // (cluster, color set)
+        uint64_t num_clusters = 0;
+        for (uint64_t slice_id = 0; slice_id != slices.size() - 1; ++slice_id) {
+            const double min_size = slices[slice_id] * num_colors;
+            const double max_size = slices[slice_id + 1] * num_colors;
+            std::vector<uint32_t> slice;
+            for (uint64_t i = 0; i != color_sets.size(); ++i) {
+                const uint64_t size = color_sets[i].size();
+                if (size > min_size and size <= max_size) slice.push_back(i);
+            }
+            if (slice.empty()) continue;
+            color_sets_t slice_color_sets;
+            slice_color_sets.reserve(slice.size());
+            for (auto i : slice) slice_color_sets.push_back(color_sets[i]);
+            auto clustering_data = cluster(
+                slice_color_sets, 0,
+                std::max<uint64_t>(1, 4 * std::sqrt(static_cast<double>(slice.size()))));
+            for (uint64_t i = 0; i != slice.size(); ++i) {
+                permutation.emplace_back(num_clusters + clustering_data.clusters[i], slice[i]);
+            }
+            num_clusters += clustering_data.num_clusters;
+        }
+        std::sort(permutation.begin(), permutation.end());
+
+        differential::builder b(num_colors);
+        differential::representative_optimizer optimizer(num_colors);
+        std::vector<uint32_t> representative;
+        ids.resize(color_sets.size());
+        for (uint64_t begin = 0; begin != permutation.size();) {
+            uint64_t end = begin;
+            while (end != permutation.size() and
+                   permutation[end].first == permutation[begin].first) {
+                ++end;
+            }
+            auto get = [&](uint64_t i) { return h.color_set(permutation[begin + i].second); };
+            optimizer.optimize(end - begin, get, representative);
+            b.process_partition(representative);
+            for (uint64_t i = begin; i != end; ++i) {
+                auto it = h.color_set(permutation[i].second);
+                b.process_color_set(it);
+                ids[permutation[i].second] = i;
+            }
+            begin = end;
+        }
+        b.build(d);
+    }
+
+    /* ids[i] is set to the id of the i-th color set in md */
+    void encode_meta_differential(partial_color_sets const& p, meta_differential& md,
+                                  std::vector<uint32_t>& ids) const {
+        const uint64_t num_partitions = m_partition_size.size() - 1;
+        meta_differential::builder b;
+        b.init(m_index.num_colors(), num_partitions);
+        std::vector<std::vector<uint32_t>> relative_ids(num_partitions);
+        for (uint64_t partition_id = 0; partition_id != num_partitions; ++partition_id) {
+            differential d;
+            const uint64_t num_colors_in_partition =
+                m_partition_size[partition_id + 1] - m_partition_size[partition_id];
+            /* a partition that no sampled color set touches still needs a differential */
+            if (p.partials[partition_id].empty()) {
+                encode_differential(color_sets_t(1, {0}), num_colors_in_partition, d,
+                                    relative_ids[partition_id]);
+            } else {
+                encode_differential(p.partials[partition_id], num_colors_in_partition, d,
+                                    relative_ids[partition_id]);
+            }
+            b.process_partition(d);
+        }
+
+        /* the meta color sets are grouped by their set of partitions */
+        auto const& meta_color_sets = p.meta_color_sets;
+        auto same_partitions = [&](uint32_t x, uint32_t y) {
+            return std::equal(meta_color_sets[x].begin(), meta_color_sets[x].end(),
+                              meta_color_sets[y].begin(), meta_color_sets[y].end(),
+                              [](auto const& a, auto const& b) { return a.first == b.first; });
+        };
+        std::vector<uint32_t> order(meta_color_sets.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](uint32_t x, uint32_t y) {
+            return std::lexicographical_compare(
+                meta_color_sets[x].begin(), meta_color_sets[x].end(), meta_color_sets[y].begin(),
+                meta_color_sets[y].end(),
+                [](auto const& a, auto const& b) { return a.first < b.first; });
+        });
+        uint64_t num_partition_sets = 0;
+        for (uint64_t k = 0; k != order.size(); ++k) {
+            if (k == 0 or !same_partitions(order[k - 1], order[k])) ++num_partition_sets;
+        }
+        b.init_meta_color_partition_sets(num_partition_sets);
+
+        std::vector<uint32_t> partition_set, relative_colors;
+        ids.resize(meta_color_sets.size());
+        for (uint64_t k = 0; k != order.size(); ++k) {
+            auto const& pairs = meta_color_sets[order[k]];
+            if (k == 0 or !same_partitions(order[k - 1], order[k])) {
+                partition_set.clear();
+                for (auto [partition_id, id] : pairs) partition_set.push_back(partition_id);
+                b.process_meta_color_partition_set(partition_set);
+            }
+            relative_colors.clear();
+            for (auto [partition_id, id] : pairs) {
+                relative_colors.push_back(relative_ids[partition_id][id]);
+            }
+            b.process_metacolor_set(relative_colors);
+            ids[order[k]] = k;
+        }
+        b.build(md);
+    }
+
+    /* as index::pseudoalign_full_intersection, on the color sets of the sampled reads */
+    template <typename ColorSets>
+    double nanosec_per_read(ColorSets const& color_sets,
+                            std::vector<uint32_t> const* ids = nullptr) const {
+        std::vector<typename ColorSets::iterator_type> iterators;
+        std::vector<uint32_t> colors, tmp;
+        uint64_t sink = 0;
+        essentials::timer<std::chrono::high_resolution_clock, std::chrono::nanoseconds> timer;
+        for (uint64_t run = 0; run != num_runs; ++run) {
+            timer.start();
+            for (auto const& read : m_reads) {
+                iterators.clear();
+                for (auto i : read) iterators.push_back(color_sets.color_set(ids ? (*ids)[i] : i));
+                colors.clear();
+                tmp.clear();
+                if constexpr (ColorSets::type == index_t::META) {
+                    meta_intersect<typename ColorSets::iterator_type, false>(iterators, colors,
+                                                                             tmp);
+                } else if constexpr (ColorSets::type == index_t::META_DIFF) {
+                    meta_intersect<typename ColorSets::iterator_type, true>(iterators, colors,
+                                                                            tmp);
+                } else if constexpr (ColorSets::type == index_t::DIFF) {
+                    diff_intersect(iterators, colors);
+                } else if constexpr (ColorSets::type == index_t::ROARING) {
+                    roaring_intersect(iterators, colors);
+                } else if constexpr (ColorSets::type == index_t::HYBRID) {
+                    intersect(iterators, colors, tmp);
+                }
+                sink += colors.size();
+            }
+            timer.stop();
+        }
+        volatile uint64_t result = sink;  // so that the intersections are not optimized away
+        (void)result;
+        return timer.elapsed() / (num_runs * m_reads.size());
+    }
+};
+
+}  // namespace fulgor
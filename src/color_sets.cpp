@@ -1,6 +1,7 @@
 #include "include/color_sets/hybrid.hpp"
 #include "include/color_sets/differential.hpp"
 #include "include/color_sets/meta.hpp"
+#include "include/color_sets/roaring.hpp"
 #include "include/color_sets/meta_differential.hpp"
 
 namespace fulgor {
@@ -80,6 +81,48 @@ void hybrid::print_stats() const  //
               << " bits/int" << std::endl;
 }
 
+void roaring::print_stats() const  //
+{
+    static const char* container_names[] = {"array", "bitmap", "run"};
+    uint64_t num_containers[3] = {};
+    uint64_t num_bits_per_container[3] = {};
+    uint64_t num_ints_per_container[3] = {};
+
+    uint64_t num_total_integers = 0;
+    for (uint64_t color_set_id = 0; color_set_id != num_color_sets(); ++color_set_id) {
+        auto it = color_set(color_set_id);
+        num_total_integers += it.size();
+        for (; it.container_key() != it.num_keys(); it.next_container()) {
+            const int type = it.container_type();
+            std::vector<interval> intervals;
+            it.container_intervals(intervals);
+            num_containers[type] += 1;
+            num_bits_per_container[type] += it.container_num_bits();
+            for (auto const& x : intervals) num_ints_per_container[type] += x.end - x.begin;
+        }
+    }
+
+    std::cout << "Color sets space breakdown:\n";
+    const uint64_t total_bits = num_bits();
+    const uint64_t total_containers = num_containers[0] + num_containers[1] + num_containers[2];
+    for (int type = 0; type != 3; ++type) {
+        if (num_containers[type] == 0) continue;
+        const uint64_t n = num_ints_per_container[type];
+        std::cout << "  num. " << container_names[type] << " containers: " << num_containers[type]
+                  << " (" << (num_containers[type] * 100.0) / total_containers
+                  << "%) -- integers: " << n << " (" << (n * 100.0) / num_total_integers
+                  << "%) -- bits/int: " << static_cast<double>(num_bits_per_container[type]) / n
+                  << " -- "
+                  << static_cast<double>(num_bits_per_container[type]) / total_bits * 100.0
+                  << "\% of total space" << '\n';
+    }
+    std::cout << "  colors: " << (8.0 * m_color_sets.num_bytes()) / num_total_integers
+              << " bits/int" << std::endl;
+    std::cout << "  offsets: "
+              << ((sizeof(m_num_colors) + m_offsets.num_bytes()) * 8.0) / num_total_integers
+              << " bits/int" << std::endl;
+}
+
 template <typename ColorSets>
 void meta<ColorSets>::print_stats() const  //
 {
@@ -96,15 +139,17 @@ void meta<ColorSets>::print_stats() const  //
         // pcs.print_stats();
         const uint64_t n = pcs.num_color_sets();
         num_total_partial_colors += n;
-        for (uint64_t i = 0; i != n; ++i) {
-            auto it = pcs.color_set(i);
-            if (it.encoding_type() == encoding_t::complement_delta_gaps) {
-                ++num_partial_color_sets_very_dense;
-            } else if (it.encoding_type() == encoding_t::bitmap) {
-                ++num_partial_color_sets_dense;
-            } else {
-                assert(it.encoding_type() == encoding_t::delta_gaps);
-                ++num_partial_color_sets_sparse;
+        if constexpr (ColorSets::type == index_t::HYBRID) {
+            for (uint64_t i = 0; i != n; ++i) {
+                auto it = pcs.color_set(i);
+                if (it.encoding_type() == encoding_t::complement_delta_gaps) {
+                    ++num_partial_color_sets_very_dense;
+                } else if (it.encoding_type() == encoding_t::bitmap) {
+                    ++num_partial_color_sets_dense;
+                } else {
+                    assert(it.encoding_type() == encoding_t::delta_gaps);
+                    ++num_partial_color_sets_sparse;
+                }
             }
         }
 
@@ -114,18 +159,22 @@ void meta<ColorSets>::print_stats() const  //
     assert(num_total_partial_colors > 0);
     assert(num_bits() > 0);
 
-    std::cout << "  num_partial_color_sets_very_dense = " << num_partial_color_sets_very_dense
-              << " / " << num_total_partial_colors << " ("
-              << (num_partial_color_sets_very_dense * 100.0) / num_total_partial_colors << "%)"
-              << std::endl;
-    std::cout << "  num_partial_color_sets_dense = " << num_partial_color_sets_dense << " / "
-              << num_total_partial_colors << " ("
-              << (num_partial_color_sets_dense * 100.0) / num_total_partial_colors << "%)"
-              << std::endl;
-    std::cout << "  num_partial_color_sets_sparse = " << num_partial_color_sets_sparse << " / "
-              << num_total_partial_colors << " ("
-              << (num_partial_color_sets_sparse * 100.0) / num_total_partial_colors << "%)"
-              << std::endl;
+    if constexpr (ColorSets::type == index_t::HYBRID) {
+        std::cout << "  num_partial_color_sets_very_dense = " << num_partial_color_sets_very_dense
+                  << " / " << num_total_partial_colors << " ("
+                  << (num_partial_color_sets_very_dense * 100.0) / num_total_partial_colors << "%)"
+                  << std::endl;
+        std::cout << "  num_partial_color_sets_dense = " << num_partial_color_sets_dense << " / "
+                  << num_total_partial_colors << " ("
+                  << (num_partial_color_sets_dense * 100.0) / num_total_partial_colors << "%)"
+                  << std::endl;
+        std::cout << "  num_partial_color_sets_sparse = " << num_partial_color_sets_sparse << " / "
+                  << num_total_partial_colors << " ("
+                  << (num_partial_color_sets_sparse * 100.0) / num_total_partial_colors << "%)"
+                  << std::endl;
+    } else {
+        std::cout << "  num_partial_color_sets = " << num_total_partial_colors << std::endl;
+    }
 
     std::cout << "  partial colors: " << num_bits_colors / 8 << " bytes ("
               << (num_bits_colors * 100.0) / num_bits() << "%)\n";
@@ -210,6 +259,27 @@ void differential::print_stats() const  //
         distribution[q]++;
     }
 
+    /* the bits that the representatives chosen by majority vote would take in each cluster */
+    uint64_t num_majority_bits = 0;
+    uint64_t num_ints = 0;
+    {
+        representative_optimizer optimizer(num_colors());
+        for (uint64_t begin = 0; begin != num_color_sets();) {
+            const uint64_t cluster_id = m_clusters_rank1_index.rank1(m_clusters, begin);
+            uint64_t end = begin + 1;
+            while (end != num_color_sets() and
+                   m_clusters_rank1_index.rank1(m_clusters, end) == cluster_id) {
+                ++end;
+            }
+            num_majority_bits += optimizer.majority_bits(
+                end - begin, [&](uint64_t i) { return color_set(begin + i); });
+            for (uint64_t id = begin; id != end; ++id) num_ints += color_set(id).size();
+            begin = end;
+        }
+    }
+    const uint64_t num_encoded_bits =
+        num_representatives + num_differential_color_sets + num_metadata;
+
     assert(num_bits() > 0);
     assert(num_bits_color_sets > 0);
 
@@ -232,6 +302,13 @@ void differential::print_stats() const  //
               << (num_differential_color_sets * 100.0) / num_bits_color_sets << "%)" << std::endl;
     std::cout << "    metadata: " << num_metadata / 8 << " bytes ("
               << (num_metadata * 100.0) / num_bits_color_sets << "%)" << std::endl;
+    if (num_ints != 0 and num_majority_bits != 0) {
+        std::cout << "  representatives chosen by encoding cost: "
+                  << num_encoded_bits * 1.0 / num_ints << " bits/int (majority vote: "
+                  << num_majority_bits * 1.0 / num_ints << " bits/int, "
+                  << 100.0 - (num_encoded_bits * 100.0) / num_majority_bits << "% smaller)"
+                  << std::endl;
+    }
     std::cout << "  differential color sets size distribution:" << std::endl;
     for (uint64_t partition = 0; partition < distribution.size(); partition++) {
         std::cout << distribution[partition] << " ";
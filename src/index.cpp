@@ -9,6 +9,7 @@ void index<ColorSets>::print_stats() const {
     auto const& k2u = get_k2u();
     auto const& u2c = get_u2c();
     auto const& u2c_rank1_index = get_u2c_rank1_index();
+    auto const& u2c_map = get_u2c_map();
     auto const& color_sets = get_color_sets();
     auto const& filenames = get_filenames();
 
@@ -21,17 +22,15 @@ void index<ColorSets>::print_stats() const {
     std::cout << "  Color sets: " << color_sets.num_bits() / 8 << " bytes / "
               << essentials::convert(color_sets.num_bits() / 8, essentials::GB) << " GB ("
               << (color_sets.num_bits() * 100.0) / total_bits << "%)\n";
-    uint64_t other_bits =
-        (u2c.num_bytes() + u2c_rank1_index.num_bytes()) * 8 + filenames.num_bits();
+    const uint64_t u2c_bytes =
+        u2c.num_bytes() + u2c_rank1_index.num_bytes() + u2c_map.num_bytes();
+    uint64_t other_bits = u2c_bytes * 8 + filenames.num_bits();
     std::cout << "  Other: " << other_bits / 8 << " bytes / "
               << essentials::convert(other_bits / 8, essentials::GB) << " GB ("
               << (other_bits * 100.0) / total_bits << "%)\n";
-    std::cout << "    Map from unitig_id to color_set_id: "
-              << u2c.num_bytes() + u2c_rank1_index.num_bytes() << " bytes / "
-              << essentials::convert(u2c.num_bytes() + u2c_rank1_index.num_bytes(), essentials::GB)
-              << " GB ("
-              << ((u2c.num_bytes() + u2c_rank1_index.num_bytes()) * 8 * 100.0) / total_bits
-              << "%)\n";
+    std::cout << "    Map from unitig_id to color_set_id: " << u2c_bytes << " bytes / "
+              << essentials::convert(u2c_bytes, essentials::GB) << " GB ("
+              << (u2c_bytes * 8 * 100.0) / total_bits << "%)\n";
     std::cout << "    filenames: " << filenames.num_bits() / 8 << " bytes / "
               << essentials::convert(filenames.num_bits() / 8, essentials::GB) << " GB ("
               << (filenames.num_bits() * 100.0) / total_bits << "%)\n";
@@ -223,8 +222,7 @@ void index<ColorSets>::load(build_configuration const& build_config)  //
         timer.start();
 
         typename ColorSets::builder color_sets_builder(num_colors);
-        const uint64_t num_bits = essentials::GiB * 8 * 8;
-        color_sets_builder.reserve_num_bits(num_bits);
+        color_sets_builder.reserve_num_bits(build_config.ram_limit_in_bytes(2) * 8);
 
         std::string color_sets_fn = build_config.file_base_name + ".color_sets.txt";
         std::ifstream in(color_sets_fn);
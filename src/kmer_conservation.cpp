@@ -31,9 +31,17 @@ void index<ColorSets>::kmer_conservation(
         char const* kmer = sequence.data() + i;
         auto answer = query.lookup_advanced(kmer);
 
-        if (answer.kmer_id != sshash::constants::invalid_uint64) {  // kmer is positive
+        uint64_t color_set_id = invalid;
+        if (answer.kmer_id != sshash::constants::invalid_uint64) {
+            color_set_id = u2c(answer.contig_id);
+            /* a k-mer of removed references only is negative */
+            if (has_removed_colors() and color_set_id != prev_color_set_id and
+                only_removed_colors(color_set_id)) {
+                color_set_id = invalid;
+            }
+        }
 
-            uint64_t color_set_id = u2c(answer.contig_id);
+        if (color_set_id != invalid) {  // kmer is positive
             if (prev_color_set_id != color_set_id) {
                 push_triple();
                 kct.num_kmers = 0;
@@ -20,13 +20,22 @@ void index<ColorSets>::kmer_matches(std::string const& sequence,
         char const* kmer = sequence.data() + i;
         auto answer = query.lookup_advanced(kmer);
         if (answer.kmer_id != sshash::constants::invalid_uint64) {  // kmer is positive
-            positive_kmers_in_sequence.set(i);
             uint64_t color_set_id = u2c(answer.contig_id);
+            /* a k-mer of removed references only is negative */
+            if (has_removed_colors() and only_removed_colors(color_set_id)) continue;
+            positive_kmers_in_sequence.set(i);
             auto it = color_set(color_set_id);
             uint64_t color_set_size = it.size();
             for (uint64_t i = 0; i != color_set_size; ++i, ++it) counts[*it] += 1;
         }
     }
+
+    /* the removed references match no k-mer */
+    if (has_removed_colors()) {
+        for (uint64_t color = 0; color != counts.size(); ++color) {
+            if (is_removed(color)) counts[color] = 0;
+        }
+    }
 }
 
 }  // namespace fulgor
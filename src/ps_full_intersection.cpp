@@ -331,6 +331,57 @@ void meta_intersect(std::vector<Iterator>& iterators, std::vector<uint32_t>& col
     }
 }
 
+/*
+    Intersect roaring color sets by container: step 1 finds the keys of the containers in
+    common, as meta_intersect does for partitions; step 2 intersects the intervals of the
+    smallest container of a key with the other containers of the key, a run at a time.
+*/
+template <typename Iterator>
+void roaring_intersect(std::vector<Iterator>& iterators, std::vector<uint32_t>& colors) {
+    assert(colors.empty());
+
+    if (iterators.empty()) return;
+
+    std::sort(iterators.begin(), iterators.end(),
+              [](auto const& x, auto const& y) { return x.size() < y.size(); });
+
+    const uint32_t num_keys = iterators[0].num_keys();
+    std::vector<roaring::interval> intervals, tmp;
+    uint32_t candidate = iterators[0].container_key();
+    uint64_t i = 1;
+    while (candidate < num_keys) {
+        for (; i != iterators.size(); ++i) {
+            iterators[i].next_geq_container(candidate);
+            uint32_t key = iterators[i].container_key();
+            if (key != candidate) {
+                candidate = key;
+                i = 0;
+                break;
+            }
+        }
+        if (i == iterators.size()) {
+            auto smallest = std::min_element(
+                iterators.begin(), iterators.end(), [](auto const& x, auto const& y) {
+                    return x.container_num_bits() < y.container_num_bits();
+                });
+            intervals.clear();
+            smallest->container_intervals(intervals);
+            for (auto it = iterators.begin(); it != iterators.end() and !intervals.empty(); ++it) {
+                if (it == smallest) continue;
+                tmp.clear();
+                it->intersect_container(intervals, tmp);
+                intervals.swap(tmp);
+            }
+            for (auto const& x : intervals) {
+                for (uint32_t color = x.begin; color != x.end; ++color) colors.push_back(color);
+            }
+            iterators[0].next_container();
+            candidate = iterators[0].container_key();
+            i = 1;
+        }
+    }
+}
+
 template <typename ColorSets>
 void index<ColorSets>::fetch_color_set_ids(std::string const& sequence,
                                            std::vector<uint32_t>& color_set_ids) const {
@@ -377,6 +428,15 @@ template <typename ColorSets>
 void index<ColorSets>::pseudoalign_full_intersection(std::vector<uint32_t>& color_set_ids,
                                                      std::vector<uint32_t>& colors,
                                                      std::vector<uint32_t>& tmp) const {
+    if (has_removed_colors()) {
+        /* the k-mers whose colors were all removed are treated as negative */
+        color_set_ids.erase(std::remove_if(color_set_ids.begin(), color_set_ids.end(),
+                                           [&](uint32_t color_set_id) {
+                                               return only_removed_colors(color_set_id);
+                                           }),
+                            color_set_ids.end());
+    }
+
     std::vector<typename ColorSets::iterator_type> iterators;
     iterators.reserve(color_set_ids.size());
     for (auto color_set_id : color_set_ids) {
@@ -392,11 +452,14 @@ void index<ColorSets>::pseudoalign_full_intersection(std::vector<uint32_t>& colo
         meta_intersect<typename ColorSets::iterator_type, true>(iterators, colors, tmp);
     } else if constexpr (ColorSets::type == index_t::DIFF) {
         diff_intersect(iterators, colors);
+    } else if constexpr (ColorSets::type == index_t::ROARING) {
+        roaring_intersect(iterators, colors);
     } else if constexpr (ColorSets::type == index_t::HYBRID) {
         intersect(iterators, colors, tmp);
     }
 
     assert(util::check_intersection(iterators, colors));
+    if (has_removed_colors()) erase_removed_colors(colors);
 }
 
 }  // namespace fulgor
@@ -39,6 +39,37 @@ void merge(std::vector<Iterator>& iterators, std::vector<uint32_t>& colors, int6
     }
 }
 
+/*
+    Every run of colors of a color set adds its score to the start of the run and subtracts
+    it after the end: the score of a color is the prefix sum of these differences, so long
+    runs cost as much as short ones.
+*/
+template <typename Iterator>
+void merge_roaring(std::vector<Iterator>& iterators, std::vector<uint32_t>& colors,
+                   const uint64_t min_score) {
+    if (iterators.empty()) return;
+
+    const uint32_t num_colors = iterators[0].item.num_colors();
+    std::vector<int64_t> score_deltas(num_colors + 1, 0);
+    std::vector<roaring::interval> intervals;
+    for (auto& it : iterators) {
+        const uint32_t num_keys = it.item.num_keys();
+        for (; it.item.container_key() != num_keys; it.item.next_container()) {
+            intervals.clear();
+            it.item.container_intervals(intervals);
+            for (auto const& x : intervals) {
+                score_deltas[x.begin] += it.score;
+                score_deltas[x.end] -= it.score;
+            }
+        }
+    }
+    int64_t score = 0;
+    for (uint32_t color = 0; color < num_colors; color++) {
+        score += score_deltas[color];
+        if (uint64_t(score) >= min_score) colors.push_back(color);
+    }
+}
+
 template <typename Iterator>
 void merge_meta(std::vector<Iterator>& iterators, std::vector<uint32_t>& colors,
                 const uint64_t min_score) {
@@ -374,12 +405,21 @@ void index<ColorSets>::pseudoalign_threshold_union(std::string const& sequence,
     std::sort(color_set_ids.begin(), color_set_ids.end(),
               [](auto const& x, auto const& y) { return x.item < y.item; });
     uint32_t prev_color_set_id = -1;
+    bool prev_only_removed = false;
     for (uint64_t i = 0; i != color_set_ids.size(); ++i) {
         uint64_t color_set_id = color_set_ids[i].item;
         if (color_set_id != prev_color_set_id) {
+            prev_color_set_id = color_set_id;
+            /* the k-mers whose colors were all removed are treated as negative */
+            prev_only_removed = has_removed_colors() and only_removed_colors(color_set_id);
+            if (prev_only_removed) {
+                num_positive_kmers_in_sequence -= color_set_ids[i].score;
+                continue;
+            }
             auto fwd_it = m_color_sets.color_set(color_set_id);
             iterators.push_back({fwd_it, color_set_ids[i].score});
-            prev_color_set_id = color_set_id;
+        } else if (prev_only_removed) {
+            num_positive_kmers_in_sequence -= color_set_ids[i].score;
         } else {
             assert(!iterators.empty());
             iterators.back().score += color_set_ids[i].score;
@@ -394,11 +434,14 @@ void index<ColorSets>::pseudoalign_threshold_union(std::string const& sequence,
         merge_diff(iterators, colors, min_score);
     } else if constexpr (ColorSets::type == index_t::META_DIFF) {
         merge_metadiff(iterators, colors, min_score);
+    } else if constexpr (ColorSets::type == index_t::ROARING) {
+        merge_roaring(iterators, colors, min_score);
     } else if constexpr (ColorSets::type == index_t::HYBRID) {
         merge(iterators, colors, min_score);
     }
 
     assert(util::check_union(iterators, colors, min_score));
+    if (has_removed_colors()) erase_removed_colors(colors);
 }
 
 }  // namespace fulgor
@@ -1,10 +1,18 @@
 #include <string>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <vector>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+
+#include <zlib.h>
 
 #include "include/index.hpp"
+#include "include/psa_reader.hpp"
+#include "include/parallel_fastx_parser.hpp"
 #include "external/FQFeeder/include/FastxParser.hpp"
 
 namespace fulgor {
@@ -24,6 +32,131 @@ std::string to_string(const pseudoalignment_algorithm algo, const double thresho
     return o;
 }
 
+/*
+    Compress a buffer into a complete gzip member.
+    Concatenated members form a valid gzip file, so every worker can compress
+    its own buffers independently (as done by pigz and BGZF).
+*/
+struct gzip_member_compressor {
+    gzip_member_compressor() {
+        m_stream.zalloc = Z_NULL;
+        m_stream.zfree = Z_NULL;
+        m_stream.opaque = Z_NULL;
+        constexpr int gzip_window_bits = 15 + 16;  // 2^15 bytes window + gzip header/trailer
+        constexpr int mem_level = 8;
+        if (deflateInit2(&m_stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, gzip_window_bits,
+                         mem_level, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::runtime_error("error in initializing zlib");
+        }
+    }
+
+    ~gzip_member_compressor() { deflateEnd(&m_stream); }
+
+    std::string compress(char const* data, const uint64_t num_bytes) {
+        if (deflateReset(&m_stream) != Z_OK) throw std::runtime_error("error in resetting zlib");
+        std::string out(deflateBound(&m_stream, num_bytes), 0);
+        m_stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        m_stream.avail_in = num_bytes;
+        m_stream.next_out = reinterpret_cast<Bytef*>(out.data());
+        m_stream.avail_out = out.size();
+        if (deflate(&m_stream, Z_FINISH) != Z_STREAM_END) {
+            throw std::runtime_error("error in compressing output");
+        }
+        out.resize(m_stream.total_out);
+        return out;
+    }
+
+private:
+    z_stream m_stream;
+};
+
+/*
+    The output file shared by all the workers.
+    By default, bytes are written in the order in which they are flushed.
+    In ordered mode, every worker flushes the output of a whole chunk of reads
+    and the chunks are written in input order: a chunk that arrives out of order
+    is kept in a bounded reorder buffer and, when the buffer is full, the worker
+    waits until its chunk is the next one to be written.
+    With gzip enabled, every flushed buffer is compressed into a gzip member
+    by the worker that flushed it, before taking the lock on the file.
+*/
+struct psa_output_file {
+    explicit psa_output_file(std::string const& output_filename)
+        : m_file(output_filename, std::ios::binary)
+        , m_ordered(false)
+        , m_gzip(false)
+        , m_max_pending_chunks(0)
+        , m_next_read_id(0) {}
+
+    void set_ordered(const uint64_t max_pending_chunks) {
+        assert(max_pending_chunks > 0);
+        m_ordered = true;
+        m_max_pending_chunks = max_pending_chunks;
+    }
+
+    void set_gzip() { m_gzip = true; }
+
+    bool ordered() const { return m_ordered; }
+    bool gzip() const { return m_gzip; }
+
+    /* Number of bytes buffered by a worker before flushing (when not in ordered mode).
+       Larger buffers are used with gzip to amortize the cost of a gzip member. */
+    uint32_t buffer_size() const { return m_gzip ? (1 << 20) : (1 << 14); }
+
+    void write(char const* data, const uint64_t num_bytes) {
+        if (m_gzip) {
+            if (num_bytes == 0) return;
+            std::string bytes = compress(data, num_bytes);
+            std::lock_guard lock(m_mut);
+            m_file.write(bytes.data(), bytes.size());
+            return;
+        }
+        std::lock_guard lock(m_mut);
+        m_file.write(data, num_bytes);
+    }
+
+    /* Write the output of the reads [first_read_id, first_read_id + num_reads). */
+    void write(std::string&& bytes, const uint64_t first_read_id, const uint64_t num_reads) {
+        assert(m_ordered);
+        if (num_reads == 0) return;
+        if (m_gzip) bytes = compress(bytes.data(), bytes.size());
+        std::unique_lock lock(m_mut);
+        m_cv.wait(lock, [&]() {
+            return first_read_id == m_next_read_id or m_pending.size() < m_max_pending_chunks;
+        });
+        if (first_read_id != m_next_read_id) {
+            assert(first_read_id > m_next_read_id);
+            m_pending.emplace(first_read_id, std::make_pair(num_reads, std::move(bytes)));
+            return;
+        }
+        m_file.write(bytes.data(), bytes.size());
+        m_next_read_id += num_reads;
+        auto it = m_pending.begin();
+        while (it != m_pending.end() and (*it).first == m_next_read_id) {
+            auto const& [chunk_num_reads, chunk_bytes] = (*it).second;
+            m_file.write(chunk_bytes.data(), chunk_bytes.size());
+            m_next_read_id += chunk_num_reads;
+            it = m_pending.erase(it);
+        }
+        m_cv.notify_all();
+    }
+
+private:
+    std::ofstream m_file;
+    std::mutex m_mut;
+    std::condition_variable m_cv;
+    bool m_ordered;
+    bool m_gzip;
+    uint64_t m_max_pending_chunks;
+    uint64_t m_next_read_id;
+    std::map<uint64_t, std::pair<uint64_t, std::string>> m_pending;  // first_read_id -> chunk
+
+    static std::string compress(char const* data, const uint64_t num_bytes) {
+        thread_local gzip_member_compressor compressor;
+        return compressor.compress(data, num_bytes);
+    }
+};
+
 template <typename Formatter>
 struct formatter_buffer {
     explicit formatter_buffer(Formatter* ptr) : m_formatter(ptr), m_num_bytes(0) {}
@@ -31,13 +164,22 @@ struct formatter_buffer {
     void write(const uint32_t query_id, std::vector<uint32_t> const& vec) {
         m_num_bytes += m_formatter->format(m_buffer, query_id, vec);
 
-        if (m_num_bytes > (1 << 14)) {
+        if (!m_formatter->file().ordered() and m_num_bytes > m_formatter->file().buffer_size()) {
             m_formatter->flush(m_buffer, m_num_bytes);
             m_num_bytes = 0;
         }
     }
 
-    ~formatter_buffer() { m_formatter->flush(m_buffer, m_num_bytes); }
+    /* In ordered mode, hand the output of a whole chunk of reads to the formatter. */
+    void flush_chunk(const uint64_t first_read_id, const uint64_t num_reads) {
+        if (!m_formatter->file().ordered()) return;
+        m_formatter->flush(m_buffer, m_num_bytes, first_read_id, num_reads);
+        m_num_bytes = 0;
+    }
+
+    ~formatter_buffer() {
+        if (m_num_bytes != 0) m_formatter->flush(m_buffer, m_num_bytes);
+    }
 
 private:
     Formatter* m_formatter;
@@ -71,15 +213,23 @@ struct psa_ascii_formatter {
     }
 
     void flush(buffer_t& buffer, const uint32_t num_bytes) {
-        m_mut.lock();
         m_file.write(buffer.str().data(), num_bytes);
-        m_mut.unlock();
         buffer.str("");
     }
 
+    void flush(buffer_t& buffer, const uint32_t num_bytes, const uint64_t first_read_id,
+               const uint64_t num_reads) {
+        std::string bytes = buffer.str();
+        assert(bytes.size() == num_bytes);
+        (void)num_bytes;
+        m_file.write(std::move(bytes), first_read_id, num_reads);
+        buffer.str("");
+    }
+
+    psa_output_file& file() { return m_file; }
+
 protected:
-    std::ofstream m_file;
-    std::mutex m_mut;
+    psa_output_file m_file;
 };
 
 struct psa_slow_formatter {
@@ -106,15 +256,23 @@ struct psa_slow_formatter {
     }
 
     void flush(buffer_t& buffer, const uint32_t num_bytes) {
-        m_mut.lock();
         m_file.write(buffer.str().data(), num_bytes);
-        m_mut.unlock();
         buffer.str("");
     }
 
+    void flush(buffer_t& buffer, const uint32_t num_bytes, const uint64_t first_read_id,
+               const uint64_t num_reads) {
+        std::string bytes = buffer.str();
+        assert(bytes.size() == num_bytes);
+        (void)num_bytes;
+        m_file.write(std::move(bytes), first_read_id, num_reads);
+        buffer.str("");
+    }
+
+    psa_output_file& file() { return m_file; }
+
 protected:
-    std::ofstream m_file;
-    std::mutex m_mut;
+    psa_output_file m_file;
 };
 
 struct psa_binary_formatter {
@@ -135,15 +293,23 @@ struct psa_binary_formatter {
     }
 
     void flush(buffer_t& buffer, const uint32_t num_bytes) {
-        m_mut.lock();
         m_file.write(buffer.str().data(), num_bytes);
-        m_mut.unlock();
         buffer.str("");
     }
 
+    void flush(buffer_t& buffer, const uint32_t num_bytes, const uint64_t first_read_id,
+               const uint64_t num_reads) {
+        std::string bytes = buffer.str();
+        assert(bytes.size() == num_bytes);
+        (void)num_bytes;
+        m_file.write(std::move(bytes), first_read_id, num_reads);
+        buffer.str("");
+    }
+
+    psa_output_file& file() { return m_file; }
+
 protected:
-    std::ofstream m_file;
-    std::mutex m_mut;
+    psa_output_file m_file;
 };
 
 struct psa_compressed_formatter {
@@ -158,9 +324,10 @@ struct psa_compressed_formatter {
     void set_num_colors(uint32_t num_colors) {
         assert(m_num_colors == 0);
         m_num_colors = num_colors;
-        m_file.write(reinterpret_cast<char*>(&m_num_colors), sizeof(uint64_t));
-        m_sparse_set_threshold_size = 0.25 * m_num_colors;
-        m_very_dense_set_threshold_size = 0.75 * m_num_colors;
+        const uint64_t header = m_num_colors;
+        m_file.write(reinterpret_cast<char const*>(&header), sizeof(uint64_t));
+        m_sparse_set_threshold_size = psa_sparse_set_threshold * m_num_colors;
+        m_very_dense_set_threshold_size = psa_very_dense_set_threshold * m_num_colors;
     }
 
     formatter_buffer<psa_compressed_formatter> buffer() { return formatter_buffer(this); }
@@ -228,26 +395,40 @@ struct psa_compressed_formatter {
     }
 
     void flush(buffer_t& buffer, const uint32_t num_bytes) {
-        m_mut.lock();
-        const uint64_t num_bits = buffer.num_bits();
-        m_file.write(reinterpret_cast<const char*>(&num_bits), sizeof(uint64_t));
-        m_file.write(reinterpret_cast<const char*>(buffer.data().data()), num_bytes);
-        m_mut.unlock();
+        std::string bytes = block(buffer, num_bytes);
+        m_file.write(bytes.data(), bytes.size());
+        buffer.clear();
+    }
+
+    void flush(buffer_t& buffer, const uint32_t num_bytes, const uint64_t first_read_id,
+               const uint64_t num_reads) {
+        m_file.write(block(buffer, num_bytes), first_read_id, num_reads);
         buffer.clear();
     }
 
+    psa_output_file& file() { return m_file; }
+
 protected:
-    std::ofstream m_file;
-    std::mutex m_mut;
+    psa_output_file m_file;
     uint32_t m_num_colors, m_sparse_set_threshold_size, m_very_dense_set_threshold_size;
+
+private:
+    /* A block is the number of bits followed by the bytes of the buffer. */
+    static std::string block(buffer_t const& buffer, const uint32_t num_bytes) {
+        const uint64_t num_bits = buffer.num_bits();
+        std::string bytes(sizeof(uint64_t) + num_bytes, 0);
+        std::memcpy(bytes.data(), &num_bits, sizeof(uint64_t));
+        std::memcpy(bytes.data() + sizeof(uint64_t), buffer.data().data(), num_bytes);
+        return bytes;
+    }
 };
 
-template <typename FulgorIndex>
+template <typename FulgorIndex, typename Parser>
 struct fastq_query_reader {
-    fastq_query_reader(std::string& query_filename, uint64_t num_threads, FulgorIndex& index)
-        : rparser({query_filename}, num_threads, num_threads - 1), index(index) {
-        rparser.start();
-    }
+    typedef decltype(std::declval<Parser&>().getReadGroup()) read_group_t;
+    typedef decltype(std::declval<read_group_t&>().begin()) record_iterator_t;
+
+    fastq_query_reader(Parser& rparser, FulgorIndex& index) : rparser(rparser), index(index) {}
 
     struct query_t {
         query_t() : id(-1) {}
@@ -279,6 +460,10 @@ struct fastq_query_reader {
             query.seq = curr_record->seq;
         }
 
+        /* id of the first read of the current chunk and number of reads in the chunk */
+        uint64_t first_read_id() const { return rg.chunk_frag_offset().frag_idx; }
+        uint64_t num_reads() { return std::distance(rg.begin(), rg.end()); }
+
         bool refill() {
             const bool result = qb->rparser.refill(rg);
             if (result) {
@@ -290,17 +475,15 @@ struct fastq_query_reader {
 
     private:
         fastq_query_reader* qb;
-        fastx_parser::ReadGroup<klibpp::KSeq> rg;
-        std::vector<klibpp::KSeq>::iterator curr_record;
+        read_group_t rg;
+        record_iterator_t curr_record;
         uint32_t curr_read_id;
     };
 
     query_group get_query_group() { return query_group(this); }
 
-    ~fastq_query_reader() { rparser.stop(); }
-
 private:
-    fastx_parser::FastxParser<fastx_parser::ReadSeq> rparser;
+    Parser& rparser;
     FulgorIndex& index;
 };
 
@@ -415,8 +598,17 @@ private:
 };
 
 struct query_options {
-    explicit query_options(const bool verbose, const uint64_t num_threads)
-        : verbose(verbose), num_threads(num_threads), num_reads(0) {}
+    explicit query_options(const bool verbose, const uint64_t num_threads,
+                           const uint64_t num_parse_threads)
+        : verbose(verbose)
+        , num_threads(num_threads)
+        , num_parse_threads(num_parse_threads)
+        , num_reads(0) {
+        assert(num_parse_threads < num_threads);
+    }
+
+    /* threads that run the queries: the other ones read and parse the query file */
+    uint64_t num_workers() const { return num_threads - num_parse_threads; }
 
     void increment_processed_reads(const int val = 1) {
         uint64_t prev = num_reads.fetch_add(val);
@@ -429,6 +621,7 @@ struct query_options {
 
     const bool verbose;
     const uint64_t num_threads;
+    const uint64_t num_parse_threads;  // if 0, every worker parses its own chunks of reads
     std::atomic<uint64_t> num_reads;
 
 private:
@@ -436,10 +629,57 @@ private:
     const uint64_t m_log2_batch_size = 20;
 };
 
+/*
+    Number of threads, out of num_threads, dedicated to reading and parsing the query file.
+    With a single thread, the worker parses its own chunks of reads.
+    A BGZF file is inflated in parallel, so it gets a thread every four.
+*/
+uint64_t default_num_parse_threads(std::string const& query_filename, const uint64_t num_threads) {
+    if (num_threads <= 1) return 0;
+    if (parallel_fastx_parser::is_bgzf(query_filename)) {
+        return std::max<uint64_t>(num_threads / 4, 1);
+    }
+    return 1;
+}
+
+/*
+    Call f(rparser) with a started parser for the query file, shared by
+    options.num_workers() worker threads. Without parse threads, the workers
+    parse their own chunks of reads (an inline parallel_fastx_parser).
+    Otherwise, a BGZF file is read by a parallel_fastx_parser with
+    options.num_parse_threads - 1 inflating threads, and any other file by
+    a FastxParser with a single parsing thread.
+*/
+template <typename Callback>
+void parse_queries(std::string const& query_filename, query_options const& options, Callback f) {
+    const uint64_t num_workers = options.num_workers();
+    std::vector<std::string> query_filenames({query_filename});
+    if (options.num_parse_threads == 0) {
+        parallel_fastx_parser rparser(query_filenames, num_workers, 0, true);
+        rparser.start();
+        f(rparser);
+        rparser.stop();
+    } else if (parallel_fastx_parser::is_bgzf(query_filename)) {
+        /* one thread splits the text into records, the other ones inflate it */
+        parallel_fastx_parser rparser(query_filenames, num_workers, options.num_parse_threads - 1);
+        rparser.start();
+        f(rparser);
+        rparser.stop();
+    } else {
+        /* a single file cannot be parsed by more than one thread */
+        fastx_parser::FastxParser<fastx_parser::ReadSeq> rparser(query_filenames, num_workers, 1);
+        rparser.start();
+        f(rparser);
+        rparser.stop();
+    }
+}
+
 struct ps_options : query_options {
     explicit ps_options(const pseudoalignment_algorithm algo, const bool verbose,
-                        const uint64_t num_threads)
-        : query_options(verbose, num_threads), algo(algo), num_mapped_reads(0) {}
+                        const uint64_t num_threads, const uint64_t num_parse_threads)
+        : query_options(verbose, num_threads, num_parse_threads)
+        , algo(algo)
+        , num_mapped_reads(0) {}
 
     void increment_mapped_reads(const int val = 1) { num_mapped_reads += val; }
 
@@ -0,0 +1,161 @@
+#include <iostream>
+
+#include "src/advisor.cpp"
+
+using namespace fulgor;
+
+/*
+    The index to recommend: the smallest one (SIZE), the fastest one (SPEED), or the smallest
+    one among those at most max_slowdown times slower than the fastest (the default).
+*/
+uint64_t recommend(std::vector<advisor::estimate> const& estimates, std::string const& criterion) {
+    constexpr double max_slowdown = 2.0;
+    auto smallest = [&](double max_nanosec) {
+        uint64_t best = estimates.size();
+        for (uint64_t i = 0; i != estimates.size(); ++i) {
+            if (estimates[i].nanosec_per_read > max_nanosec) continue;
+            if (best == estimates.size() or
+                estimates[i].index_bits < estimates[best].index_bits) {
+                best = i;
+            }
+        }
+        return best;
+    };
+    uint64_t fastest = 0;
+    for (uint64_t i = 1; i != estimates.size(); ++i) {
+        if (estimates[i].nanosec_per_read < estimates[fastest].nanosec_per_read) fastest = i;
+    }
+    if (criterion == "size") return smallest(std::numeric_limits<double>::max());
+    if (criterion == "speed") return fastest;
+    return smallest(max_slowdown * estimates[fastest].nanosec_per_read);
+}
+
+int advise(int argc, char** argv) {
+    cmd_line_parser::parser parser(argc, argv);
+    parser.add("index_filename", "The Fulgor index filename (.fur) to advise on.", "-i", true);
+    parser.add("sample_size",
+               "Number of color sets sampled to estimate the sizes (default is " +
+                   std::to_string(advisor::default_sample_size) + ").",
+               "-s", false);
+    parser.add("num_reads",
+               "Number of synthetic reads to benchmark pseudoalignment (default is " +
+                   std::to_string(advisor::default_num_reads) + ").",
+               "-r", false);
+    parser.add("criterion",
+               "What the recommended index minimizes: \"size\", \"speed\" or \"balanced\" (the "
+               "smallest index at most twice as slow as the fastest, the default).",
+               "--criterion", false);
+    parser.add("build", "Build the recommended index, as the tool \"color\" does.", "--build",
+               false, true);
+    parser.add(
+        "tmp_dirname",
+        "Temporary directory used for construction in external memory. Default is directory '" +
+            constants::default_tmp_dirname + "'.",
+        "-d", false);
+    parser.add("RAM",
+               "RAM limit in GiB. Default value is " +
+                   std::to_string(constants::default_ram_limit_in_GiB) + ".",
+               "-g", false);
+    parser.add("num_threads", "Number of threads (default is 1).", "-t", false);
+    parser.add("clustering",
+               "How references and color sets are clustered, for the estimates and with --build: "
+               "\"kmeans\" (the default) or \"minhash\".",
+               "--clustering", false);
+    parser.add("verbose", "Verbose output during construction.", "--verbose", false, true);
+    parser.add("check", "Check correctness after index construction (it might take some time).",
+               "--check", false, true);
+    parser.add("force", "Re-build the index even when an index with the same name is found.",
+               "--force", false, true);
+    if (!parser.parse()) return 1;
+    util::print_cmd(argc, argv);
+
+    build_configuration build_config;
+    build_config.index_filename_to_partition = parser.get<std::string>("index_filename");
+    auto const& index_filename = build_config.index_filename_to_partition;
+    if (!sshash::util::ends_with(index_filename, "." + constants::hfur_filename_extension) or
+        is_roaring(index_filename)) {
+        std::cerr << "Error: the file to advise on must have extension \"."
+                  << constants::hfur_filename_extension
+                  << "\". Have you first built a Fulgor index with the tool \"build\"?"
+                  << std::endl;
+        return 1;
+    }
+
+    std::string criterion = "balanced";
+    if (parser.parsed("criterion")) criterion = parser.get<std::string>("criterion");
+    if (criterion != "size" and criterion != "speed" and criterion != "balanced") {
+        std::cerr << "Error: unknown criterion \"" << criterion
+                  << "\": use \"size\", \"speed\" or \"balanced\"." << std::endl;
+        return 1;
+    }
+    uint64_t sample_size = advisor::default_sample_size;
+    uint64_t num_reads = advisor::default_num_reads;
+    if (parser.parsed("sample_size")) sample_size = parser.get<uint64_t>("sample_size");
+    if (parser.parsed("num_reads")) num_reads = parser.get<uint64_t>("num_reads");
+
+    if (parser.parsed("tmp_dirname")) {
+        build_config.tmp_dirname = parser.get<std::string>("tmp_dirname");
+        essentials::create_directory(build_config.tmp_dirname);
+    }
+    if (parser.parsed("RAM")) build_config.ram_limit_in_GiB = parser.get<uint64_t>("RAM");
+    if (parser.parsed("num_threads")) {
+        build_config.num_threads = parser.get<uint64_t>("num_threads");
+    }
+    if (parser.parsed("clustering") and
+        !parse_clustering(parser.get<std::string>("clustering"), build_config)) {
+        return 1;
+    }
+    build_config.verbose = parser.get<bool>("verbose");
+    build_config.check = parser.get<bool>("check");
+    bool force = parser.get<bool>("force");
+
+    std::vector<advisor::estimate> estimates;
+    {
+        hfur_index_t index;
+        essentials::logger("loading index...");
+        essentials::load(index, index_filename.c_str());
+        essentials::logger("DONE");
+
+        advisor a(index, build_config, sample_size, num_reads);
+        estimates = a.run();
+    }
+
+    std::cout << "type\textension\tcolor sets (bytes)\tindex (bytes)\tns/read" << std::endl;
+    for (auto const& e : estimates) {
+        std::cout << e.name << '\t' << e.extension << '\t' << e.color_sets_bits / 8 << '\t'
+                  << e.index_bits / 8 << '\t' << e.nanosec_per_read << std::endl;
+    }
+    auto const& best = estimates[recommend(estimates, criterion)];
+    std::cout << "recommended (" << criterion << "): " << best.name << " (." << best.extension
+              << ")" << std::endl;
+
+    if (!parser.get<bool>("build")) return 0;
+    if (best.extension == constants::hfur_filename_extension) {
+        std::cout << "the input index is already of the recommended type" << std::endl;
+        return 0;
+    }
+
+    build_config.meta_colored = best.extension == constants::mfur_filename_extension or
+                                best.extension == constants::mrfur_filename_extension or
+                                best.extension == constants::mdfur_filename_extension;
+    build_config.diff_colored = best.extension == constants::dfur_filename_extension or
+                                best.extension == constants::mdfur_filename_extension;
+    build_config.roaring_colored = best.extension == constants::rfur_filename_extension or
+                                   best.extension == constants::mrfur_filename_extension;
+
+    checkpoint cp(build_config);
+    cp.clear();
+
+    if (build_config.meta_colored and build_config.diff_colored) {
+        meta_diff_color(build_config, force);
+    } else if (build_config.meta_colored) {
+        meta_color(build_config, force);
+    } else if (build_config.diff_colored) {
+        diff_color(build_config, force);
+    } else if (build_config.roaring_colored) {
+        roaring_color(build_config, force);
+    }
+
+    cp.clear();
+    return 0;
+}
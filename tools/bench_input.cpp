@@ -0,0 +1,102 @@
+#include <iostream>
+
+using namespace fulgor;
+
+template <typename Parser>
+void bench_input(Parser& rparser, const uint64_t num_workers, std::atomic<uint64_t>& num_reads,
+                 std::atomic<uint64_t>& num_bases) {
+    std::vector<std::thread> workers;
+    workers.reserve(num_workers);
+    for (uint64_t i = 0; i != num_workers; ++i) {
+        workers.push_back(std::thread([&rparser, &num_reads, &num_bases]() {
+            uint64_t reads = 0, bases = 0;
+            auto rg = rparser.getReadGroup();
+            while (rparser.refill(rg)) {
+                for (auto const& record : rg) {
+                    reads += 1;
+                    bases += record.seq.length();
+                }
+            }
+            num_reads += reads;
+            num_bases += bases;
+        }));
+    }
+    for (auto& w : workers) w.join();
+}
+
+int bench_input(int argc, char** argv) {
+    cmd_line_parser::parser parser(argc, argv);
+
+    parser.add("query_filename", "Query filename in FASTA/FASTQ format (optionally gzipped).", "-q",
+               true);
+    parser.add("num_threads", "Number of threads (default is 1).", "-t", false);
+    parser.add("parse_threads",
+               "Number of threads, out of num_threads, that read and parse the query file. "
+               "If 0, every thread parses its own chunks of reads (default is 0 with 1 thread, "
+               "num_threads/4 for BGZF files and 1 otherwise).",
+               "--parse-threads", false);
+    parser.add("parser",
+               "Parser to use. Must be either auto (same as pseudoalign), fastx or parallel "
+               "(default is auto).",
+               "--parser", false);
+    if (!parser.parse()) return 1;
+
+    auto query_filename = parser.get<std::string>("query_filename");
+    auto parser_type = parser.parsed("parser") ? parser.get<std::string>("parser") : "auto";
+    if (parser_type != "auto" and parser_type != "fastx" and parser_type != "parallel") {
+        std::cerr << "Unknown parser. Supported parsers: auto, fastx, parallel." << std::endl;
+        return 1;
+    }
+
+    uint64_t num_threads = 1;
+    if (parser.parsed("num_threads")) num_threads = parser.get<uint64_t>("num_threads");
+    if (num_threads == 0) {
+        std::cerr << "number of threads must be > 0" << std::endl;
+        return 1;
+    }
+    uint64_t num_parse_threads = default_num_parse_threads(query_filename, num_threads);
+    if (parser.parsed("parse_threads")) num_parse_threads = parser.get<uint64_t>("parse_threads");
+    if (num_parse_threads >= num_threads) {
+        std::cerr << "number of parsing threads must be < number of threads" << std::endl;
+        return 1;
+    }
+    if (parser_type == "fastx" and num_parse_threads == 0) {
+        std::cerr << "the fastx parser needs a parsing thread" << std::endl;
+        return 1;
+    }
+
+    query_options options(false, num_threads, num_parse_threads);
+    std::atomic<uint64_t> num_reads = 0;
+    std::atomic<uint64_t> num_bases = 0;
+    const uint64_t num_workers = options.num_workers();
+    std::vector<std::string> query_filenames({query_filename});
+
+    essentials::timer<std::chrono::high_resolution_clock, std::chrono::milliseconds> t;
+    t.start();
+    if (parser_type == "auto") {
+        parse_queries(query_filename, options, [&](auto& rparser) {
+            bench_input(rparser, num_workers, num_reads, num_bases);
+        });
+    } else if (parser_type == "fastx") {
+        fastx_parser::FastxParser<fastx_parser::ReadSeq> rparser(query_filenames, num_workers, 1);
+        rparser.start();
+        bench_input(rparser, num_workers, num_reads, num_bases);
+        rparser.stop();
+    } else {
+        const bool inline_parsing = num_parse_threads == 0;
+        parallel_fastx_parser rparser(query_filenames, num_workers,
+                                      inline_parsing ? 0 : num_parse_threads - 1, inline_parsing);
+        rparser.start();
+        bench_input(rparser, num_workers, num_reads, num_bases);
+        rparser.stop();
+    }
+    t.stop();
+
+    const double seconds = t.elapsed() / 1000;
+    std::cout << "parsed " << num_reads << " reads (" << num_bases << " bases)" << std::endl;
+    std::cout << "elapsed = " << t.elapsed() << " millisec / " << seconds << " sec" << std::endl;
+    std::cout << num_reads / seconds << " reads/sec / " << num_bases / seconds / 1000000
+              << " MB/sec (bases)" << std::endl;
+
+    return 0;
+}
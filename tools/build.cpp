@@ -1,11 +1,55 @@
 using namespace fulgor;
 
-void meta_color(build_configuration const& build_config, const bool force)  //
+std::string clustering_name(const clustering_t clustering) {
+    return clustering == clustering_t::MINHASH ? "minhash" : "kmeans";
+}
+
+/* set the clustering of build_config from the value of option --clustering */
+bool parse_clustering(std::string const& name, build_configuration& build_config) {
+    for (auto clustering : {clustering_t::KMEANS, clustering_t::MINHASH}) {
+        if (name == clustering_name(clustering)) {
+            build_config.clustering = clustering;
+            return true;
+        }
+    }
+    std::cerr << "Error: unknown clustering \"" << name << "\": use \"kmeans\" or \"minhash\"."
+              << std::endl;
+    return false;
+}
+
+/* set the tuning of build_config from the value of option --tune-for */
+bool parse_tuning(std::string const& name, build_configuration& build_config) {
+    if (name == "size") {
+        build_config.tune_for = tuning_t::SIZE;
+    } else if (name == "speed") {
+        build_config.tune_for = tuning_t::SPEED;
+    } else {
+        std::cerr << "Error: unknown tuning \"" << name << "\": use \"size\" or \"speed\"."
+                  << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/* report the size of the color sets next to the building time, to compare the clusterings */
+template <typename Index>
+void print_clustering_summary(build_configuration const& build_config, Index const& index,
+                              const uint64_t seconds) {
+    const uint64_t color_sets_bytes = index.get_color_sets().num_bits() / 8;
+    const uint64_t index_bytes = index.num_bits() / 8;
+    std::cout << "** clustering '" << clustering_name(build_config.clustering)
+              << "': color sets take " << color_sets_bytes << " bytes out of " << index_bytes
+              << " bytes for the index, built in " << seconds << " seconds" << std::endl;
+}
+
+template <typename MetaIndex>
+void meta_color(build_configuration const& build_config, const bool force,
+                std::string const& extension)  //
 {
     std::string output_filename = build_config.index_filename_to_partition.substr(
                                       0, build_config.index_filename_to_partition.length() -
                                              constants::hfur_filename_extension.length() - 1) +
-                                  "." + constants::mfur_filename_extension;
+                                  "." + extension;
 
     if (std::filesystem::exists(output_filename)) {
         std::cerr << "An index with the name '" << output_filename << "' already exists."
@@ -21,23 +65,35 @@ void meta_color(build_configuration const& build_config, const bool force)  //
     essentials::timer<std::chrono::high_resolution_clock, std::chrono::seconds> timer;
     timer.start();
 
-    mfur_index_t index;
-    mfur_index_t::meta_builder builder(build_config);
+    MetaIndex index;
+    typename MetaIndex::meta_builder builder(build_config);
     builder.build(index);
 
     timer.stop();
     essentials::logger("BUILDING DONE");
     std::cout << "** building the index took " << timer.elapsed() << " seconds / "
               << timer.elapsed() / 60 << " minutes" << std::endl;
+    print_clustering_summary(build_config, index, timer.elapsed());
 
     essentials::logger("saving index to disk...");
     essentials::save(index, output_filename.c_str());
+    util::carry_removed_colors(build_config.index_filename_to_partition, output_filename,
+                               builder.get_permutation());
     essentials::logger("DONE");
 
     if (build_config.verbose) index.print_stats();
     if (build_config.check) builder.check(index);
 }
 
+void meta_color(build_configuration const& build_config, const bool force)  //
+{
+    if (build_config.roaring_colored) {
+        meta_color<mrfur_index_t>(build_config, force, constants::mrfur_filename_extension);
+    } else {
+        meta_color<mfur_index_t>(build_config, force, constants::mfur_filename_extension);
+    }
+}
+
 void diff_color(build_configuration const& build_config, const bool force)  //
 {
     std::string output_filename = build_config.index_filename_to_partition.substr(
@@ -67,9 +123,52 @@ void diff_color(build_configuration const& build_config, const bool force)  //
     essentials::logger("BUILDING DONE");
     std::cout << "** building the index took " << timer.elapsed() << " seconds / "
               << timer.elapsed() / 60 << " minutes" << std::endl;
+    print_clustering_summary(build_config, index, timer.elapsed());
+
+    essentials::logger("saving index to disk...");
+    essentials::save(index, output_filename.c_str());
+    util::carry_removed_colors(build_config.index_filename_to_partition, output_filename);
+    essentials::logger("DONE");
+
+    if (build_config.verbose) { index.print_stats(); }
+    if (build_config.check) { builder.check(index); }
+}
+
+void roaring_color(build_configuration const& build_config, const bool force)  //
+{
+    std::string output_filename = build_config.index_filename_to_partition.substr(
+                                      0, build_config.index_filename_to_partition.length() -
+                                             constants::hfur_filename_extension.length() - 1) +
+                                  "." + constants::rfur_filename_extension;
+
+    if (std::filesystem::exists(output_filename)) {
+        std::cerr << "An index with the name '" << output_filename << "' already exists."
+                  << std::endl;
+        if (force) {
+            std::cerr << "Option '--force' specified: re-building the index." << std::endl;
+        } else {
+            std::cerr << "Use option '--force' to re-build the index." << std::endl;
+            return;
+        }
+    }
+
+    essentials::timer<std::chrono::high_resolution_clock, std::chrono::seconds> timer;
+    timer.start();
+
+    rfur_index_t index;
+    rfur_index_t::reorder_builder builder(build_config);
+    builder.build(index);
+
+    timer.stop();
+    essentials::logger("BUILDING DONE");
+    std::cout << "** building the index took " << timer.elapsed() << " seconds / "
+              << timer.elapsed() / 60 << " minutes" << std::endl;
+    print_clustering_summary(build_config, index, timer.elapsed());
 
     essentials::logger("saving index to disk...");
     essentials::save(index, output_filename.c_str());
+    util::carry_removed_colors(build_config.index_filename_to_partition, output_filename,
+                               builder.get_permutation());
     essentials::logger("DONE");
 
     if (build_config.verbose) { index.print_stats(); }
@@ -124,9 +223,11 @@ void meta_diff_color(build_configuration const& build_config, const bool force)
     essentials::logger("BUILD DONE");
     std::cout << "** building the index took " << build_timer.elapsed() << " seconds / "
               << build_timer.elapsed() / 60 << " minutes" << std::endl;
+    print_clustering_summary(build_config, index, build_timer.elapsed());
 
     essentials::logger("saving index to disk...");
     essentials::save(index, output_filename.c_str());
+    util::carry_removed_colors(meta_filename, output_filename);
     essentials::logger("DONE");
 
     if (build_config.verbose) { index.print_stats(); }
@@ -157,6 +258,37 @@ int build(int argc, char** argv) {
                "--force", false, true);
     parser.add("meta", "Build a meta-colored index.", "--meta", false, true);
     parser.add("diff", "Build a differential-colored index.", "--diff", false, true);
+    parser.add("roaring",
+               "Build an index whose color sets (the partial color sets with --meta) are coded "
+               "with Roaring-style array, bitmap and run containers, after permuting the "
+               "references so that similar ones are adjacent. Not compatible with --diff.",
+               "--roaring", false, true);
+    parser.add("rebuild_k2u",
+               "With --diff, rebuild the k-mer dictionary so that unitigs are laid out in the "
+               "order of the permuted color sets, instead of mapping the color set ids of the "
+               "partitioned index (slower to build). Ignored for indexes with a map from unitigs "
+               "to color sets (e.g., merged ones).",
+               "--rebuild-k2u", false, true);
+    parser.add("split_clusters",
+               "With --diff, split the clusters of color sets that take fewer bits with two "
+               "representatives than with one (slower to build).",
+               "--split-clusters", false, true);
+    parser.add("clustering",
+               "How references (with --meta) and color sets (with --diff) are clustered: "
+               "\"kmeans\" (divisive k-means on HLL sketches, the default) or \"minhash\" "
+               "(LSH on MinHash sketches, faster and lighter on large collections).",
+               "--clustering", false);
+    parser.add("tune_for",
+               "Tune the thresholds of the hybrid encoding (of the partial color sets with "
+               "--meta) on a uniform sample of the color sets, for \"size\" or \"speed\" of "
+               "decoding, instead of using the fixed thresholds of 0.25 and 0.75 times the number "
+               "of colors. The sample takes one more pass over the unitigs when building from the "
+               "references.",
+               "--tune-for", false);
+    parser.add("resume",
+               "Resume an interrupted construction from the last stage it completed, as "
+               "recorded in the temporary directory.",
+               "--resume", false, true);
 
     if (!parser.parse()) return 1;
     util::print_cmd(argc, argv);
@@ -169,6 +301,22 @@ int build(int argc, char** argv) {
     bool force = parser.get<bool>("force");
     build_config.meta_colored = parser.get<bool>("meta");
     build_config.diff_colored = parser.get<bool>("diff");
+    build_config.roaring_colored = parser.get<bool>("roaring");
+    if (build_config.roaring_colored and build_config.diff_colored) {
+        std::cerr << "Error: \"--roaring\" cannot be combined with \"--diff\"." << std::endl;
+        return 1;
+    }
+    build_config.rebuild_k2u = parser.get<bool>("rebuild_k2u");
+    build_config.split_clusters = parser.get<bool>("split_clusters");
+    build_config.resume = parser.get<bool>("resume");
+    if (parser.parsed("clustering") and
+        !parse_clustering(parser.get<std::string>("clustering"), build_config)) {
+        return 1;
+    }
+    if (parser.parsed("tune_for") and
+        !parse_tuning(parser.get<std::string>("tune_for"), build_config)) {
+        return 1;
+    }
 
     if (parser.parsed("tmp_dirname")) {
         build_config.tmp_dirname = parser.get<std::string>("tmp_dirname");
@@ -178,11 +326,30 @@ int build(int argc, char** argv) {
         build_config.num_threads = parser.get<uint64_t>("num_threads");
     }
 
-    if (std::filesystem::exists(output_filename)) {
+    auto k = parser.get<uint64_t>("k");
+    auto m = parser.get<uint64_t>("m");
+    build_config.k = k;
+    build_config.m = m;
+    build_config.verbose = parser.get<bool>("verbose");
+    build_config.check = parser.get<bool>("check");
+    build_config.filenames_list = parser.get<std::string>("filenames_list");
+    if (parser.get<uint64_t>("RAM")) {
+        build_config.ram_limit_in_GiB = parser.get<uint64_t>("RAM");
+    }
+
+    checkpoint cp(build_config);
+    if (!build_config.resume) cp.clear();
+    const bool index_done = cp.completed("fur");
+
+    if (std::filesystem::exists(output_filename) and !index_done) {
         std::cerr << "An index with the name '" << output_filename << "' already exists."
                   << std::endl;
         if (force) {
             std::cerr << "Option '--force' specified: re-building the index." << std::endl;
+        } else if (build_config.resume) {
+            std::cerr << "Option '--resume' specified but the index was not recorded as complete: "
+                         "re-building the index."
+                      << std::endl;
         } else {
             std::cerr << "Use option '--force' to re-build the index." << std::endl;
             if (build_config.meta_colored and build_config.diff_colored) {
@@ -198,40 +365,37 @@ int build(int argc, char** argv) {
                 std::cerr << "Consider using: \"./fulgor color -i " << output_filename << " -d "
                           << build_config.tmp_dirname << " -t "
                           << std::to_string(build_config.num_threads) << " --diff\"" << std::endl;
+            } else if (build_config.roaring_colored) {
+                std::cerr << "Consider using: \"./fulgor color -i " << output_filename << " -d "
+                          << build_config.tmp_dirname << " -t "
+                          << std::to_string(build_config.num_threads) << " --roaring\""
+                          << std::endl;
             }
             return 1;
         }
     }
 
-    auto k = parser.get<uint64_t>("k");
-    auto m = parser.get<uint64_t>("m");
-    build_config.k = k;
-    build_config.m = m;
-    build_config.verbose = parser.get<bool>("verbose");
-    build_config.check = parser.get<bool>("check");
-    build_config.filenames_list = parser.get<std::string>("filenames_list");
-    if (parser.get<uint64_t>("RAM")) {
-        build_config.ram_limit_in_GiB = parser.get<uint64_t>("RAM");
-    }
-
-    essentials::timer<std::chrono::high_resolution_clock, std::chrono::seconds> timer;
-    timer.start();
+    if (!index_done) {
+        essentials::timer<std::chrono::high_resolution_clock, std::chrono::seconds> timer;
+        timer.start();
 
-    hfur_index_t index;
-    hfur_index_t::builder builder(build_config);
-    builder.build(index);
+        hfur_index_t index;
+        hfur_index_t::builder builder(build_config);
+        builder.build(index);
 
-    timer.stop();
-    essentials::logger("BUILDING DONE");
-    std::cout << "** building the index took " << timer.elapsed() << " seconds / "
-              << timer.elapsed() / 60 << " minutes" << std::endl;
+        timer.stop();
+        essentials::logger("BUILDING DONE");
+        std::cout << "** building the index took " << timer.elapsed() << " seconds / "
+                  << timer.elapsed() / 60 << " minutes" << std::endl;
 
-    essentials::logger("saving index to disk...");
-    essentials::save(index, output_filename.c_str());
-    essentials::logger("DONE");
+        essentials::logger("saving index to disk...");
+        essentials::save(index, output_filename.c_str());
+        cp.commit("fur", {output_filename});
+        essentials::logger("DONE");
 
-    if (build_config.verbose) index.print_stats();
-    if (build_config.check) builder.check(index);
+        if (build_config.verbose) index.print_stats();
+        if (build_config.check) builder.check(index);
+    }
 
     if (build_config.meta_colored and build_config.diff_colored) {
         meta_diff_color(build_config, force);
@@ -239,8 +403,11 @@ int build(int argc, char** argv) {
         meta_color(build_config, force);
     } else if (build_config.diff_colored) {
         diff_color(build_config, force);
+    } else if (build_config.roaring_colored) {
+        roaring_color(build_config, force);
     }
 
+    cp.clear();
     return 0;
 }
 
@@ -252,6 +419,10 @@ int color(int argc, char** argv) {
         "Temporary directory used for construction in external memory. Default is directory '" +
             constants::default_tmp_dirname + "'.",
         "-d", false);
+    parser.add("RAM",
+               "RAM limit in GiB. Default value is " +
+                   std::to_string(constants::default_ram_limit_in_GiB) + ".",
+               "-g", false);
     parser.add("num_threads", "Number of threads (default is 1).", "-t", false);
     parser.add("verbose", "Verbose output during construction.", "--verbose", false, true);
     parser.add("check", "Check correctness after index construction (it might take some time).",
@@ -260,6 +431,37 @@ int color(int argc, char** argv) {
                "--force", false, true);
     parser.add("meta", "Build a meta-colored index.", "--meta", false, true);
     parser.add("diff", "Build a differential-colored index.", "--diff", false, true);
+    parser.add("roaring",
+               "Build an index whose color sets (the partial color sets with --meta) are coded "
+               "with Roaring-style array, bitmap and run containers, after permuting the "
+               "references so that similar ones are adjacent. Not compatible with --diff.",
+               "--roaring", false, true);
+    parser.add("rebuild_k2u",
+               "With --diff, rebuild the k-mer dictionary so that unitigs are laid out in the "
+               "order of the permuted color sets, instead of mapping the color set ids of the "
+               "partitioned index (slower to build). Ignored for indexes with a map from unitigs "
+               "to color sets (e.g., merged ones).",
+               "--rebuild-k2u", false, true);
+    parser.add("split_clusters",
+               "With --diff, split the clusters of color sets that take fewer bits with two "
+               "representatives than with one (slower to build).",
+               "--split-clusters", false, true);
+    parser.add("clustering",
+               "How references (with --meta) and color sets (with --diff) are clustered: "
+               "\"kmeans\" (divisive k-means on HLL sketches, the default) or \"minhash\" "
+               "(LSH on MinHash sketches, faster and lighter on large collections).",
+               "--clustering", false);
+    parser.add("tune_for",
+               "Tune the thresholds of the hybrid encoding (of the partial color sets with "
+               "--meta) on a uniform sample of the color sets, for \"size\" or \"speed\" of "
+               "decoding, instead of using the fixed thresholds of 0.25 and 0.75 times the number "
+               "of colors. The sample takes one more pass over the unitigs when building from the "
+               "references.",
+               "--tune-for", false);
+    parser.add("resume",
+               "Resume an interrupted construction from the last stage it completed, as "
+               "recorded in the temporary directory.",
+               "--resume", false, true);
 
     if (!parser.parse()) return 1;
     util::print_cmd(argc, argv);
@@ -279,25 +481,49 @@ int color(int argc, char** argv) {
         build_config.tmp_dirname = parser.get<std::string>("tmp_dirname");
         essentials::create_directory(build_config.tmp_dirname);
     }
+    if (parser.parsed("RAM")) build_config.ram_limit_in_GiB = parser.get<uint64_t>("RAM");
     if (parser.parsed("num_threads")) {
         build_config.num_threads = parser.get<uint64_t>("num_threads");
     }
     build_config.check = parser.get<bool>("check");
     build_config.meta_colored = parser.get<bool>("meta");
     build_config.diff_colored = parser.get<bool>("diff");
+    build_config.roaring_colored = parser.get<bool>("roaring");
+    if (build_config.roaring_colored and build_config.diff_colored) {
+        std::cerr << "Error: \"--roaring\" cannot be combined with \"--diff\"." << std::endl;
+        return 1;
+    }
+    build_config.rebuild_k2u = parser.get<bool>("rebuild_k2u");
+    build_config.split_clusters = parser.get<bool>("split_clusters");
+    build_config.resume = parser.get<bool>("resume");
+    if (parser.parsed("clustering") and
+        !parse_clustering(parser.get<std::string>("clustering"), build_config)) {
+        return 1;
+    }
+    if (parser.parsed("tune_for") and
+        !parse_tuning(parser.get<std::string>("tune_for"), build_config)) {
+        return 1;
+    }
     build_config.verbose = parser.get<bool>("verbose");
     bool force = parser.get<bool>("force");
 
+    checkpoint cp(build_config);
+    if (!build_config.resume) cp.clear();
+
     if (build_config.meta_colored and build_config.diff_colored) {
         meta_diff_color(build_config, force);
     } else if (build_config.meta_colored) {
         meta_color(build_config, force);
     } else if (build_config.diff_colored) {
         diff_color(build_config, force);
+    } else if (build_config.roaring_colored) {
+        roaring_color(build_config, force);
     } else {
-        std::cerr << "Either \"--meta\" or \"--diff\" should be specified." << std::endl;
+        std::cerr << "Either \"--meta\", \"--diff\" or \"--roaring\" should be specified."
+                  << std::endl;
         return 1;
     }
 
+    cp.clear();
     return 0;
 }
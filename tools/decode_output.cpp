@@ -0,0 +1,107 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#include "include/psa_reader.hpp"
+
+using namespace fulgor;
+
+void write_record(std::ofstream& out_file, std::string& tmpstr, uint32_t query_id,
+                  std::vector<uint32_t> const& colors) {
+    out_file << query_id << '\t' << colors.size();
+    if (!colors.empty()) {
+        util::vec_to_tsv(colors, tmpstr);
+        out_file << '\t' << tmpstr;
+    }
+    out_file << '\n';
+}
+
+int decode_output(int argc, char** argv) {
+    cmd_line_parser::parser parser(argc, argv);
+
+    parser.add("input_filename",
+               "Output file of pseudoalign in binary or compressed format (optionally gzipped).",
+               "-i", true);
+    parser.add("output_filename",
+               "File where the records will be written in the ascii format of pseudoalign. You "
+               "can specify \"/dev/stdout\" to write output to stdout.",
+               "-o", true);
+    parser.add("format", "Format of the input file. Must either binary or compressed.", "--format",
+               true);
+    parser.add("num_threads", "Number of threads used to decode (default is 1).", "-t", false);
+    parser.add("query_id",
+               "Only decode the record of this query id, looking it up with the block index.",
+               "--query-id", false);
+    parser.add("verbose", "Verbose output (default is false).", "--verbose", false, true);
+    if (!parser.parse()) return 1;
+
+    auto input_filename = parser.get<std::string>("input_filename");
+    auto output_filename = parser.get<std::string>("output_filename");
+    auto input_format = parser.get<std::string>("format");
+
+    psa_output_format format;
+    if (input_format == "binary") {
+        format = psa_output_format::BINARY;
+    } else if (input_format == "compressed") {
+        format = psa_output_format::COMPRESSED;
+    } else {
+        std::cerr << "Unknown input format. Supported formats: binary, compressed." << std::endl;
+        return 1;
+    }
+
+    uint64_t num_threads = 1;
+    if (parser.parsed("num_threads")) num_threads = parser.get<uint64_t>("num_threads");
+    if (num_threads == 0) {
+        std::cerr << "number of threads must be > 0" << std::endl;
+        return 1;
+    }
+
+    bool verbose = parser.get<bool>("verbose");
+    if (verbose) util::print_cmd(argc, argv);
+
+    std::ofstream out_file(output_filename, std::ios::out | std::ios::trunc);
+    if (!out_file) {
+        std::cerr << "could not open output file " + output_filename << std::endl;
+        return 1;
+    }
+
+    essentials::timer<std::chrono::high_resolution_clock, std::chrono::milliseconds> t;
+    t.start();
+
+    psa_reader reader(input_filename, format);
+    std::string tmpstr;
+    uint64_t num_records = 0;
+
+    if (parser.parsed("query_id")) {
+        auto query_id = parser.get<uint32_t>("query_id");
+        reader.build_index(num_threads);
+        if (verbose) {
+            std::cout << "indexed " << reader.index().size() << " blocks" << std::endl;
+        }
+        std::vector<uint32_t> colors;
+        if (!reader.find(query_id, colors)) {
+            std::cerr << "query id " << query_id << " not found" << std::endl;
+            return 1;
+        }
+        write_record(out_file, tmpstr, query_id, colors);
+        num_records = 1;
+    } else {
+        reader.for_each_block(num_threads, [&](std::vector<psa_record> const& records) {
+            for (auto const& record : records) {
+                write_record(out_file, tmpstr, record.query_id, record.colors);
+            }
+            num_records += records.size();
+        });
+    }
+
+    t.stop();
+
+    if (verbose) {
+        std::cout << "decoded " << num_records << " records" << std::endl;
+        std::cout << "elapsed = " << t.elapsed() << " millisec / ";
+        std::cout << t.elapsed() / 1000 << " sec / ";
+        std::cout << t.elapsed() / 1000 / 60 << " min" << std::endl;
+    }
+
+    return 0;
+}
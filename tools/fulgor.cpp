@@ -17,9 +17,13 @@
 #include "util.cpp"
 #include "build.cpp"
 #include "permute.cpp"
+#include "update.cpp"
 #include "pseudoalign.cpp"
 #include "kmer_conservation.cpp"
 #include "kmer_matches.cpp"
+#include "decode_output.cpp"
+#include "bench_input.cpp"
+#include "advise.cpp"
 
 int help(char* arg0) {
     std::cout << "== Fulgor: a colored de Bruijn graph index"
@@ -36,8 +40,14 @@ int help(char* arg0) {
 
     std::cout << "Construction:\n"
               << "  build              build an index\n"
-              << "  color              build a meta- or a diff- or a meta-diff- index\n"
+              << "  color              build a meta-, diff-, meta-diff- or roaring index\n"
               << "  permute            permute the reference names of an index\n"
+              << "  reorder            permute the references of an index and its color sets\n"
+              << "  add                add references to an index\n"
+              << "  remove             remove references from an index\n"
+              << "  merge              merge two indexes\n"
+              << "  subset             build the index of a subset of the references of an index\n"
+              << "  advise             compare the index types on samples of an index\n"
               << std::endl;
 
     std::cout << "Queries:\n"
@@ -45,6 +55,8 @@ int help(char* arg0) {
               << "  kmer-conservation  print color set info for each positive kmer in query\n"
               << "  kmer-matches       print positive kmers per query and number of kmer matches "
                  "per color\n"
+              << "  decode-output      decode a binary or compressed pseudoalignment output to "
+                 "text\n"
               << std::endl;
 
     std::cout
@@ -56,6 +68,7 @@ int help(char* arg0) {
         << "  print-filenames    print all reference filenames\n"
         << "  dump               write unitigs and color sets of an index in text format\n"
         << "  load               build an index from dump output\n"
+        << "  bench-input        measure the throughput of reading and parsing a query file\n"
         << std::endl;
 
     std::cout << "Other:\n"
@@ -82,6 +95,8 @@ int main(int argc, char** argv) {
         return kmer_conservation(argc - 1, argv + 1);
     } else if (tool == "kmer-matches") {
         return kmer_matches(argc - 1, argv + 1);
+    } else if (tool == "decode-output") {
+        return decode_output(argc - 1, argv + 1);
     } else if (tool == "check") {
         return check(argc - 1, argv + 1);
     } else if (tool == "verify") {
@@ -90,17 +105,31 @@ int main(int argc, char** argv) {
         return stats(argc - 1, argv + 1);
     } else if (tool == "print-filenames") {
         return print_filenames(argc - 1, argv + 1);
+    } else if (tool == "bench-input") {
+        return bench_input(argc - 1, argv + 1);
     }
 
     /* advanced tools */
     else if (tool == "permute") {
         return permute(argc - 1, argv + 1);
+    } else if (tool == "reorder") {
+        return reorder(argc - 1, argv + 1);
+    } else if (tool == "advise") {
+        return advise(argc - 1, argv + 1);
     } else if (tool == "dump") {
         return dump(argc - 1, argv + 1);
     } else if (tool == "load") {
         return load(argc - 1, argv + 1);
     } else if (tool == "color") {
         return color(argc - 1, argv + 1);
+    } else if (tool == "add") {
+        return add(argc - 1, argv + 1);
+    } else if (tool == "remove") {
+        return remove(argc - 1, argv + 1);
+    } else if (tool == "merge") {
+        return merge(argc - 1, argv + 1);
+    } else if (tool == "subset") {
+        return subset(argc - 1, argv + 1);
     }
 
     std::cout << "Unsupported tool '" << tool << "'.\n" << std::endl;
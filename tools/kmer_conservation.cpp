@@ -6,11 +6,9 @@
 
 using namespace fulgor;
 
-template <typename FulgorIndex>
-void kmer_conservation(FulgorIndex const& index,
-                       fastx_parser::FastxParser<fastx_parser::ReadSeq>& rparser,
-                       std::ofstream& out_file, std::mutex& ofile_mut,
-                       query_options& options)  //
+template <typename FulgorIndex, typename Parser>
+void kmer_conservation(FulgorIndex const& index, Parser& rparser, std::ofstream& out_file,
+                       std::mutex& ofile_mut, query_options& options)  //
 {
     std::vector<kmer_conservation_triple> kmer_conservation_info;
     std::stringstream ss;
@@ -63,6 +61,7 @@ int kmer_conservation(std::string const& index_filename, std::string const& quer
     FulgorIndex index;
     if (options.verbose) essentials::logger("loading index from disk...");
     essentials::load(index, index_filename.c_str());
+    index.set_removed_colors(util::read_removed_colors(index_filename));
     if (options.verbose) essentials::logger("DONE");
 
     std::ifstream is(query_filename.c_str());
@@ -78,15 +77,9 @@ int kmer_conservation(std::string const& index_filename, std::string const& quer
     essentials::timer<std::chrono::high_resolution_clock, std::chrono::milliseconds> t;
     t.start();
 
-    const uint64_t num_threads = options.num_threads;
-    auto query_filenames = std::vector<std::string>({query_filename});
-    assert(num_threads >= 2);
-    fastx_parser::FastxParser<fastx_parser::ReadSeq> rparser(query_filenames, num_threads,
-                                                             num_threads - 1);
-
-    rparser.start();
+    const uint64_t num_workers = options.num_workers();
     std::vector<std::thread> workers;
-    workers.reserve(num_threads);
+    workers.reserve(num_workers);
     std::mutex ofile_mut;
 
     std::ofstream out_file;
@@ -96,14 +89,14 @@ int kmer_conservation(std::string const& index_filename, std::string const& quer
         return 1;
     }
 
-    for (uint64_t i = 1; i != num_threads; ++i) {
-        workers.push_back(std::thread([&index, &rparser, &out_file, &ofile_mut, &options]() {
-            kmer_conservation(index, rparser, out_file, ofile_mut, options);
-        }));
-    }
-
-    for (auto& w : workers) w.join();
-    rparser.stop();
+    parse_queries(query_filename, options, [&](auto& rparser) {
+        for (uint64_t i = 0; i != num_workers; ++i) {
+            workers.push_back(std::thread([&index, &rparser, &out_file, &ofile_mut, &options]() {
+                kmer_conservation(index, rparser, out_file, ofile_mut, options);
+            }));
+        }
+        for (auto& w : workers) w.join();
+    });
 
     t.stop();
     if (options.verbose) essentials::logger("DONE");
@@ -131,6 +124,12 @@ int kmer_conservation(int argc, char** argv) {
                "to avoid printing status messages to stdout.",
                "-o", true);
     parser.add("num_threads", "Number of threads (default is 1).", "-t", false);
+    parser.add("parse_threads",
+               "Number of threads, out of num_threads, that read and parse the query file. "
+               "If 0, every thread parses its own chunks of reads. Values larger than 1 only "
+               "help with BGZF files (default is 0 with 1 thread, num_threads/4 for BGZF files "
+               "and 1 otherwise).",
+               "--parse-threads", false);
     parser.add("verbose", "Verbose output during query (default is false).", "--verbose", false,
                true);
     if (!parser.parse()) return 1;
@@ -141,19 +140,29 @@ int kmer_conservation(int argc, char** argv) {
 
     uint64_t num_threads = 1;
     if (parser.parsed("num_threads")) num_threads = parser.get<uint64_t>("num_threads");
-    if (num_threads == 1) {
-        num_threads += 1;
-        std::cerr
-            << "1 thread was specified, but an additional thread will be allocated for parsing"
-            << std::endl;
+    if (num_threads == 0) {
+        std::cerr << "number of threads must be > 0" << std::endl;
+        return 1;
+    }
+    uint64_t num_parse_threads = default_num_parse_threads(query_filename, num_threads);
+    if (parser.parsed("parse_threads")) num_parse_threads = parser.get<uint64_t>("parse_threads");
+    if (num_parse_threads >= num_threads) {
+        std::cerr << "number of parsing threads must be < number of threads" << std::endl;
+        return 1;
     }
 
     bool verbose = parser.get<bool>("verbose");
     if (verbose) util::print_cmd(argc, argv);
 
-    query_options options(verbose, num_threads);
+    query_options options(verbose, num_threads, num_parse_threads);
 
-    if (is_meta_diff(index_filename)) {
+    if (is_meta_roaring(index_filename)) {
+        return kmer_conservation<mrfur_index_t>(index_filename, query_filename, output_filename,
+                                                options);
+    } else if (is_roaring(index_filename)) {
+        return kmer_conservation<rfur_index_t>(index_filename, query_filename, output_filename,
+                                               options);
+    } else if (is_meta_diff(index_filename)) {
         return kmer_conservation<mdfur_index_t>(index_filename, query_filename, output_filename,
                                                 options);
     } else if (is_meta(index_filename)) {
@@ -55,4 +55,114 @@ int permute(int argc, char** argv) {
               << timer.elapsed() / 60 << " minutes" << std::endl;
 
     return 0;
-}
\ No newline at end of file
+}
+
+int reorder(int argc, char** argv) {
+    cmd_line_parser::parser parser(argc, argv);
+    parser.add("index_filename", "The Fulgor index filename whose references are reordered.",
+               "-i", true);
+    parser.add("output_filename",
+               "Output filename. Default is the input filename with extension \".reordered." +
+                   constants::hfur_filename_extension + "\".",
+               "-o", false);
+    parser.add(
+        "tmp_dirname",
+        "Temporary directory used for construction in external memory. Default is directory '" +
+            constants::default_tmp_dirname + "'.",
+        "-d", false);
+    parser.add("RAM",
+               "RAM limit in GiB. Default value is " +
+                   std::to_string(constants::default_ram_limit_in_GiB) + ".",
+               "-g", false);
+    parser.add("num_threads", "Number of threads (default is 1).", "-t", false);
+    parser.add("clustering",
+               "How references are clustered: \"kmeans\" (divisive k-means on HLL sketches, the "
+               "default) or \"minhash\" (LSH on MinHash sketches).",
+               "--clustering", false);
+    parser.add("verbose", "Verbose output during construction.", "--verbose", false, true);
+    parser.add("check", "Check correctness after reordering (it might take some time).",
+               "--check", false, true);
+    parser.add("force", "Overwrite the output index if it already exists.", "--force", false,
+               true);
+    parser.add("resume",
+               "Resume an interrupted reordering from the last stage it completed, as recorded "
+               "in the temporary directory.",
+               "--resume", false, true);
+    if (!parser.parse()) return 1;
+    util::print_cmd(argc, argv);
+
+    build_configuration build_config;
+    build_config.index_filename_to_partition = parser.get<std::string>("index_filename");
+    auto const& index_filename = build_config.index_filename_to_partition;
+    if (!sshash::util::ends_with(index_filename, "." + constants::hfur_filename_extension) or
+        is_roaring(index_filename)) {
+        std::cerr << "Error: the file to reorder must have extension \"."
+                  << constants::hfur_filename_extension
+                  << "\". Have you first built a Fulgor index with the tool \"build\"?"
+                  << std::endl;
+        return 1;
+    }
+    std::string output_filename =
+        index_filename.substr(0, index_filename.length() -
+                                     constants::hfur_filename_extension.length() - 1) +
+        ".reordered." + constants::hfur_filename_extension;
+    if (parser.parsed("output_filename")) {
+        output_filename = parser.get<std::string>("output_filename");
+    }
+    if (output_filename == index_filename) {
+        std::cerr << "Error: the output index must be different from the input one." << std::endl;
+        return 1;
+    }
+    if (std::filesystem::exists(output_filename) and !parser.get<bool>("force")) {
+        std::cerr << "An index with the name '" << output_filename << "' already exists."
+                  << std::endl;
+        std::cerr << "Use option '--force' to overwrite it." << std::endl;
+        return 1;
+    }
+
+    if (parser.parsed("tmp_dirname")) {
+        build_config.tmp_dirname = parser.get<std::string>("tmp_dirname");
+        essentials::create_directory(build_config.tmp_dirname);
+    }
+    if (parser.parsed("RAM")) build_config.ram_limit_in_GiB = parser.get<uint64_t>("RAM");
+    if (parser.parsed("num_threads")) {
+        build_config.num_threads = parser.get<uint64_t>("num_threads");
+    }
+    if (parser.parsed("clustering") and
+        !parse_clustering(parser.get<std::string>("clustering"), build_config)) {
+        return 1;
+    }
+    build_config.verbose = parser.get<bool>("verbose");
+    build_config.check = parser.get<bool>("check");
+    build_config.resume = parser.get<bool>("resume");
+
+    /* the stages are recorded under the name of the output index, so that they do not mix
+       with those of "color -i" on the same input index */
+    build_config.file_base_name = std::filesystem::path(output_filename).replace_extension();
+    checkpoint cp(build_config);
+    if (!build_config.resume) cp.clear();
+
+    essentials::timer<std::chrono::high_resolution_clock, std::chrono::seconds> timer;
+    timer.start();
+
+    hfur_index_t index;
+    hfur_index_t::reorder_builder builder(build_config);
+    builder.build(index);
+
+    timer.stop();
+    essentials::logger("BUILDING DONE");
+    std::cout << "** reordering the index took " << timer.elapsed() << " seconds / "
+              << timer.elapsed() / 60 << " minutes" << std::endl;
+
+    essentials::logger("saving index to disk...");
+    essentials::save(index, output_filename.c_str());
+    /* the removed references stay removed, with their new colors */
+    util::carry_removed_colors(index_filename, output_filename, builder.get_permutation());
+    essentials::logger("DONE");
+
+    if (build_config.verbose) index.print_stats();
+    if (build_config.check) builder.check(index);
+
+    cp.clear();
+    return 0;
+}
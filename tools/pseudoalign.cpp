@@ -50,6 +50,9 @@ void pseudoalign_worker(FulgorIndex const& index, QueryReader& query_reader, For
             colors.clear();
             qg.next();
         }
+        if constexpr (!std::is_same_v<preprocessed_query_reader, QueryReader>) {
+            output_buffer.flush_chunk(qg.first_read_id(), qg.num_reads());
+        }
     }
 }
 
@@ -59,13 +62,12 @@ void pseudoalign_orchestrator(FulgorIndex& index, QueryReader& query_reader, For
     essentials::timer<std::chrono::high_resolution_clock, std::chrono::milliseconds> t;
     t.start();
 
-    const uint64_t num_threads = options.num_threads;
-    assert(num_threads >= 2);
+    const uint64_t num_workers = options.num_workers();
 
     if (options.verbose) essentials::logger("*** START: pseudoalignment");
     std::vector<std::thread> workers;
-    workers.reserve(num_threads);
-    for (uint64_t i = 1; i != num_threads; ++i) {
+    workers.reserve(num_workers);
+    for (uint64_t i = 0; i != num_workers; ++i) {
         workers.push_back(std::thread([&index, &query_reader, &formatter, threshold, &options]() {
             pseudoalign_worker(index, query_reader, formatter, threshold, options);
         }));
@@ -96,17 +98,13 @@ void fetch_and_deduplicate_sets(const std::string& query_filename, Formatter& ou
     if (options.verbose) essentials::logger("*** START: fetching color set ids");
 
     std::ofstream tmp_file(tmp_filename, std::ios::binary);
-    auto query_filenames = std::vector({query_filename});
-    fastx_parser::FastxParser<fastx_parser::ReadSeq> rparser(query_filenames, options.num_threads,
-                                                             options.num_threads - 1);
-    rparser.start();
     std::vector<std::thread> workers;
     std::mutex outfile_mut, iomut;
 
     constexpr int32_t buff_thresh = 50;
     std::atomic<uint64_t> num_fetched_reads = 0;
-    auto fetch = [&rparser, &index, &tmp_file, &outfile_mut, &iomut, &num_fetched_reads,
-                  &options]() {
+    auto fetch = [&index, &tmp_file, &outfile_mut, &iomut, &num_fetched_reads,
+                  &options](auto& rparser) {
         uint32_t buff_size = 0;
         std::vector<uint32_t> color_set_ids;
         std::stringstream ss;
@@ -156,9 +154,12 @@ void fetch_and_deduplicate_sets(const std::string& query_filename, Formatter& ou
         }
     };
 
-    for (uint64_t i = 1; i < options.num_threads; ++i) { workers.push_back(std::thread(fetch)); }
-    for (auto& w : workers) w.join();
-    rparser.stop();
+    parse_queries(query_filename, options, [&](auto& rparser) {
+        for (uint64_t i = 0; i != options.num_workers(); ++i) {
+            workers.push_back(std::thread([&]() { fetch(rparser); }));
+        }
+        for (auto& w : workers) w.join();
+    });
     tmp_file.close();
 
     if (options.verbose) essentials::logger("*** DONE: fetching color set ids");
@@ -237,6 +238,12 @@ int pseudoalign(int argc, char** argv) {
                "to avoid printing status messages to stdout.",
                "-o", true);
     parser.add("num_threads", "Number of threads (default is 1).", "-t", false);
+    parser.add("parse_threads",
+               "Number of threads, out of num_threads, that read and parse the query file. "
+               "If 0, every thread parses its own chunks of reads. Values larger than 1 only "
+               "help with BGZF files (default is 0 with 1 thread, num_threads/4 for BGZF files "
+               "and 1 otherwise).",
+               "--parse-threads", false);
     parser.add("verbose", "Verbose output during query (default is false).", "--verbose", false,
                true);
     parser.add("threshold",
@@ -251,6 +258,14 @@ int pseudoalign(int argc, char** argv) {
                "Format of the output file. Must either ascii, binary, compressed"
                " (default is ascii).",
                "--format", false);
+    parser.add("gzip_output",
+               "Compress the output with gzip (default is false). Every worker compresses its "
+               "own output chunks, so compression scales with the number of threads.",
+               "--gzip-output", false, true);
+    parser.add("ordered",
+               "Write the output in the same order as the reads in the query file "
+               "(default is false). Not available with --deduplicate.",
+               "--ordered", false, true);
     if (!parser.parse()) return 1;
 
     auto index_filename = parser.get<std::string>("index_filename");
@@ -258,15 +273,26 @@ int pseudoalign(int argc, char** argv) {
     auto output_filename = parser.get<std::string>("output_filename");
 
     bool deduplicate = parser.get<bool>("deduplicate");
+    bool ordered = parser.get<bool>("ordered");
+    bool gzip_output = parser.get<bool>("gzip_output");
+    if (ordered and deduplicate) {
+        std::cerr << "Ordered output not available with deduplication. Remove --deduplicate flag."
+                  << std::endl;
+        return 1;
+    }
     auto output_format = parser.parsed("format") ? parser.get<std::string>("format") : "ascii";
 
     uint64_t num_threads = 1;
     if (parser.parsed("num_threads")) num_threads = parser.get<uint64_t>("num_threads");
-    if (num_threads == 1) {
-        num_threads += 1;
-        std::cerr
-            << "1 thread was specified, but an additional thread will be allocated for parsing"
-            << std::endl;
+    if (num_threads == 0) {
+        std::cerr << "number of threads must be > 0" << std::endl;
+        return 1;
+    }
+    uint64_t num_parse_threads = default_num_parse_threads(query_filename, num_threads);
+    if (parser.parsed("parse_threads")) num_parse_threads = parser.get<uint64_t>("parse_threads");
+    if (num_parse_threads >= num_threads) {
+        std::cerr << "number of parsing threads must be < number of threads" << std::endl;
+        return 1;
     }
 
     double threshold = constants::invalid_threshold;
@@ -291,8 +317,14 @@ int pseudoalign(int argc, char** argv) {
     bool verbose = parser.get<bool>("verbose");
     if (verbose) util::print_cmd(argc, argv);
 
-    std::variant<hfur_index_t, mdfur_index_t, mfur_index_t, dfur_index_t> index;
-    if (is_meta_diff(index_filename)) {
+    std::variant<hfur_index_t, mdfur_index_t, mfur_index_t, dfur_index_t, mrfur_index_t,
+                 rfur_index_t>
+        index;
+    if (is_meta_roaring(index_filename)) {
+        index = mrfur_index_t();
+    } else if (is_roaring(index_filename)) {
+        index = rfur_index_t();
+    } else if (is_meta_diff(index_filename)) {
         index = mdfur_index_t();
     } else if (is_meta(index_filename)) {
         index = mfur_index_t();
@@ -321,7 +353,7 @@ int pseudoalign(int argc, char** argv) {
     }
 
     std::string tmp_filename = "queries.tmp";
-    ps_options options(ps_alg, verbose, num_threads);
+    ps_options options(ps_alg, verbose, num_threads, num_parse_threads);
 
     if (verbose) {
         std::cout << "\n---------------------------------" << std::endl;
@@ -334,30 +366,51 @@ int pseudoalign(int argc, char** argv) {
     }
 
     std::visit(
-        [&index_filename, &query_filename, &output_filename, &tmp_filename, deduplicate,
-         num_threads, threshold, verbose, &options](auto&& index, auto&& formatter) {
+        [&index_filename, &query_filename, &output_filename, &tmp_filename, deduplicate, ordered,
+         gzip_output, num_threads, threshold, verbose, &options](auto&& index, auto&& formatter) {
             if (verbose) essentials::logger("*** START: loading the index");
             essentials::load(index, index_filename.c_str());
+            {
+                auto removed_colors = util::read_removed_colors(index_filename);
+                if (!removed_colors.empty()) {
+                    if (verbose) {
+                        std::cout << "skipping " << removed_colors.size()
+                                  << " removed references" << std::endl;
+                    }
+                    index.set_removed_colors(removed_colors);
+                }
+            }
             if (verbose) essentials::logger("*** DONE: loading the index");
 
             if (verbose)
                 essentials::logger("performing queries from file '" + query_filename + "'...");
 
-            if constexpr (std::is_same_v<std::decay_t<decltype(formatter)>,
-                                         psa_compressed_formatter>) {
-                formatter.set_num_colors(index.num_colors());
-            }
             if constexpr (!std::is_same_v<std::decay_t<decltype(formatter)>, std::monostate>) {
                 std::ofstream out(output_filename);
 
+                /* at most this many chunks per worker are kept waiting to be written */
+                constexpr uint64_t max_pending_chunks_per_thread = 4;
+                if (ordered) {
+                    formatter.file().set_ordered(max_pending_chunks_per_thread * num_threads);
+                }
+                if (gzip_output) formatter.file().set_gzip();
+
+                if constexpr (std::is_same_v<std::decay_t<decltype(formatter)>,
+                                             psa_compressed_formatter>) {
+                    formatter.set_num_colors(index.num_colors());
+                }
+
                 if (deduplicate) {
                     fetch_and_deduplicate_sets(query_filename, formatter, tmp_filename, index,
                                                options);
                     preprocessed_query_reader query_reader(tmp_filename, num_threads);
                     pseudoalign_orchestrator(index, query_reader, formatter, threshold, options);
                 } else {
-                    fastq_query_reader query_reader(query_filename, num_threads, index);
-                    pseudoalign_orchestrator(index, query_reader, formatter, threshold, options);
+                    parse_queries(query_filename, options, [&](auto& rparser) {
+                        fastq_query_reader query_reader(rparser, index);
+                        pseudoalign_orchestrator(index, query_reader, formatter, threshold,
+                                                 options);
+                    });
                 }
             }
         },
@@ -0,0 +1,538 @@
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace fulgor;
+
+int add(int argc, char** argv) {
+    cmd_line_parser::parser parser(argc, argv);
+    parser.add("index_filename", "The Fulgor index filename to which references are added.", "-i",
+               true);
+    parser.add("filenames_list", "Filenames list of the references to add.", "-l", true);
+    parser.add("file_base_name", "File basename of the updated index.", "-o", true);
+    parser.add(
+        "tmp_dirname",
+        "Temporary directory used for construction in external memory. Default is directory '" +
+            constants::default_tmp_dirname + "'.",
+        "-d", false);
+    parser.add("RAM",
+               "RAM limit in GiB. Default value is " +
+                   std::to_string(constants::default_ram_limit_in_GiB) + ".",
+               "-g", false);
+    parser.add("num_threads", "Number of threads (default is 1).", "-t", false);
+    parser.add("verbose", "Verbose output during construction.", "--verbose", false, true);
+    parser.add("check", "Check correctness after index construction (it might take some time).",
+               "--check", false, true);
+    parser.add("force", "Re-build the index even when an index with the same name is found.",
+               "--force", false, true);
+    if (!parser.parse()) return 1;
+    util::print_cmd(argc, argv);
+
+    auto index_filename = parser.get<std::string>("index_filename");
+    if (!sshash::util::ends_with(index_filename, "." + constants::hfur_filename_extension)) {
+        std::cerr << "Error: references can only be added to an index with extension \"."
+                  << constants::hfur_filename_extension
+                  << "\": use the tool \"color\" on the updated index to partition it."
+                  << std::endl;
+        return 1;
+    }
+
+    build_configuration build_config;
+    build_config.file_base_name = parser.get<std::string>("file_base_name");
+    build_config.filenames_list = parser.get<std::string>("filenames_list");
+    build_config.verbose = parser.get<bool>("verbose");
+    build_config.check = parser.get<bool>("check");
+    if (parser.parsed("tmp_dirname")) {
+        build_config.tmp_dirname = parser.get<std::string>("tmp_dirname");
+        essentials::create_directory(build_config.tmp_dirname);
+    }
+    if (parser.parsed("RAM")) build_config.ram_limit_in_GiB = parser.get<uint64_t>("RAM");
+    if (parser.parsed("num_threads")) {
+        build_config.num_threads = parser.get<uint64_t>("num_threads");
+    }
+
+    std::string output_filename =
+        build_config.file_base_name + "." + constants::hfur_filename_extension;
+    if (std::filesystem::exists(output_filename)) {
+        std::cerr << "An index with the name '" << output_filename << "' already exists."
+                  << std::endl;
+        if (parser.get<bool>("force")) {
+            std::cerr << "Option '--force' specified: re-building the index." << std::endl;
+        } else {
+            std::cerr << "Use option '--force' to re-build the index." << std::endl;
+            return 1;
+        }
+    }
+
+    essentials::timer<std::chrono::high_resolution_clock, std::chrono::seconds> timer;
+    timer.start();
+
+    hfur_index_t base_index;
+    essentials::logger("loading index to update...");
+    essentials::load(base_index, index_filename.c_str());
+    essentials::logger("DONE");
+
+    /* index the new references alone, with the same k and minimizer length */
+    hfur_index_t new_index;
+    {
+        build_configuration new_build_config = build_config;
+        new_build_config.k = base_index.k();
+        new_build_config.m = base_index.get_k2u().m();
+        new_build_config.file_base_name = build_config.file_base_name + ".new";
+        essentials::logger("building an index of the new references...");
+        hfur_index_t::builder builder(new_build_config);
+        builder.build(new_index);
+        checkpoint(new_build_config).clear();
+        essentials::logger("DONE");
+    }
+
+    hfur_index_t index;
+    hfur_index_t::merge_builder builder(build_config);
+    builder.build(index, base_index, new_index);
+
+    timer.stop();
+    essentials::logger("BUILDING DONE");
+    std::cout << "added " << new_index.num_colors() << " references to the "
+              << base_index.num_colors() << " of the index" << std::endl;
+    std::cout << "** updating the index took " << timer.elapsed() << " seconds / "
+              << timer.elapsed() / 60 << " minutes" << std::endl;
+
+    essentials::logger("saving index to disk...");
+    essentials::save(index, output_filename.c_str());
+    /* the colors of the base index come first: its removed references keep their colors */
+    util::carry_removed_colors(index_filename, output_filename);
+    essentials::logger("DONE");
+
+    if (build_config.verbose) index.print_stats();
+    if (build_config.check and !builder.check(index, base_index, new_index)) return 1;
+
+    return 0;
+}
+
+int merge(int argc, char** argv) {
+    cmd_line_parser::parser parser(argc, argv);
+    parser.add("first_filename", "The first Fulgor index to merge.", "-a", true);
+    parser.add("second_filename",
+               "The second Fulgor index to merge: its colors are numbered after those of the "
+               "first index.",
+               "-b", true);
+    parser.add("file_base_name", "File basename of the merged index.", "-o", true);
+    parser.add(
+        "tmp_dirname",
+        "Temporary directory used for construction in external memory. Default is directory '" +
+            constants::default_tmp_dirname + "'.",
+        "-d", false);
+    parser.add("RAM",
+               "RAM limit in GiB. Default value is " +
+                   std::to_string(constants::default_ram_limit_in_GiB) + ".",
+               "-g", false);
+    parser.add("num_threads", "Number of threads (default is 1).", "-t", false);
+    parser.add("verbose", "Verbose output during construction.", "--verbose", false, true);
+    parser.add("check", "Check correctness after index construction (it might take some time).",
+               "--check", false, true);
+    parser.add("force", "Re-build the index even when an index with the same name is found.",
+               "--force", false, true);
+    if (!parser.parse()) return 1;
+    util::print_cmd(argc, argv);
+
+    auto first_filename = parser.get<std::string>("first_filename");
+    auto second_filename = parser.get<std::string>("second_filename");
+    for (auto const& filename : {first_filename, second_filename}) {
+        if (!sshash::util::ends_with(filename, "." + constants::hfur_filename_extension)) {
+            std::cerr << "Error: only indexes with extension \"."
+                      << constants::hfur_filename_extension
+                      << "\" can be merged: use the tool \"color\" on the merged index to "
+                         "partition it."
+                      << std::endl;
+            return 1;
+        }
+    }
+
+    build_configuration build_config;
+    build_config.file_base_name = parser.get<std::string>("file_base_name");
+    build_config.verbose = parser.get<bool>("verbose");
+    build_config.check = parser.get<bool>("check");
+    if (parser.parsed("tmp_dirname")) {
+        build_config.tmp_dirname = parser.get<std::string>("tmp_dirname");
+        essentials::create_directory(build_config.tmp_dirname);
+    }
+    if (parser.parsed("RAM")) build_config.ram_limit_in_GiB = parser.get<uint64_t>("RAM");
+    if (parser.parsed("num_threads")) {
+        build_config.num_threads = parser.get<uint64_t>("num_threads");
+    }
+
+    std::string output_filename =
+        build_config.file_base_name + "." + constants::hfur_filename_extension;
+    if (std::filesystem::exists(output_filename)) {
+        std::cerr << "An index with the name '" << output_filename << "' already exists."
+                  << std::endl;
+        if (parser.get<bool>("force")) {
+            std::cerr << "Option '--force' specified: re-building the index." << std::endl;
+        } else {
+            std::cerr << "Use option '--force' to re-build the index." << std::endl;
+            return 1;
+        }
+    }
+
+    hfur_index_t first_index, second_index;
+    essentials::logger("loading the indexes to merge...");
+    essentials::load(first_index, first_filename.c_str());
+    essentials::load(second_index, second_filename.c_str());
+    essentials::logger("DONE");
+
+    {
+        /* a reference in both indexes would get two colors */
+        std::unordered_set<std::string_view> first_filenames;
+        for (uint64_t i = 0; i != first_index.num_colors(); ++i) {
+            first_filenames.insert(first_index.filename(i));
+        }
+        for (uint64_t i = 0; i != second_index.num_colors(); ++i) {
+            if (first_filenames.count(second_index.filename(i))) {
+                std::cerr << "Warning: reference '" << second_index.filename(i)
+                          << "' is in both indexes." << std::endl;
+            }
+        }
+    }
+
+    essentials::timer<std::chrono::high_resolution_clock, std::chrono::seconds> timer;
+    timer.start();
+
+    hfur_index_t index;
+    hfur_index_t::merge_builder builder(build_config);
+    builder.build(index, first_index, second_index);
+
+    timer.stop();
+    essentials::logger("BUILDING DONE");
+    std::cout << "merged " << first_index.num_colors() << " + " << second_index.num_colors()
+              << " references" << std::endl;
+    std::cout << "** merging the indexes took " << timer.elapsed() << " seconds / "
+              << timer.elapsed() / 60 << " minutes" << std::endl;
+
+    essentials::logger("saving index to disk...");
+    essentials::save(index, output_filename.c_str());
+    {
+        /* the removed references stay removed: those of the second index are renumbered */
+        auto removed_colors = util::read_removed_colors(first_filename);
+        for (auto color : util::read_removed_colors(second_filename)) {
+            removed_colors.push_back(first_index.num_colors() + color);
+        }
+        util::write_removed_colors(output_filename, removed_colors);
+    }
+    essentials::logger("DONE");
+
+    if (build_config.verbose) index.print_stats();
+    if (build_config.check and !builder.check(index, first_index, second_index)) return 1;
+
+    return 0;
+}
+
+/*
+    Read the references to remove, one per line: either a filename of the index
+    (as printed by the tool "print-filenames") or a color id.
+*/
+template <typename FulgorIndex>
+bool parse_references(FulgorIndex const& index, std::string const& filenames_list,
+                      std::vector<uint32_t>& colors) {
+    std::ifstream in(filenames_list);
+    if (!in.is_open()) {
+        std::cerr << "Error: cannot open file '" << filenames_list << "'." << std::endl;
+        return false;
+    }
+    std::unordered_map<std::string_view, uint32_t> color_of;
+    for (uint64_t color = 0; color != index.num_colors(); ++color) {
+        color_of[index.filename(color)] = color;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty()) continue;
+        auto it = color_of.find(line);
+        if (it != color_of.end()) {
+            colors.push_back(it->second);
+            continue;
+        }
+        if (std::all_of(line.begin(), line.end(), [](char c) { return std::isdigit(c); }) and
+            line.size() < 10 and std::stoull(line) < index.num_colors()) {
+            colors.push_back(std::stoull(line));
+            continue;
+        }
+        std::cerr << "Error: reference '" << line << "' not found in the index." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/*
+    Write the index of the given colors of an index, of the same type, to
+    build_config.file_base_name (partitioned again if it is not a .fur index).
+    The removed references among the given colors stay removed.
+*/
+template <typename FulgorIndex>
+int build_subset(FulgorIndex const& index, std::string const& index_filename,
+                 std::vector<uint32_t> const& colors, build_configuration build_config,
+                 const bool merge_unitigs, const bool force) {
+    std::string output_filename =
+        build_config.file_base_name + "." + constants::hfur_filename_extension;
+    if (std::filesystem::exists(output_filename)) {
+        std::cerr << "An index with the name '" << output_filename << "' already exists."
+                  << std::endl;
+        if (force) {
+            std::cerr << "Option '--force' specified: re-building the index." << std::endl;
+        } else {
+            std::cerr << "Use option '--force' to re-build the index." << std::endl;
+            return 1;
+        }
+    }
+
+    essentials::timer<std::chrono::high_resolution_clock, std::chrono::seconds> timer;
+    timer.start();
+
+    {
+        hfur_index_t subset_index;
+        hfur_index_t::subset_builder builder(build_config);
+        builder.build(subset_index, index, colors, merge_unitigs);
+
+        timer.stop();
+        essentials::logger("BUILDING DONE");
+        std::cout << "** building the index took " << timer.elapsed() << " seconds / "
+                  << timer.elapsed() / 60 << " minutes" << std::endl;
+
+        essentials::logger("saving index to disk...");
+        essentials::save(subset_index, output_filename.c_str());
+        std::vector<uint32_t> new_color(index.num_colors(), uint32_t(-1));
+        for (uint64_t i = 0; i != colors.size(); ++i) new_color[colors[i]] = i;
+        util::carry_removed_colors(index_filename, output_filename, new_color);
+        essentials::logger("DONE");
+
+        if (build_config.verbose) subset_index.print_stats();
+        if (build_config.check and !builder.check(subset_index, index, colors)) return 1;
+    }
+
+    /* partition the new index as the input one */
+    if (FulgorIndex::color_sets_type::type != index_t::HYBRID) {
+        build_config.index_filename_to_partition = output_filename;
+        checkpoint cp(build_config);
+        cp.clear();
+        if constexpr (FulgorIndex::color_sets_type::type == index_t::META) {
+            build_config.roaring_colored = std::is_same_v<FulgorIndex, mrfur_index_t>;
+            meta_color(build_config, force);
+        } else if constexpr (FulgorIndex::color_sets_type::type == index_t::ROARING) {
+            roaring_color(build_config, force);
+        } else if constexpr (FulgorIndex::color_sets_type::type == index_t::DIFF) {
+            diff_color(build_config, force);
+        } else if constexpr (FulgorIndex::color_sets_type::type == index_t::META_DIFF) {
+            meta_diff_color(build_config, force);
+        }
+        cp.clear();
+    }
+
+    return 0;
+}
+
+template <typename FulgorIndex>
+int remove_references(std::string const& index_filename, std::string const& filenames_list,
+                      build_configuration build_config, const bool compact, const bool force) {
+    FulgorIndex index;
+    essentials::logger("loading index from disk...");
+    essentials::load(index, index_filename.c_str());
+    essentials::logger("DONE");
+
+    auto removed_colors = util::read_removed_colors(index_filename);
+    const uint64_t num_removed_before = removed_colors.size();
+    if (!filenames_list.empty()) {
+        if (!parse_references(index, filenames_list, removed_colors)) return 1;
+        std::sort(removed_colors.begin(), removed_colors.end());
+        removed_colors.erase(std::unique(removed_colors.begin(), removed_colors.end()),
+                             removed_colors.end());
+    }
+    if (removed_colors.size() == index.num_colors()) {
+        std::cerr << "Error: all the references of the index would be removed." << std::endl;
+        return 1;
+    }
+    if (removed_colors.size() != num_removed_before) {
+        util::write_removed_colors(index_filename, removed_colors);
+    }
+    std::cout << "removed " << removed_colors.size() - num_removed_before
+              << " references: " << removed_colors.size() << " of the " << index.num_colors()
+              << " references of the index are removed" << std::endl;
+    if (!compact) return 0;
+
+    if (removed_colors.empty()) {
+        std::cerr << "Error: no references were removed, nothing to compact." << std::endl;
+        return 1;
+    }
+
+    std::vector<uint32_t> colors;
+    colors.reserve(index.num_colors() - removed_colors.size());
+    for (uint32_t color = 0, i = 0; color != index.num_colors(); ++color) {
+        if (i != removed_colors.size() and removed_colors[i] == color) {
+            ++i;
+        } else {
+            colors.push_back(color);
+        }
+    }
+
+    return build_subset(index, index_filename, colors, build_config, false, force);
+}
+
+int remove(int argc, char** argv) {
+    cmd_line_parser::parser parser(argc, argv);
+    parser.add("index_filename", "The Fulgor index filename from which references are removed.",
+               "-i", true);
+    parser.add("filenames_list",
+               "List of the references to remove, one per line: either a filename of the index "
+               "or a color id. The references are only hidden from queries, until the index "
+               "is compacted.",
+               "-l", false);
+    parser.add("compact",
+               "Write a compacted index, of the same type, without the removed references "
+               "(requires option '-o').",
+               "--compact", false, true);
+    parser.add("file_base_name", "File basename of the compacted index.", "-o", false);
+    parser.add(
+        "tmp_dirname",
+        "Temporary directory used for construction in external memory. Default is directory '" +
+            constants::default_tmp_dirname + "'.",
+        "-d", false);
+    parser.add("RAM",
+               "RAM limit in GiB. Default value is " +
+                   std::to_string(constants::default_ram_limit_in_GiB) + ".",
+               "-g", false);
+    parser.add("num_threads", "Number of threads (default is 1).", "-t", false);
+    parser.add("verbose", "Verbose output during construction.", "--verbose", false, true);
+    parser.add("check", "Check correctness after index construction (it might take some time).",
+               "--check", false, true);
+    parser.add("force", "Re-build the index even when an index with the same name is found.",
+               "--force", false, true);
+    if (!parser.parse()) return 1;
+    util::print_cmd(argc, argv);
+
+    auto index_filename = parser.get<std::string>("index_filename");
+    const bool compact = parser.get<bool>("compact");
+    std::string filenames_list =
+        parser.parsed("filenames_list") ? parser.get<std::string>("filenames_list") : "";
+    if (filenames_list.empty() and !compact) {
+        std::cerr << "Either option '-l' or option '--compact' should be specified." << std::endl;
+        return 1;
+    }
+    if (compact and !parser.parsed("file_base_name")) {
+        std::cerr << "Option '--compact' requires option '-o'." << std::endl;
+        return 1;
+    }
+
+    build_configuration build_config;
+    if (compact) build_config.file_base_name = parser.get<std::string>("file_base_name");
+    build_config.verbose = parser.get<bool>("verbose");
+    build_config.check = parser.get<bool>("check");
+    if (parser.parsed("tmp_dirname")) {
+        build_config.tmp_dirname = parser.get<std::string>("tmp_dirname");
+        essentials::create_directory(build_config.tmp_dirname);
+    }
+    if (parser.parsed("RAM")) build_config.ram_limit_in_GiB = parser.get<uint64_t>("RAM");
+    if (parser.parsed("num_threads")) {
+        build_config.num_threads = parser.get<uint64_t>("num_threads");
+    }
+    const bool force = parser.get<bool>("force");
+
+    if (is_meta_roaring(index_filename)) {
+        return remove_references<mrfur_index_t>(index_filename, filenames_list, build_config,
+                                                compact, force);
+    } else if (is_roaring(index_filename)) {
+        return remove_references<rfur_index_t>(index_filename, filenames_list, build_config,
+                                               compact, force);
+    } else if (is_meta_diff(index_filename)) {
+        return remove_references<mdfur_index_t>(index_filename, filenames_list, build_config,
+                                              compact, force);
+    } else if (is_meta(index_filename)) {
+        return remove_references<mfur_index_t>(index_filename, filenames_list, build_config,
+                                              compact, force);
+    } else if (is_diff(index_filename)) {
+        return remove_references<dfur_index_t>(index_filename, filenames_list, build_config,
+                                              compact, force);
+    } else if (is_hybrid(index_filename)) {
+        return remove_references<hfur_index_t>(index_filename, filenames_list, build_config,
+                                              compact, force);
+    }
+    std::cerr << "Wrong filename supplied." << std::endl;
+    return 1;
+}
+
+template <typename FulgorIndex>
+int subset(std::string const& index_filename, std::string const& refs_list,
+           build_configuration const& build_config, const bool force) {
+    FulgorIndex index;
+    essentials::logger("loading index from disk...");
+    essentials::load(index, index_filename.c_str());
+    essentials::logger("DONE");
+
+    std::vector<uint32_t> colors;
+    if (!parse_references(index, refs_list, colors)) return 1;
+    std::sort(colors.begin(), colors.end());
+    colors.erase(std::unique(colors.begin(), colors.end()), colors.end());
+    if (colors.empty()) {
+        std::cerr << "Error: no references selected." << std::endl;
+        return 1;
+    }
+    std::cout << "selected " << colors.size() << " of the " << index.num_colors()
+              << " references of the index" << std::endl;
+
+    return build_subset(index, index_filename, colors, build_config, true, force);
+}
+
+int subset(int argc, char** argv) {
+    cmd_line_parser::parser parser(argc, argv);
+    parser.add("index_filename", "The Fulgor index filename.", "-i", true);
+    parser.add("refs_list",
+               "List of the references to keep, one per line: either a filename of the index or "
+               "a color id.",
+               "--refs", true);
+    parser.add("file_base_name", "File basename of the new index.", "-o", true);
+    parser.add(
+        "tmp_dirname",
+        "Temporary directory used for construction in external memory. Default is directory '" +
+            constants::default_tmp_dirname + "'.",
+        "-d", false);
+    parser.add("RAM",
+               "RAM limit in GiB. Default value is " +
+                   std::to_string(constants::default_ram_limit_in_GiB) + ".",
+               "-g", false);
+    parser.add("num_threads", "Number of threads (default is 1).", "-t", false);
+    parser.add("verbose", "Verbose output during construction.", "--verbose", false, true);
+    parser.add("check", "Check correctness after index construction (it might take some time).",
+               "--check", false, true);
+    parser.add("force", "Re-build the index even when an index with the same name is found.",
+               "--force", false, true);
+    if (!parser.parse()) return 1;
+    util::print_cmd(argc, argv);
+
+    auto index_filename = parser.get<std::string>("index_filename");
+    auto refs_list = parser.get<std::string>("refs_list");
+
+    build_configuration build_config;
+    build_config.file_base_name = parser.get<std::string>("file_base_name");
+    build_config.verbose = parser.get<bool>("verbose");
+    build_config.check = parser.get<bool>("check");
+    if (parser.parsed("tmp_dirname")) {
+        build_config.tmp_dirname = parser.get<std::string>("tmp_dirname");
+        essentials::create_directory(build_config.tmp_dirname);
+    }
+    if (parser.parsed("RAM")) build_config.ram_limit_in_GiB = parser.get<uint64_t>("RAM");
+    if (parser.parsed("num_threads")) {
+        build_config.num_threads = parser.get<uint64_t>("num_threads");
+    }
+    const bool force = parser.get<bool>("force");
+
+    if (is_meta_roaring(index_filename)) {
+        return subset<mrfur_index_t>(index_filename, refs_list, build_config, force);
+    } else if (is_roaring(index_filename)) {
+        return subset<rfur_index_t>(index_filename, refs_list, build_config, force);
+    } else if (is_meta_diff(index_filename)) {
+        return subset<mdfur_index_t>(index_filename, refs_list, build_config, force);
+    } else if (is_meta(index_filename)) {
+        return subset<mfur_index_t>(index_filename, refs_list, build_config, force);
+    } else if (is_diff(index_filename)) {
+        return subset<dfur_index_t>(index_filename, refs_list, build_config, force);
+    } else if (is_hybrid(index_filename)) {
+        return subset<hfur_index_t>(index_filename, refs_list, build_config, force);
+    }
+    std::cerr << "Wrong filename supplied." << std::endl;
+    return 1;
+}
@@ -14,6 +14,15 @@ bool is_diff(std::string const& index_filename) {
     return sshash::util::ends_with(index_filename, constants::dfur_filename_extension);
 }
 
+/* check these first: their extensions end with that of hybrid indexes */
+bool is_meta_roaring(std::string const& index_filename) {
+    return sshash::util::ends_with(index_filename, constants::mrfur_filename_extension);
+}
+
+bool is_roaring(std::string const& index_filename) {
+    return sshash::util::ends_with(index_filename, constants::rfur_filename_extension);
+}
+
 bool is_hybrid(std::string const& index_filename) {
     return sshash::util::ends_with(index_filename, constants::hfur_filename_extension);
 }
@@ -236,7 +245,11 @@ int verify(int argc, char** argv) {
     if (!parser.parse()) return 1;
     util::print_cmd(argc, argv);
     auto index_filename = parser.get<std::string>("index_filename");
-    if (is_meta(index_filename)) {
+    if (is_meta_roaring(index_filename)) {
+        verify<mrfur_index_t>(index_filename);
+    } else if (is_roaring(index_filename)) {
+        verify<rfur_index_t>(index_filename);
+    } else if (is_meta(index_filename)) {
         verify<mfur_index_t>(index_filename);
     } else if (is_meta_diff(index_filename)) {
         verify<mdfur_index_t>(index_filename);
@@ -257,7 +270,11 @@ int stats(int argc, char** argv) {
     if (!parser.parse()) return 1;
     util::print_cmd(argc, argv);
     auto index_filename = parser.get<std::string>("index_filename");
-    if (is_meta(index_filename)) {
+    if (is_meta_roaring(index_filename)) {
+        print_stats<mrfur_index_t>(index_filename);
+    } else if (is_roaring(index_filename)) {
+        print_stats<rfur_index_t>(index_filename);
+    } else if (is_meta(index_filename)) {
         print_stats<mfur_index_t>(index_filename);
     } else if (is_meta_diff(index_filename)) {
         print_stats<mdfur_index_t>(index_filename);
@@ -278,7 +295,11 @@ int print_filenames(int argc, char** argv) {
     if (!parser.parse()) return 1;
     util::print_cmd(argc, argv);
     auto index_filename = parser.get<std::string>("index_filename");
-    if (is_meta_diff(index_filename)) {
+    if (is_meta_roaring(index_filename)) {
+        print_filenames<mrfur_index_t>(index_filename);
+    } else if (is_roaring(index_filename)) {
+        print_filenames<rfur_index_t>(index_filename);
+    } else if (is_meta_diff(index_filename)) {
         print_filenames<mdfur_index_t>(index_filename);
     } else if (is_meta(index_filename)) {
         print_filenames<mfur_index_t>(index_filename);
@@ -313,7 +334,19 @@ int dump(int argc, char** argv) {
 
     build_configuration build_config;
 
-    if (is_meta_diff(index_filename)) {
+    if (is_meta_roaring(index_filename)) {
+        std::string basename{
+            index_filename.data(),
+            index_filename.length() - constants::mrfur_filename_extension.length() - 1};
+        build_config.file_base_name = output_basename.length() == 0 ? basename : output_basename;
+        dump<mrfur_index_t>(index_filename, build_config);
+    } else if (is_roaring(index_filename)) {
+        std::string basename{
+            index_filename.data(),
+            index_filename.length() - constants::rfur_filename_extension.length() - 1};
+        build_config.file_base_name = output_basename.length() == 0 ? basename : output_basename;
+        dump<rfur_index_t>(index_filename, build_config);
+    } else if (is_meta_diff(index_filename)) {
         std::string basename{
             index_filename.data(),
             index_filename.length() - constants::mdfur_filename_extension.length() - 1};
@@ -425,7 +458,10 @@ int check(int argc, char** argv) {
     uint64_t num_threads = parser.parsed("num_threads") ? parser.get<uint64_t>("num_threads") : 1;
 
     std::variant<hfur_index_t, mdfur_index_t, mfur_index_t, dfur_index_t> base_index;
-    if (is_meta_diff(base_filename)) {
+    if (is_meta_roaring(base_filename) or is_roaring(base_filename)) {
+        std::cerr << "Wrong base index filename supplied." << std::endl;
+        return 1;
+    } else if (is_meta_diff(base_filename)) {
         base_index = mdfur_index_t();
     } else if (is_meta(base_filename)) {
         base_index = mfur_index_t();
@@ -438,8 +474,13 @@ int check(int argc, char** argv) {
         return 1;
     }
 
-    std::variant<mdfur_index_t, mfur_index_t, dfur_index_t> target_index;
-    if (is_meta_diff(target_filename)) {
+    std::variant<mdfur_index_t, mfur_index_t, dfur_index_t, mrfur_index_t, rfur_index_t>
+        target_index;
+    if (is_meta_roaring(target_filename)) {
+        target_index = mrfur_index_t();
+    } else if (is_roaring(target_filename)) {
+        target_index = rfur_index_t();
+    } else if (is_meta_diff(target_filename)) {
         target_index = mdfur_index_t();
     } else if (is_meta(target_filename)) {
         target_index = mfur_index_t();